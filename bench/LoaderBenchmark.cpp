@@ -0,0 +1,439 @@
+// Decodes large synthetic glTF meshes with the fused and the generic
+// primitive decoders and reports their timings as JSON.
+//
+//   lunar-loader-bench [--primitives N] [--vertices N] [--iterations N]
+//                      [--output PATH]
+//
+// Two layouts are generated: "float" stores every attribute as tightly
+// packed floats in its own buffer view, "quantized" interleaves
+// KHR_mesh_quantization types (u16 positions, i8 normals, u16 texture
+// coordinates, u8 colors) at a 20 byte stride. Decoding is single threaded
+// so the numbers compare the decoders, not the job system.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fastgltf/core.hpp>
+
+#include "Logger.h"
+#include "MeshDecoder.h"
+
+namespace {
+
+struct Options {
+	uint32_t primitives { 32 };
+	uint32_t vertices { 65536 };
+	uint32_t iterations { 10 };
+	std::filesystem::path output {};
+};
+
+auto parse_uint(std::string_view text) -> std::optional<uint32_t>
+{
+	uint32_t value {};
+	auto const [end, error] { std::from_chars(
+		text.data(), text.data() + text.size(), value) };
+	if (error != std::errc {} || end != text.data() + text.size())
+		return std::nullopt;
+	return value;
+}
+
+auto parse_options(std::span<char *> args) -> std::optional<Options>
+{
+	Options options {};
+	for (size_t i { 1 }; i < args.size(); i++) {
+		std::string_view const arg { args[i] };
+		if (i + 1 >= args.size())
+			return std::nullopt;
+		std::string_view const value { args[++i] };
+
+		if (arg == "--output") {
+			options.output = value;
+			continue;
+		}
+
+		auto const number { parse_uint(value) };
+		if (!number)
+			return std::nullopt;
+		if (arg == "--primitives")
+			options.primitives = std::max(*number, 1u);
+		else if (arg == "--vertices")
+			options.vertices = std::max(*number, 3u);
+		else if (arg == "--iterations")
+			options.iterations = std::max(*number, 1u);
+		else
+			return std::nullopt;
+	}
+	return options;
+}
+
+// Accumulates the binary buffer and the JSON for its views and accessors.
+struct GltfWriter {
+	std::vector<std::byte> bin;
+	std::vector<size_t> view_offsets;
+	std::vector<std::string> views;
+	std::vector<std::string> accessors;
+
+	auto view(size_t size, uint32_t stride, uint32_t target) -> size_t
+	{
+		bin.resize((bin.size() + 3) & ~size_t { 3 });
+		auto const offset { bin.size() };
+		bin.resize(offset + size);
+		view_offsets.emplace_back(offset);
+		views.emplace_back(std::format(
+		    "{{ \"buffer\": 0, \"byteOffset\": {}, \"byteLength\": {}{}, "
+		    "\"target\": {} }}",
+		    offset, size,
+		    stride ? std::format(", \"byteStride\": {}", stride) : "",
+		    target));
+		return views.size() - 1;
+	}
+
+	auto data(size_t view_index) -> std::byte *
+	{
+		return bin.data() + view_offsets[view_index];
+	}
+
+	auto accessor(size_t view_index, size_t offset, uint32_t component,
+	    size_t count, std::string_view type, bool normalized,
+	    std::string_view bounds = {}) -> size_t
+	{
+		accessors.emplace_back(std::format(
+		    "{{ \"bufferView\": {}, \"byteOffset\": {}, "
+		    "\"componentType\": {}, \"count\": {}, \"type\": \"{}\", "
+		    "\"normalized\": {}{} }}",
+		    view_index, offset, component, count, type, normalized, bounds));
+		return accessors.size() - 1;
+	}
+};
+
+constexpr uint32_t GL_BYTE { 5120 };
+constexpr uint32_t GL_UNSIGNED_BYTE { 5121 };
+constexpr uint32_t GL_UNSIGNED_SHORT { 5123 };
+constexpr uint32_t GL_UNSIGNED_INT { 5125 };
+constexpr uint32_t GL_FLOAT { 5126 };
+constexpr uint32_t GL_ARRAY_BUFFER { 34962 };
+constexpr uint32_t GL_ELEMENT_ARRAY_BUFFER { 34963 };
+
+template<typename T>
+auto store(std::byte *dst, T value) -> void
+{
+	std::memcpy(dst, &value, sizeof(T));
+}
+
+// Writes `<dir>/<layout>.gltf` and its buffer, returning the glTF path.
+auto generate(std::filesystem::path const &dir, std::string_view layout,
+    Options const &options) -> std::filesystem::path
+{
+	bool const quantized { layout == "quantized" };
+	std::mt19937 rng { 1234 };
+	std::uniform_real_distribution<float> unit { -1.0f, 1.0f };
+	std::uniform_int_distribution<uint32_t> index_dist { 0,
+		options.vertices - 1 };
+
+	GltfWriter writer;
+	std::vector<std::string> primitives;
+	size_t const vertices { options.vertices };
+	size_t const indices { vertices / 2 * 3 };
+	bool const short_indices { quantized && vertices <= 65536 };
+
+	for (uint32_t p { 0 }; p < options.primitives; p++) {
+		std::string attributes;
+		if (quantized) {
+			constexpr uint32_t STRIDE { 20 };
+			auto const view { writer.view(
+				vertices * STRIDE, STRIDE, GL_ARRAY_BUFFER) };
+			auto *dst { writer.data(view) };
+			for (size_t v { 0 }; v < vertices; v++, dst += STRIDE) {
+				for (size_t c { 0 }; c < 3; c++) {
+					store(dst + c * 2,
+					    static_cast<uint16_t>(rng() & 0xffff));
+					store(dst + 8 + c,
+					    static_cast<int8_t>(std::lround(unit(rng) * 127.0f)));
+				}
+				store(dst + 12, static_cast<uint16_t>(rng() & 0xffff));
+				store(dst + 14, static_cast<uint16_t>(rng() & 0xffff));
+				store(dst + 16, static_cast<uint32_t>(rng()));
+			}
+			attributes = std::format("\"POSITION\": {}, \"NORMAL\": {}, "
+			                         "\"TEXCOORD_0\": {}, \"COLOR_0\": {}",
+			    writer.accessor(view, 0, GL_UNSIGNED_SHORT, vertices, "VEC3",
+			        false,
+			        ", \"min\": [0, 0, 0], \"max\": [65535, 65535, 65535]"),
+			    writer.accessor(view, 8, GL_BYTE, vertices, "VEC3", true),
+			    writer.accessor(
+			        view, 12, GL_UNSIGNED_SHORT, vertices, "VEC2", true),
+			    writer.accessor(
+			        view, 16, GL_UNSIGNED_BYTE, vertices, "VEC4", true));
+		} else {
+			auto const floats { [&](uint32_t components, std::string_view type,
+				                    std::string_view bounds = {}) {
+				auto const view { writer.view(
+					vertices * components * sizeof(float), 0,
+					GL_ARRAY_BUFFER) };
+				auto *dst { writer.data(view) };
+				for (size_t i { 0 }; i < vertices * components; i++)
+					store(dst + i * sizeof(float), unit(rng));
+				return writer.accessor(
+				    view, 0, GL_FLOAT, vertices, type, false, bounds);
+			} };
+			auto const position { floats(3, "VEC3",
+				", \"min\": [-1, -1, -1], \"max\": [1, 1, 1]") };
+			auto const normal { floats(3, "VEC3") };
+			auto const uv { floats(2, "VEC2") };
+			auto const color { floats(4, "VEC4") };
+			attributes = std::format("\"POSITION\": {}, \"NORMAL\": {}, "
+			                         "\"TEXCOORD_0\": {}, \"COLOR_0\": {}",
+			    position, normal, uv, color);
+		}
+
+		auto const index_size { short_indices ? 2u : 4u };
+		auto const view { writer.view(
+			indices * index_size, 0, GL_ELEMENT_ARRAY_BUFFER) };
+		auto *dst { writer.data(view) };
+		for (size_t i { 0 }; i < indices; i++) {
+			auto const index { index_dist(rng) };
+			if (short_indices)
+				store(dst + i * 2, static_cast<uint16_t>(index));
+			else
+				store(dst + i * 4, index);
+		}
+		auto const index_accessor { writer.accessor(view, 0,
+			short_indices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, indices,
+			"SCALAR", false) };
+
+		primitives.emplace_back(
+		    std::format("{{ \"attributes\": {{ {} }}, \"indices\": {} }}",
+		        attributes, index_accessor));
+	}
+
+	auto const join { [](std::vector<std::string> const &items) {
+		std::string out;
+		for (auto const &item : items)
+			out += (out.empty() ? "\n    " : ",\n    ") + item;
+		return out;
+	} };
+
+	auto const bin_name { std::format("{}.bin", layout) };
+	std::ofstream { dir / bin_name, std::ios::binary }.write(
+	    reinterpret_cast<char const *>(writer.bin.data()),
+	    static_cast<std::streamsize>(writer.bin.size()));
+
+	auto const gltf_path { dir / std::format("{}.gltf", layout) };
+	std::ofstream { gltf_path } << std::format(
+	    "{{\n"
+	    "  \"asset\": {{ \"version\": \"2.0\" }},\n"
+	    "  {}"
+	    "  \"buffers\": [{{ \"uri\": \"{}\", \"byteLength\": {} }}],\n"
+	    "  \"bufferViews\": [{}],\n"
+	    "  \"accessors\": [{}],\n"
+	    "  \"meshes\": [{{ \"name\": \"synthetic\", \"primitives\": [{}] }}]\n"
+	    "}}\n",
+	    quantized ? "\"extensionsUsed\": [\"KHR_mesh_quantization\"],\n"
+	                "  \"extensionsRequired\": [\"KHR_mesh_quantization\"],\n"
+	              : "",
+	    bin_name, writer.bin.size(), join(writer.views),
+	    join(writer.accessors), join(primitives));
+
+	return gltf_path;
+}
+
+struct Result {
+	std::vector<double> generic_ms;
+	std::vector<double> fused_ms;
+	float max_error { 0.0f };
+	bool indices_match { true };
+};
+
+auto median(std::vector<double> samples) -> double
+{
+	std::ranges::sort(samples);
+	return samples[samples.size() / 2];
+}
+
+auto run(fastgltf::Asset const &gltf, Options const &options, Logger &logger)
+    -> Result
+{
+	auto const &primitives { gltf.meshes[0].primitives };
+	size_t vertex_total { 0 };
+	size_t index_total { 0 };
+	for (auto const &p : primitives) {
+		vertex_total
+		    += gltf.accessors[p.findAttribute("POSITION")->accessorIndex].count;
+		index_total += gltf.accessors[p.indicesAccessor.value()].count;
+	}
+
+	using Decoder = smath::Vec4 (*)(fastgltf::Asset const &,
+	    fastgltf::Primitive const &, uint32_t, std::span<Lunar::Vertex>,
+	    std::span<uint32_t>, Logger &);
+	auto const decode_all { [&](Decoder decoder,
+		                        std::vector<Lunar::Vertex> &vertices,
+		                        std::vector<uint32_t> &indices,
+		                        std::vector<smath::Vec4> &bounds) {
+		size_t first_vertex { 0 };
+		size_t first_index { 0 };
+		for (size_t i { 0 }; i < primitives.size(); i++) {
+			auto const &p { primitives[i] };
+			auto const vertex_count {
+				gltf.accessors[p.findAttribute("POSITION")->accessorIndex].count
+			};
+			auto const index_count {
+				gltf.accessors[p.indicesAccessor.value()].count
+			};
+			bounds[i] = decoder(gltf, p, static_cast<uint32_t>(first_vertex),
+			    std::span(vertices).subspan(first_vertex, vertex_count),
+			    std::span(indices).subspan(first_index, index_count), logger);
+			first_vertex += vertex_count;
+			first_index += index_count;
+		}
+	} };
+
+	std::vector<Lunar::Vertex> generic_vertices(vertex_total);
+	std::vector<Lunar::Vertex> fused_vertices(vertex_total);
+	std::vector<uint32_t> generic_indices(index_total);
+	std::vector<uint32_t> fused_indices(index_total);
+	std::vector<smath::Vec4> generic_bounds(primitives.size());
+	std::vector<smath::Vec4> fused_bounds(primitives.size());
+
+	Result result;
+	auto const time { [](auto &&function) {
+		auto const start { std::chrono::steady_clock::now() };
+		function();
+		return std::chrono::duration<double, std::milli>(
+		    std::chrono::steady_clock::now() - start)
+		    .count();
+	} };
+	// One untimed pass each so page faults on the output arrays do not
+	// count against whichever decoder runs first.
+	decode_all(Lunar::decode_primitive_generic, generic_vertices,
+	    generic_indices, generic_bounds);
+	decode_all(
+	    Lunar::decode_primitive, fused_vertices, fused_indices, fused_bounds);
+	for (uint32_t i { 0 }; i < options.iterations; i++) {
+		result.generic_ms.emplace_back(time([&] {
+			decode_all(Lunar::decode_primitive_generic, generic_vertices,
+			    generic_indices, generic_bounds);
+		}));
+		result.fused_ms.emplace_back(time([&] {
+			decode_all(Lunar::decode_primitive, fused_vertices, fused_indices,
+			    fused_bounds);
+		}));
+	}
+
+	auto const compare { [&](float a, float b) {
+		result.max_error = std::max(result.max_error, std::abs(a - b));
+	} };
+	for (size_t v { 0 }; v < vertex_total; v++) {
+		auto const &a { generic_vertices[v] };
+		auto const &b { fused_vertices[v] };
+		for (int c { 0 }; c < 3; c++) {
+			compare(a.position[c], b.position[c]);
+			compare(a.normal[c], b.normal[c]);
+		}
+		for (int c { 0 }; c < 4; c++)
+			compare(a.color[c], b.color[c]);
+		compare(a.u, b.u);
+		compare(a.v, b.v);
+	}
+	for (size_t i { 0 }; i < primitives.size(); i++) {
+		for (int c { 0 }; c < 4; c++)
+			compare(generic_bounds[i][c], fused_bounds[i][c]);
+	}
+	result.indices_match = generic_indices == fused_indices;
+
+	return result;
+}
+
+} // namespace
+
+auto main(int argc, char **argv) -> int
+{
+	auto const options { parse_options({ argv, static_cast<size_t>(argc) }) };
+	if (!options) {
+		std::println(std::cerr,
+		    "Usage: {} [--primitives N] [--vertices N] [--iterations N] "
+		    "[--output PATH]",
+		    argv[0]);
+		return 1;
+	}
+
+	Logger logger { "LunarBench" };
+	auto const dir { std::filesystem::temp_directory_path()
+		/ std::format("lunar-loader-bench-{}",
+		    std::chrono::steady_clock::now().time_since_epoch().count()) };
+	std::filesystem::create_directories(dir);
+
+	bool ok { true };
+	std::vector<std::string> layouts;
+	for (std::string_view const layout : { "float", "quantized" }) {
+		auto const path { generate(dir, layout, *options) };
+
+		auto data { fastgltf::GltfDataBuffer::FromPath(path) };
+		fastgltf::Parser parser { fastgltf::Extensions::KHR_mesh_quantization };
+		auto load { parser.loadGltf(
+			data.get(), dir, fastgltf::Options::LoadExternalBuffers) };
+		if (data.error() != fastgltf::Error::None
+		    || load.error() != fastgltf::Error::None) {
+			logger.err("Failed to load generated {}", path.string());
+			ok = false;
+			break;
+		}
+
+		auto const result { run(load.get(), *options, logger) };
+		auto const generic { median(result.generic_ms) };
+		auto const fused { median(result.fused_ms) };
+		// Both decoders use the same float math; anything beyond rounding
+		// noise is a decoding bug.
+		if (result.max_error > 1e-6f || !result.indices_match) {
+			logger.err("{}: decoders disagree (max error {}, indices {})",
+			    layout, result.max_error,
+			    result.indices_match ? "match" : "differ");
+			ok = false;
+		}
+
+		layouts.emplace_back(std::format(
+		    "    \"{}\": {{ \"generic_ms\": {:.3f}, \"fused_ms\": {:.3f}, "
+		    "\"speedup\": {:.2f}, \"max_error\": {} }}",
+		    layout, generic, fused, generic / fused, result.max_error));
+	}
+	std::filesystem::remove_all(dir);
+	if (!ok)
+		return 1;
+
+	auto const report { std::format("{{\n"
+		                            "  \"primitives\": {},\n"
+		                            "  \"vertices_per_primitive\": {},\n"
+		                            "  \"iterations\": {},\n"
+		                            "  \"layouts\": {{\n{},\n{}\n  }}\n"
+		                            "}}\n",
+		options->primitives, options->vertices, options->iterations,
+		layouts[0], layouts[1]) };
+
+	if (options->output.empty()) {
+		std::print("{}", report);
+	} else {
+		std::ofstream out { options->output };
+		out << report;
+		if (!out) {
+			logger.err("Failed to write {}", options->output.string());
+			return 1;
+		}
+		logger.info("Wrote {}", options->output.string());
+	}
+
+	return 0;
+}
@@ -0,0 +1,232 @@
+// Renders a synthetic scene headlessly and reports per-frame timings as JSON.
+//
+//   lunar-bench [--frames N] [--warmup N] [--meshes N] [--width W]
+//               [--height H] [--compact 0|1] [--mesh-shading 0|1]
+//               [--lods 0|1] [--output PATH]
+//
+// Every frame is waited on before the next one is recorded, so the numbers
+// describe one frame in isolation rather than pipelined throughput.
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Loader.h"
+#include "Logger.h"
+#include "VulkanRenderer.h"
+
+namespace {
+
+struct Options {
+	uint32_t frames { 300 };
+	uint32_t warmup { 30 };
+	uint32_t meshes { 1 };
+	uint32_t width { 1280 };
+	uint32_t height { 720 };
+	// Load the mesh with Lunar::VertexFormat::Compact vertices.
+	bool compact { false };
+	// Draw with task/mesh shaders where the device supports them.
+	bool mesh_shading { true };
+	// Simplify the mesh and pick a level of detail per instance.
+	bool lods { true };
+	std::filesystem::path output {};
+};
+
+auto parse_uint(std::string_view text) -> std::optional<uint32_t>
+{
+	uint32_t value {};
+	auto const [end, error] { std::from_chars(
+		text.data(), text.data() + text.size(), value) };
+	if (error != std::errc {} || end != text.data() + text.size())
+		return std::nullopt;
+	return value;
+}
+
+auto parse_options(std::span<char *> args) -> std::optional<Options>
+{
+	Options options {};
+	for (size_t i { 1 }; i < args.size(); i++) {
+		std::string_view const arg { args[i] };
+		if (i + 1 >= args.size())
+			return std::nullopt;
+		std::string_view const value { args[++i] };
+
+		if (arg == "--output") {
+			options.output = value;
+			continue;
+		}
+
+		auto const number { parse_uint(value) };
+		if (!number)
+			return std::nullopt;
+		if (arg == "--frames")
+			options.frames = std::max(*number, 1u);
+		else if (arg == "--warmup")
+			options.warmup = *number;
+		else if (arg == "--meshes")
+			options.meshes = *number;
+		else if (arg == "--width")
+			options.width = std::max(*number, 1u);
+		else if (arg == "--height")
+			options.height = std::max(*number, 1u);
+		else if (arg == "--compact")
+			options.compact = *number != 0;
+		else if (arg == "--mesh-shading")
+			options.mesh_shading = *number != 0;
+		else if (arg == "--lods")
+			options.lods = *number != 0;
+		else
+			return std::nullopt;
+	}
+	return options;
+}
+
+// Lays `count` copies of `mesh` out on a square grid facing the camera.
+auto populate(Lunar::Scene &scene, std::shared_ptr<Lunar::Mesh> const &mesh,
+    uint32_t count) -> void
+{
+	scene.clear();
+	if (count == 0)
+		return;
+
+	auto const side { static_cast<uint32_t>(
+		std::ceil(std::sqrt(static_cast<double>(count)))) };
+	auto const spacing { 4.0f / static_cast<float>(side) };
+	auto const scale { spacing * 0.4f };
+	auto const origin { -0.5f * spacing * static_cast<float>(side - 1) };
+
+	for (uint32_t i { 0 }; i < count; i++) {
+		auto transform { smath::Mat4::identity() };
+		transform[0][0] = scale;
+		transform[1][1] = scale;
+		transform[2][2] = scale;
+		transform[3][0] = origin + spacing * static_cast<float>(i % side);
+		transform[3][1] = origin + spacing * static_cast<float>(i / side);
+		scene.add(mesh, transform);
+	}
+}
+
+auto summarize(std::vector<double> samples) -> std::string
+{
+	if (samples.empty())
+		return "null";
+
+	std::ranges::sort(samples);
+	auto const percentile { [&](double p) {
+		auto const rank { static_cast<size_t>(
+			std::ceil(p / 100.0 * static_cast<double>(samples.size()))) };
+		return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+	} };
+	auto const mean { std::accumulate(samples.begin(), samples.end(), 0.0)
+		/ static_cast<double>(samples.size()) };
+
+	return std::format("{{ \"mean\": {:.4f}, \"min\": {:.4f}, \"p50\": {:.4f}, "
+	                   "\"p90\": {:.4f}, \"p95\": {:.4f}, \"p99\": {:.4f}, "
+	                   "\"max\": {:.4f} }}",
+	    mean, samples.front(), percentile(50.0), percentile(90.0),
+	    percentile(95.0), percentile(99.0), samples.back());
+}
+
+} // namespace
+
+auto main(int argc, char **argv) -> int
+{
+	auto const options { parse_options({ argv, static_cast<size_t>(argc) }) };
+	if (!options) {
+		std::println(std::cerr,
+		    "Usage: {} [--frames N] [--warmup N] [--meshes N] [--width W] "
+		    "[--height H] [--compact 0|1] [--mesh-shading 0|1] "
+		    "[--lods 0|1] [--output PATH]",
+		    argv[0]);
+		return 1;
+	}
+
+	Logger logger { "LunarBench" };
+	Lunar::VulkanRenderer renderer { nullptr, logger,
+		Lunar::RendererConfig {
+		    .frames_in_flight = 2,
+		    .recording_threads = 0,
+		    .pipeline_cache_path = {},
+		    .mesh_cache_directory = {},
+		    .headless = true,
+		    .headless_extent = { options->width, options->height },
+		    .validation = false,
+		    .mesh_shading = options->mesh_shading,
+		    .lod_pixel_error = options->lods ? 1.0f : 0.0f,
+		} };
+
+	auto const meshes { Lunar::Mesh::load_gltf_meshes(renderer,
+		"assets/basicmesh.glb",
+		Lunar::MeshLoadOptions {
+		    .optimize = true,
+		    .vertex_format = options->compact ? Lunar::VertexFormat::Compact
+		                                      : Lunar::VertexFormat::Full,
+		    .meshlets = true,
+		    .lods = options->lods,
+		}) };
+	if (!meshes || meshes->size() < 3) {
+		logger.err("Failed to load assets/basicmesh.glb");
+		return 1;
+	}
+	populate(renderer.scene(), meshes->at(2), options->meshes);
+
+	// Pipelines compile in the background; they must all be ready before
+	// the frames count.
+	for (uint32_t frame { 0 };
+	    frame < options->warmup || !renderer.pipelines_ready(); frame++) {
+		renderer.render();
+		renderer.wait_last_frame();
+	}
+
+	std::vector<double> record_ms, latency_ms, gpu_ms;
+	for (uint32_t frame { 0 }; frame < options->frames; frame++) {
+		renderer.render();
+		auto const timings { renderer.wait_last_frame() };
+		record_ms.emplace_back(timings.record_ms);
+		latency_ms.emplace_back(timings.latency_ms);
+		if (timings.gpu_ms)
+			gpu_ms.emplace_back(*timings.gpu_ms);
+	}
+
+	auto const report { std::format(
+		"{{\n"
+		"  \"device\": \"{}\",\n"
+		"  \"scene\": {{ \"meshes\": {}, \"width\": {}, \"height\": {}, "
+		"\"compact\": {}, \"mesh_shading\": {}, \"lods\": {} }},\n"
+		"  \"frames\": {},\n"
+		"  \"record_ms\": {},\n"
+		"  \"latency_ms\": {},\n"
+		"  \"gpu_ms\": {}\n"
+		"}}\n",
+		renderer.device_name(), options->meshes, options->width,
+		options->height, options->compact, renderer.mesh_shading(),
+		options->lods, options->frames, summarize(record_ms),
+		summarize(latency_ms), summarize(gpu_ms)) };
+
+	if (options->output.empty()) {
+		std::print("{}", report);
+	} else {
+		std::ofstream out { options->output };
+		out << report;
+		if (!out) {
+			logger.err("Failed to write {}", options->output.string());
+			return 1;
+		}
+		logger.info("Wrote {}", options->output.string());
+	}
+
+	return 0;
+}
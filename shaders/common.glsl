@@ -0,0 +1,142 @@
+// Layouts shared with the renderer, see the C++ types each one mirrors, and
+// the culling both GPU-driven paths do. Including shaders enable
+// GL_EXT_buffer_reference.
+#ifndef COMMON_GLSL
+#define COMMON_GLSL
+
+// Vertex in Types.h.
+struct Vertex {
+	vec3 position;
+	float uv_x;
+	vec3 normal;
+	float uv_y;
+	vec4 color;
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer {
+	Vertex vertices[];
+};
+
+// CompactVertex in Types.h: unorm16 position within the mesh bounds,
+// octahedral snorm16 normal, half float uv and unorm8 color.
+struct CompactVertex {
+	uint position_xy;
+	uint position_z;
+	uint normal;
+	uint uv;
+	uint color;
+};
+
+layout(buffer_reference, std430) readonly buffer CompactVertexBuffer {
+	CompactVertex vertices[];
+};
+
+const uint VERTEX_FORMAT_FULL = 0;
+const uint VERTEX_FORMAT_COMPACT = 1;
+
+vec3 decode_octahedral(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx))
+			* mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));
+	return normalize(n);
+}
+
+Vertex fetch_vertex(VertexBuffer buffer, uint format, vec3 offset,
+	vec3 scale, uint index) {
+	if (format != VERTEX_FORMAT_COMPACT)
+		return buffer.vertices[index];
+
+	CompactVertex c = CompactVertexBuffer(buffer).vertices[index];
+	vec3 q = vec3(unpackUnorm2x16(c.position_xy), unpackUnorm2x16(c.position_z).x);
+	vec2 uv = unpackHalf2x16(c.uv);
+
+	Vertex v;
+	v.position = offset + q * scale;
+	v.uv_x = uv.x;
+	v.normal = decode_octahedral(unpackSnorm2x16(c.normal));
+	v.uv_y = uv.y;
+	v.color = unpackUnorm4x8(c.color);
+	return v;
+}
+
+// Meshlet in Meshlets.h.
+struct Meshlet {
+	vec3 center;
+	float radius;
+	vec3 cone_axis;
+	float cone_cutoff;
+	uint vertex_offset;
+	uint triangle_offset;
+	uint vertex_count;
+	uint triangle_count;
+};
+
+layout(buffer_reference, std430) readonly buffer MeshletBuffer {
+	Meshlet meshlets[];
+};
+
+// MAX_LODS in Types.h.
+const uint MAX_LODS = 4;
+
+// GPULod in VulkanRenderer.h.
+struct Lod {
+	MeshletBuffer meshlets;
+	uint first_index;
+	uint index_count;
+	uint meshlet_count;
+	float error;
+};
+
+// GPUInstance in VulkanRenderer.h.
+struct Instance {
+	mat4 model;
+	vec4 bounds;
+	vec3 position_offset;
+	uint vertex_format;
+	vec3 position_scale;
+	uint lod_count;
+	VertexBuffer vertex_buffer;
+	uvec2 padding;
+	Lod lods[MAX_LODS];
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBuffer {
+	Instance instances[];
+};
+
+// Gribb/Hartmann, with planes normalized so signed distances compare
+// against sphere radii directly.
+bool sphere_in_frustum(mat4 view_proj, vec3 center, float radius) {
+	mat4 m = view_proj;
+	vec4 r0 = vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+	vec4 r1 = vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+	vec4 r2 = vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+	vec4 r3 = vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+	vec4 planes[6] = vec4[6](r3 + r0, r3 - r0, r3 + r1, r3 - r1, r3 + r2,
+		r3 - r2);
+	for (int i = 0; i < 6; i++) {
+		vec4 plane = planes[i] / length(planes[i].xyz);
+		if (dot(plane.xyz, center) + plane.w < -radius)
+			return false;
+	}
+	return true;
+}
+
+// The coarsest level whose error stays within the pixel budget at the
+// sphere's nearest view depth; `lod_scale` as VulkanRenderer::lod_scale().
+uint select_lod(Instance inst, mat4 view_proj, float lod_scale, vec3 center,
+	float radius, float scale) {
+	mat4 m = view_proj;
+	vec4 w_row = vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+	float depth = dot(w_row, vec4(center, 1.0)) - radius;
+	uint lod = 0;
+	for (uint i = 1; i < inst.lod_count; i++) {
+		if (inst.lods[i].error * scale * lod_scale > depth)
+			break;
+		lod = i;
+	}
+	return lod;
+}
+
+#endif // COMMON_GLSL
@@ -0,0 +1,24 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "common.glsl"
+
+layout (location = 0) out vec3 out_color;
+layout (location = 1) out vec3 out_uv;
+
+layout(push_constant) uniform constants {
+	mat4 view_proj;
+	InstanceBuffer instances;
+} PushConstants;
+
+void main() {
+	Instance inst = PushConstants.instances.instances[gl_InstanceIndex];
+	Vertex v = fetch_vertex(inst.vertex_buffer, inst.vertex_format,
+		inst.position_offset, inst.position_scale, uint(gl_VertexIndex));
+
+	gl_Position = PushConstants.view_proj * inst.model * vec4(v.position, 1.0f);
+	out_color = v.color.xyz;
+	out_uv.x = v.uv_x;
+	out_uv.y = v.uv_y;
+}
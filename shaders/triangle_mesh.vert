@@ -1,28 +1,25 @@
 #version 450
 #extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "common.glsl"
 
 layout (location = 0) out vec3 out_color;
 layout (location = 1) out vec3 out_uv;
 
-struct Vertex {
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	vec4 color;
-};
-
-layout(buffer_reference, std430) readonly buffer VertexBuffer{
-	Vertex vertices[];
-};
-
 layout(push_constant) uniform constants {
 	mat4 world_matrix;
+	vec3 position_offset;
+	uint vertex_format;
+	vec3 position_scale;
+	uint padding;
 	VertexBuffer vertex_buffer;
 } PushConstants;
 
 void main() {
-	Vertex v = PushConstants.vertex_buffer.vertices[gl_VertexIndex];
+	Vertex v = fetch_vertex(PushConstants.vertex_buffer,
+		PushConstants.vertex_format, PushConstants.position_offset,
+		PushConstants.position_scale, uint(gl_VertexIndex));
 
 	gl_Position = PushConstants.world_matrix * vec4(v.position, 1.0f);
 	out_color = v.color.xyz;
@@ -0,0 +1,52 @@
+#version 460
+
+layout (set = 0, binding = 0) uniform sampler2D source;
+
+layout (push_constant) uniform constants {
+	// The rendered corner of the source, in texels.
+	vec2 source_size;
+	// The whole source image.
+	vec2 image_size;
+} PushConstants;
+
+layout (location = 0) in vec2 in_uv;
+
+layout (location = 0) out vec4 out_color;
+
+// Bilinear fetch that never reaches past the rendered corner.
+vec3 fetch(vec2 texel) {
+	texel = clamp(texel, vec2(0.5), PushConstants.source_size - 0.5);
+	return textureLod(source, texel / PushConstants.image_size, 0.0).rgb;
+}
+
+// Catmull-Rom over the 4x4 texels around the sample. The two middle
+// weights of each axis are merged into one bilinear fetch, which takes
+// 9 fetches instead of 16 and makes a scale of 1 a plain copy.
+void main() {
+	vec2 position = in_uv * PushConstants.source_size;
+	vec2 center = floor(position - 0.5) + 0.5;
+	vec2 f = position - center;
+
+	vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+	vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+	vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+	vec2 w3 = f * f * (-0.5 + 0.5 * f);
+	vec2 w12 = w1 + w2;
+
+	vec2 p0 = center - 1.0;
+	vec2 p12 = center + w2 / w12;
+	vec2 p3 = center + 2.0;
+
+	vec3 color = fetch(vec2(p0.x, p0.y)) * w0.x * w0.y
+		+ fetch(vec2(p12.x, p0.y)) * w12.x * w0.y
+		+ fetch(vec2(p3.x, p0.y)) * w3.x * w0.y
+		+ fetch(vec2(p0.x, p12.y)) * w0.x * w12.y
+		+ fetch(vec2(p12.x, p12.y)) * w12.x * w12.y
+		+ fetch(vec2(p3.x, p12.y)) * w3.x * w12.y
+		+ fetch(vec2(p0.x, p3.y)) * w0.x * w3.y
+		+ fetch(vec2(p12.x, p3.y)) * w12.x * w3.y
+		+ fetch(vec2(p3.x, p3.y)) * w3.x * w3.y;
+
+	// The negative lobes can overshoot below black.
+	out_color = vec4(max(color, vec3(0.0)), 1.0);
+}
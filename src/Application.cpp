@@ -1,5 +1,7 @@
 #include "Application.h"
 
+#include <cfloat>
+#include <filesystem>
 #include <iostream>
 #include <print>
 #include <stdexcept>
@@ -12,6 +14,7 @@
 #include <imgui_impl_sdl3.h>
 #include <imgui_impl_vulkan.h>
 
+#include "Paths.h"
 #include "Util.h"
 #include "VulkanRenderer.h"
 
@@ -31,7 +34,14 @@ Application::Application()
 		throw std::runtime_error("App init fail");
 	}
 
-	m_renderer = std::make_unique<VulkanRenderer>(m_window, m_logger);
+	m_renderer = std::make_unique<VulkanRenderer>(m_window, m_logger,
+	    RendererConfig {
+	        .frames_in_flight = 3,
+	        .pipeline_cache_path
+	        = cache_directory("Lunar") / "pipeline_cache.bin",
+	        .mesh_cache_directory = cache_directory("Lunar") / "meshes",
+	        .dynamic_resolution = true,
+	    });
 
 	mouse_captured(true);
 
@@ -58,6 +68,9 @@ auto Application::run() -> void
 	uint64_t last { 0 };
 	float fps { 0.0f };
 	while (m_running) {
+		// Input is sampled as late as the frame pacer allows.
+		m_renderer->pace_frame();
+
 		uint64_t now { SDL_GetTicks() };
 		uint64_t dt { now - last };
 		last = now;
@@ -91,14 +104,71 @@ auto Application::run() -> void
 		if (m_show_imgui) {
 			ImGui::ShowDemoWindow();
 
-			ImGui::SetNextWindowSize({ 100, 50 });
 			ImGui::SetNextWindowPos({ 0, 0 });
 			ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4 { 0, 0, 0, 0.5f });
 			if (ImGui::Begin("Debug Info", nullptr,
-			        ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize)) {
+			        ImGuiWindowFlags_NoTitleBar
+			            | ImGuiWindowFlags_AlwaysAutoResize)) {
 				defer(ImGui::End());
 
 				ImGui::Text("%s", std::format("FPS: {:.2f}", fps).c_str());
+				ImGui::Text("%s",
+				    std::format("Scale: {:.0f}%",
+				        m_renderer->resolution_scale() * 100.0f)
+				        .c_str());
+				ImGui::Text("%s",
+				    std::format("Latency: {:.1f} ms{}",
+				        m_renderer->latency_ms(),
+				        m_renderer->present_wait() ? "" : " (GPU)")
+				        .c_str());
+
+				auto const current { m_renderer->present_mode() };
+				if (ImGui::BeginCombo("Present",
+				        present_mode_name(current).data())) {
+					for (auto const mode :
+					    { PresentMode::Fifo, PresentMode::FifoRelaxed,
+					        PresentMode::Mailbox, PresentMode::Immediate }) {
+						if (ImGui::Selectable(present_mode_name(mode).data(),
+						        mode == current))
+							m_renderer->set_present_mode(mode);
+					}
+					ImGui::EndCombo();
+				}
+				auto low_latency { m_renderer->low_latency() };
+				if (ImGui::Checkbox("Low latency", &low_latency))
+					m_renderer->set_low_latency(low_latency);
+
+				auto const &profiler { m_renderer->gpu_profiler() };
+				if (profiler.enabled() && !profiler.history().empty()
+				    && ImGui::CollapsingHeader("GPU")) {
+					auto const &latest { profiler.history().back() };
+					for (auto const &scope : latest.scopes) {
+						auto const values { profiler.series(scope.name) };
+						auto const overlay { std::format(
+							"{:.3f} ms", scope.duration_ms) };
+						ImGui::PlotLines(scope.name.c_str(), values.data(),
+						    static_cast<int>(values.size()), 0,
+						    overlay.c_str(), 0.0f, FLT_MAX, { 240, 40 });
+						if (scope.statistics && ImGui::IsItemHovered()) {
+							auto const &s { *scope.statistics };
+							ImGui::SetTooltip("%s",
+							    std::format("Vertices: {}\nPrimitives: {}\n"
+							                "Clipped: {}\nFragments: {}\n"
+							                "Compute: {}",
+							        s.input_vertices, s.input_primitives,
+							        s.clipping_primitives,
+							        s.fragment_invocations,
+							        s.compute_invocations)
+							        .c_str());
+						}
+					}
+					if (ImGui::Button("Export GPU profile")) {
+						auto const directory { cache_directory("Lunar") };
+						std::error_code ec;
+						std::filesystem::create_directories(directory, ec);
+						profiler.export_csv(directory / "gpu_profile.csv");
+					}
+				}
 			}
 			ImGui::PopStyleColor();
 		}
@@ -0,0 +1,101 @@
+#include "BarrierBuilder.h"
+
+namespace Lunar {
+
+auto BarrierBuilder::range(VkImageAspectFlags aspect, uint32_t base_mip,
+    uint32_t mip_count, uint32_t base_layer, uint32_t layer_count)
+    -> VkImageSubresourceRange
+{
+	return {
+		.aspectMask = aspect,
+		.baseMipLevel = base_mip,
+		.levelCount = mip_count,
+		.baseArrayLayer = base_layer,
+		.layerCount = layer_count,
+	};
+}
+
+auto BarrierBuilder::image(VkImage image, VkImageLayout old_layout,
+    SyncScope src, VkImageLayout new_layout, SyncScope dst,
+    VkImageSubresourceRange const &subresource) -> BarrierBuilder &
+{
+	m_images.emplace_back(VkImageMemoryBarrier2 {
+	    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+	    .pNext = nullptr,
+	    .srcStageMask = src.stage,
+	    .srcAccessMask = src.access,
+	    .dstStageMask = dst.stage,
+	    .dstAccessMask = dst.access,
+	    .oldLayout = old_layout,
+	    .newLayout = new_layout,
+	    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .image = image,
+	    .subresourceRange = subresource,
+	});
+
+	return *this;
+}
+
+auto BarrierBuilder::buffer(VkBuffer buffer, SyncScope src, SyncScope dst,
+    VkDeviceSize offset, VkDeviceSize size) -> BarrierBuilder &
+{
+	m_buffers.emplace_back(VkBufferMemoryBarrier2 {
+	    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+	    .pNext = nullptr,
+	    .srcStageMask = src.stage,
+	    .srcAccessMask = src.access,
+	    .dstStageMask = dst.stage,
+	    .dstAccessMask = dst.access,
+	    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	    .buffer = buffer,
+	    .offset = offset,
+	    .size = size,
+	});
+
+	return *this;
+}
+
+auto BarrierBuilder::memory(SyncScope src, SyncScope dst) -> BarrierBuilder &
+{
+	m_memory.emplace_back(VkMemoryBarrier2 {
+	    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+	    .pNext = nullptr,
+	    .srcStageMask = src.stage,
+	    .srcAccessMask = src.access,
+	    .dstStageMask = dst.stage,
+	    .dstAccessMask = dst.access,
+	});
+
+	return *this;
+}
+
+auto BarrierBuilder::record(VkCommandBuffer cmd) -> void
+{
+	if (empty())
+		return;
+
+	VkDependencyInfo dep_info {};
+	dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dep_info.pNext = nullptr;
+	dep_info.memoryBarrierCount = static_cast<uint32_t>(m_memory.size());
+	dep_info.pMemoryBarriers = m_memory.data();
+	dep_info.bufferMemoryBarrierCount = static_cast<uint32_t>(m_buffers.size());
+	dep_info.pBufferMemoryBarriers = m_buffers.data();
+	dep_info.imageMemoryBarrierCount = static_cast<uint32_t>(m_images.size());
+	dep_info.pImageMemoryBarriers = m_images.data();
+
+	vkCmdPipelineBarrier2(cmd, &dep_info);
+
+	clear();
+}
+
+auto BarrierBuilder::clear() -> void
+{
+	m_images.clear();
+	m_buffers.clear();
+	m_memory.clear();
+}
+
+} // namespace Lunar
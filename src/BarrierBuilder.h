@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+namespace Lunar {
+
+// One side of a dependency: the pipeline stages and the accesses within them.
+struct SyncScope {
+	VkPipelineStageFlags2 stage;
+	VkAccessFlags2 access;
+};
+
+namespace sync {
+
+constexpr SyncScope NONE { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE };
+constexpr SyncScope COMPUTE_WRITE {
+	VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+	VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+};
+constexpr SyncScope COMPUTE_READ_WRITE {
+	VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+	VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+};
+constexpr SyncScope COLOR_ATTACHMENT {
+	VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+	VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT
+	    | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+};
+constexpr SyncScope COLOR_ATTACHMENT_WRITE {
+	VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+	VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+};
+constexpr SyncScope DEPTH_ATTACHMENT {
+	VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT
+	    | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+	VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+	    | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+};
+constexpr SyncScope BLIT_READ {
+	VK_PIPELINE_STAGE_2_BLIT_BIT,
+	VK_ACCESS_2_TRANSFER_READ_BIT,
+};
+constexpr SyncScope BLIT_WRITE {
+	VK_PIPELINE_STAGE_2_BLIT_BIT,
+	VK_ACCESS_2_TRANSFER_WRITE_BIT,
+};
+constexpr SyncScope FRAGMENT_SAMPLED_READ {
+	VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+	VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+};
+constexpr SyncScope COPY_WRITE {
+	VK_PIPELINE_STAGE_2_COPY_BIT,
+	VK_ACCESS_2_TRANSFER_WRITE_BIT,
+};
+constexpr SyncScope CLEAR_WRITE {
+	VK_PIPELINE_STAGE_2_CLEAR_BIT,
+	VK_ACCESS_2_TRANSFER_WRITE_BIT,
+};
+constexpr SyncScope INDIRECT_READ {
+	VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+	VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+};
+constexpr SyncScope GEOMETRY_READ {
+	VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT
+	    | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT
+	    | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+	VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT
+	    | VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+};
+
+} // namespace sync
+
+// Collects image, buffer and global memory barriers with explicit source and
+// destination scopes and records them as a single vkCmdPipelineBarrier2.
+struct BarrierBuilder {
+	static auto range(VkImageAspectFlags aspect, uint32_t base_mip = 0,
+	    uint32_t mip_count = VK_REMAINING_MIP_LEVELS, uint32_t base_layer = 0,
+	    uint32_t layer_count = VK_REMAINING_ARRAY_LAYERS)
+	    -> VkImageSubresourceRange;
+
+	auto image(VkImage image, VkImageLayout old_layout, SyncScope src,
+	    VkImageLayout new_layout, SyncScope dst,
+	    VkImageSubresourceRange const &subresource
+	    = range(VK_IMAGE_ASPECT_COLOR_BIT)) -> BarrierBuilder &;
+	auto buffer(VkBuffer buffer, SyncScope src, SyncScope dst,
+	    VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE)
+	    -> BarrierBuilder &;
+	auto memory(SyncScope src, SyncScope dst) -> BarrierBuilder &;
+
+	auto empty() const -> bool
+	{
+		return m_images.empty() && m_buffers.empty() && m_memory.empty();
+	}
+	// Records every collected barrier and clears the builder for reuse.
+	auto record(VkCommandBuffer cmd) -> void;
+	auto clear() -> void;
+
+private:
+	std::vector<VkImageMemoryBarrier2> m_images;
+	std::vector<VkBufferMemoryBarrier2> m_buffers;
+	std::vector<VkMemoryBarrier2> m_memory;
+};
+
+} // namespace Lunar
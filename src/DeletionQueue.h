@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <deque>
 #include <functional>
+#include <utility>
 
 namespace Lunar {
 
@@ -22,4 +24,32 @@ struct DeletionQueue {
 	}
 };
 
+// Deletors tagged with the timeline value after which the GPU no longer
+// references what they destroy. Values must be enqueued in non-decreasing
+// order.
+struct TimelineDeletionQueue {
+	std::deque<std::pair<uint64_t, std::function<void()>>> deletors;
+
+	auto emplace(uint64_t value, std::function<void()> &&fn) -> void
+	{
+		deletors.emplace_back(value, std::move(fn));
+	}
+
+	auto collect(uint64_t completed_value) -> void
+	{
+		while (!deletors.empty() && deletors.front().first <= completed_value) {
+			deletors.front().second();
+			deletors.pop_front();
+		}
+	}
+
+	auto flush() -> void
+	{
+		for (auto &[value, fn] : deletors) {
+			fn();
+		}
+		deletors.clear();
+	}
+};
+
 } // namespace Lunar
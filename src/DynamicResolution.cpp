@@ -0,0 +1,82 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Lunar {
+
+// Share of the budget a new scale aims for.
+constexpr double TARGET_LOAD { 0.85 };
+// Averages above this share of the budget lower the scale.
+constexpr double LOWER_LOAD { 0.95 };
+// Averages below this share count as headroom.
+constexpr double RAISE_LOAD { 0.7 };
+// Frames of headroom before the scale rises.
+constexpr uint32_t RAISE_FRAMES { 30 };
+// The rendered area grows by at most this factor per step.
+constexpr double MAX_AREA_GROWTH { 1.1 };
+constexpr double AVERAGE_WEIGHT { 0.1 };
+// Smaller changes are not worth the differently sized frames.
+constexpr float MIN_STEP { 0.01f };
+
+auto DynamicResolution::init(float min_scale, float max_scale, double budget_ms)
+    -> void
+{
+	m_max_scale = std::clamp(max_scale, 0.1f, 1.0f);
+	m_min_scale = std::clamp(min_scale, 0.1f, m_max_scale);
+	m_budget_ms = budget_ms;
+	m_scale = m_max_scale;
+	m_samples = 0;
+	m_headroom_frames = 0;
+}
+
+auto DynamicResolution::update(double gpu_ms, float frame_scale) -> float
+{
+	if (m_budget_ms <= 0.0 || frame_scale != m_scale)
+		return m_scale;
+
+	m_average_ms = m_samples == 0
+	    ? gpu_ms
+	    : m_average_ms + (gpu_ms - m_average_ms) * AVERAGE_WEIGHT;
+	m_samples++;
+
+	// Scale that brings `ms` to the target load.
+	auto const fit { [&](double ms) {
+		return m_scale
+		    * static_cast<float>(std::sqrt(TARGET_LOAD * m_budget_ms / ms));
+	} };
+
+	// A single frame over budget already misses the deadline, so spikes
+	// are answered right away rather than once the average catches up.
+	if (gpu_ms > m_budget_ms) {
+		set_scale(fit(gpu_ms));
+	} else if (m_average_ms > LOWER_LOAD * m_budget_ms) {
+		set_scale(fit(m_average_ms));
+	} else if (m_average_ms < RAISE_LOAD * m_budget_ms) {
+		if (++m_headroom_frames >= RAISE_FRAMES) {
+			auto const limit { m_scale
+				* static_cast<float>(std::sqrt(MAX_AREA_GROWTH)) };
+			set_scale(std::min(fit(m_average_ms), limit));
+		}
+	} else {
+		m_headroom_frames = 0;
+	}
+
+	return m_scale;
+}
+
+auto DynamicResolution::set_scale(float scale) -> void
+{
+	scale = std::clamp(scale, m_min_scale, m_max_scale);
+	if (std::abs(scale - m_scale) < MIN_STEP && scale != m_min_scale
+	    && scale != m_max_scale)
+		return;
+	if (scale == m_scale)
+		return;
+
+	m_scale = scale;
+	m_samples = 0;
+	m_headroom_frames = 0;
+}
+
+} // namespace Lunar
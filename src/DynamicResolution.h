@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Lunar {
+
+// Picks the scale frames render at so their GPU time stays under a budget.
+// Time is taken to grow with the rendered area, the square of the scale.
+// A frame over budget lowers the scale at once; it only rises again after
+// a run of frames with clear headroom, so it does not oscillate around the
+// budget.
+struct DynamicResolution {
+	auto init(float min_scale, float max_scale, double budget_ms) -> void;
+
+	// Feeds the GPU time of a frame rendered at `frame_scale` and returns
+	// the scale for the next one. Frames rendered before the last change
+	// are ignored.
+	auto update(double gpu_ms, float frame_scale) -> float;
+
+	auto scale() const -> float { return m_scale; }
+	auto budget_ms() const -> double { return m_budget_ms; }
+
+private:
+	auto set_scale(float scale) -> void;
+
+	float m_min_scale { 1.0f };
+	float m_max_scale { 1.0f };
+	double m_budget_ms { 0.0 };
+	float m_scale { 1.0f };
+	// Moving average of the frames rendered at the current scale.
+	double m_average_ms { 0.0 };
+	uint32_t m_samples { 0 };
+	// Consecutive frames with room to raise the scale.
+	uint32_t m_headroom_frames { 0 };
+};
+
+} // namespace Lunar
@@ -0,0 +1,183 @@
+#include "GeometryBuffer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "BarrierBuilder.h"
+#include "Util.h"
+
+namespace Lunar {
+
+constexpr auto CATEGORY { Logger::Category::Renderer };
+
+auto GeometryBuffer::init(Logger &logger, VkDevice dev, VmaAllocator allocator,
+    VkDeviceSize capacity) -> void
+{
+	m_logger = &logger;
+	m_dev = dev;
+	m_vma = allocator;
+
+	create_buffer(capacity);
+	m_allocator.init(capacity);
+}
+
+auto GeometryBuffer::destroy() -> void
+{
+	for (auto &relocation : m_relocations) {
+		vmaDestroyBuffer(
+		    m_vma, relocation.src.buffer, relocation.src.allocation);
+	}
+	m_relocations.clear();
+
+	if (m_buffer.buffer != VK_NULL_HANDLE) {
+		vmaDestroyBuffer(m_vma, m_buffer.buffer, m_buffer.allocation);
+		m_buffer = {};
+	}
+	m_ranges.clear();
+	m_free_handles.clear();
+}
+
+auto GeometryBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment)
+    -> GeometryHandle
+{
+	auto offset { m_allocator.allocate(size, alignment) };
+	if (!offset) {
+		auto new_capacity { std::max<VkDeviceSize>(capacity(), 1) };
+		while (new_capacity < used_bytes() + size + alignment)
+			new_capacity *= 2;
+		if (new_capacity == capacity())
+			new_capacity *= 2;
+
+		m_logger->info(CATEGORY, "Growing geometry buffer from {} to {} KiB",
+		    capacity() / 1024, new_capacity / 1024);
+		rebuild(new_capacity);
+
+		offset = m_allocator.allocate(size, alignment);
+		if (!offset) {
+			m_logger->err(CATEGORY,
+			    "Geometry buffer allocation of {} bytes failed", size);
+			throw std::runtime_error("Geometry buffer out of memory");
+		}
+	}
+
+	Range range {
+		.offset = *offset,
+		.size = size,
+		.alignment = alignment,
+		.live = true,
+	};
+
+	if (!m_free_handles.empty()) {
+		auto const handle { m_free_handles.back() };
+		m_free_handles.pop_back();
+		m_ranges[handle] = range;
+		return handle;
+	}
+
+	m_ranges.emplace_back(range);
+	return static_cast<GeometryHandle>(m_ranges.size() - 1);
+}
+
+auto GeometryBuffer::free(GeometryHandle handle) -> void
+{
+	auto &range { m_ranges.at(handle) };
+	if (!range.live)
+		return;
+
+	m_allocator.free(range.offset, range.size);
+	range.live = false;
+	m_free_handles.emplace_back(handle);
+}
+
+auto GeometryBuffer::fragmentation() const -> float
+{
+	auto const free_bytes { m_allocator.free_bytes() };
+	if (free_bytes == 0)
+		return 0.0f;
+
+	return 1.0f
+	    - static_cast<float>(m_allocator.largest_free_block())
+	    / static_cast<float>(free_bytes);
+}
+
+auto GeometryBuffer::defragment() -> void { rebuild(capacity()); }
+
+auto GeometryBuffer::record_relocations(VkCommandBuffer cmd,
+    TimelineDeletionQueue &retired, uint64_t retire_value) -> void
+{
+	for (auto &relocation : m_relocations) {
+		if (!relocation.regions.empty()) {
+			vkCmdCopyBuffer(cmd, relocation.src.buffer, relocation.dst,
+			    static_cast<uint32_t>(relocation.regions.size()),
+			    relocation.regions.data());
+		}
+
+		// Later relocations read what this one wrote, and the frame reads the
+		// final buffer.
+		BarrierBuilder {}
+		    .memory(sync::COPY_WRITE, sync::GEOMETRY_READ)
+		    .record(cmd);
+
+		retired.emplace(retire_value, [vma = m_vma, src = relocation.src]() {
+			vmaDestroyBuffer(vma, src.buffer, src.allocation);
+		});
+	}
+	m_relocations.clear();
+}
+
+auto GeometryBuffer::create_buffer(VkDeviceSize capacity) -> void
+{
+	VkBufferCreateInfo buffer_ci {};
+	buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_ci.size = capacity;
+	buffer_ci.usage = USAGE;
+	buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo alloc_ci {};
+	alloc_ci.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+	VK_CHECK(*m_logger,
+	    vmaCreateBuffer(m_vma, &buffer_ci, &alloc_ci, &m_buffer.buffer,
+	        &m_buffer.allocation, &m_buffer.info));
+
+	VkBufferDeviceAddressInfo address_info {};
+	address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	address_info.buffer = m_buffer.buffer;
+	m_address = vkGetBufferDeviceAddress(m_dev, &address_info);
+}
+
+auto GeometryBuffer::rebuild(VkDeviceSize capacity) -> void
+{
+	Relocation relocation { .src = m_buffer, .dst = {}, .regions = {} };
+
+	create_buffer(capacity);
+	m_allocator.init(capacity);
+	relocation.dst = m_buffer.buffer;
+
+	std::vector<GeometryHandle> live;
+	for (GeometryHandle handle { 0 }; handle < m_ranges.size(); handle++) {
+		if (m_ranges[handle].live)
+			live.emplace_back(handle);
+	}
+	std::ranges::sort(live, [&](GeometryHandle a, GeometryHandle b) {
+		return m_ranges[a].offset < m_ranges[b].offset;
+	});
+
+	for (auto const handle : live) {
+		auto &range { m_ranges[handle] };
+		auto const new_offset {
+			m_allocator.allocate(range.size, range.alignment).value()
+		};
+		relocation.regions.emplace_back(VkBufferCopy {
+		    .srcOffset = range.offset,
+		    .dstOffset = new_offset,
+		    .size = range.size,
+		});
+		range.offset = new_offset;
+	}
+
+	m_relocations.emplace_back(std::move(relocation));
+	m_generation++;
+}
+
+} // namespace Lunar
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan_core.h>
+
+#include "DeletionQueue.h"
+#include "Logger.h"
+#include "OffsetAllocator.h"
+#include "Types.h"
+
+namespace Lunar {
+
+// One device-address buffer shared by the vertex and index data of every mesh.
+// Ranges are suballocated through an OffsetAllocator and referred to by
+// stable handles, so the backing buffer can be grown or compacted without
+// touching the meshes that own the ranges.
+struct GeometryBuffer {
+	static constexpr VkBufferUsageFlags USAGE
+	    = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+	    | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+	    | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+	auto init(Logger &logger, VkDevice dev, VmaAllocator allocator,
+	    VkDeviceSize capacity) -> void;
+	auto destroy() -> void;
+
+	auto allocate(VkDeviceSize size, VkDeviceSize alignment) -> GeometryHandle;
+	auto free(GeometryHandle handle) -> void;
+
+	auto offset(GeometryHandle handle) const -> VkDeviceSize
+	{
+		return m_ranges.at(handle).offset;
+	}
+	auto size(GeometryHandle handle) const -> VkDeviceSize
+	{
+		return m_ranges.at(handle).size;
+	}
+	auto address(GeometryHandle handle) const -> VkDeviceAddress
+	{
+		return m_address + offset(handle);
+	}
+
+	auto buffer() const -> VkBuffer { return m_buffer.buffer; }
+	auto address() const -> VkDeviceAddress { return m_address; }
+	auto capacity() const -> VkDeviceSize { return m_allocator.capacity(); }
+	auto used_bytes() const -> VkDeviceSize
+	{
+		return m_allocator.capacity() - m_allocator.free_bytes();
+	}
+	// Bumped whenever ranges move, invalidating cached offsets/addresses.
+	auto generation() const -> uint64_t { return m_generation; }
+	// 0 when all free space is contiguous, approaching 1 as it splinters.
+	auto fragmentation() const -> float;
+
+	// Moves every live range into a freshly packed buffer. Takes effect at
+	// the next record_relocations().
+	auto defragment() -> void;
+	auto needs_relocation() const -> bool { return !m_relocations.empty(); }
+	// Records the copies for every pending grow/defragment into `cmd` and
+	// hands the buffers they replaced to `retired`, to be destroyed once the
+	// timeline reaches `retire_value`.
+	auto record_relocations(VkCommandBuffer cmd,
+	    TimelineDeletionQueue &retired, uint64_t retire_value) -> void;
+
+private:
+	struct Range {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		VkDeviceSize alignment;
+		bool live;
+	};
+
+	struct Relocation {
+		AllocatedBuffer src;
+		VkBuffer dst;
+		std::vector<VkBufferCopy> regions;
+	};
+
+	auto create_buffer(VkDeviceSize capacity) -> void;
+	auto rebuild(VkDeviceSize capacity) -> void;
+
+	Logger *m_logger { nullptr };
+	VkDevice m_dev { VK_NULL_HANDLE };
+	VmaAllocator m_vma { nullptr };
+
+	AllocatedBuffer m_buffer {};
+	VkDeviceAddress m_address { 0 };
+	OffsetAllocator m_allocator;
+
+	std::vector<Range> m_ranges;
+	std::vector<GeometryHandle> m_free_handles;
+	std::vector<Relocation> m_relocations;
+	uint64_t m_generation { 0 };
+};
+
+} // namespace Lunar
@@ -0,0 +1,242 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <fstream>
+
+#include "Util.h"
+
+namespace Lunar {
+
+constexpr auto CATEGORY { Logger::Category::Renderer };
+
+// In the order the results are written, which is the order of the bits.
+constexpr VkQueryPipelineStatisticFlags STATISTIC_FLAGS {
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT
+};
+constexpr uint32_t STATISTIC_COUNT { 6 };
+static_assert(sizeof(GpuProfiler::Statistics)
+    == STATISTIC_COUNT * sizeof(uint64_t));
+
+auto GpuProfiler::init(Logger &logger, VkDevice dev, uint32_t slot_count,
+    float timestamp_period, uint64_t timestamp_mask, bool pipeline_statistics)
+    -> void
+{
+	m_logger = &logger;
+	m_dev = dev;
+	m_timestamp_period = timestamp_period;
+	m_timestamp_mask = timestamp_mask;
+	m_pipeline_statistics = pipeline_statistics;
+
+	VkQueryPoolCreateInfo timestamps_ci {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = MAX_SCOPES * 2,
+		.pipelineStatistics = 0,
+	};
+	VkQueryPoolCreateInfo statistics_ci {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+		.queryCount = MAX_SCOPES,
+		.pipelineStatistics = STATISTIC_FLAGS,
+	};
+	m_slots.resize(slot_count);
+	for (auto &slot : m_slots) {
+		VK_CHECK(*m_logger,
+		    vkCreateQueryPool(
+		        m_dev, &timestamps_ci, nullptr, &slot.timestamps));
+		if (m_pipeline_statistics) {
+			VK_CHECK(*m_logger,
+			    vkCreateQueryPool(
+			        m_dev, &statistics_ci, nullptr, &slot.statistics));
+		}
+	}
+}
+
+auto GpuProfiler::destroy() -> void
+{
+	for (auto &slot : m_slots) {
+		if (slot.timestamps != VK_NULL_HANDLE)
+			vkDestroyQueryPool(m_dev, slot.timestamps, nullptr);
+		if (slot.statistics != VK_NULL_HANDLE)
+			vkDestroyQueryPool(m_dev, slot.statistics, nullptr);
+	}
+	m_slots.clear();
+	m_history.clear();
+}
+
+auto GpuProfiler::begin_frame(
+    VkCommandBuffer cmd, uint32_t slot_index, uint64_t frame_number) -> void
+{
+	auto &slot { m_slots.at(slot_index) };
+	collect(slot);
+
+	slot.frame_ms.reset();
+	vkCmdResetQueryPool(cmd, slot.timestamps, 0, MAX_SCOPES * 2);
+	if (slot.statistics != VK_NULL_HANDLE)
+		vkCmdResetQueryPool(cmd, slot.statistics, 0, MAX_SCOPES);
+	slot.scopes.clear();
+	slot.frame_number = frame_number;
+	slot.recorded = true;
+	m_current = slot_index;
+}
+
+auto GpuProfiler::add_scope(std::string_view name) -> uint32_t
+{
+	auto &scopes { m_slots.at(m_current).scopes };
+	if (scopes.size() >= MAX_SCOPES)
+		return ~0u;
+	scopes.emplace_back(name);
+	return static_cast<uint32_t>(scopes.size() - 1);
+}
+
+auto GpuProfiler::begin(VkCommandBuffer cmd, uint32_t scope) const -> void
+{
+	auto const &slot { m_slots[m_current] };
+	vkCmdWriteTimestamp2(
+	    cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, slot.timestamps, scope * 2);
+	if (slot.statistics != VK_NULL_HANDLE)
+		vkCmdBeginQuery(cmd, slot.statistics, scope, 0);
+}
+
+auto GpuProfiler::end(VkCommandBuffer cmd, uint32_t scope) const -> void
+{
+	auto const &slot { m_slots[m_current] };
+	if (slot.statistics != VK_NULL_HANDLE)
+		vkCmdEndQuery(cmd, slot.statistics, scope);
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+	    slot.timestamps, scope * 2 + 1);
+}
+
+auto GpuProfiler::collect(Slot &slot) -> void
+{
+	if (!slot.recorded || slot.scopes.empty())
+		return;
+
+	auto const count { static_cast<uint32_t>(slot.scopes.size()) };
+	std::array<uint64_t, MAX_SCOPES * 2> ticks {};
+	// Without WAIT, incomplete results are reported instead of waited for;
+	// the slot is tried again next time.
+	if (vkGetQueryPoolResults(m_dev, slot.timestamps, 0, count * 2,
+	        sizeof(ticks), ticks.data(), sizeof(uint64_t),
+	        VK_QUERY_RESULT_64_BIT)
+	    != VK_SUCCESS)
+		return;
+	slot.recorded = false;
+
+	std::array<Statistics, MAX_SCOPES> statistics {};
+	auto const has_statistics { slot.statistics != VK_NULL_HANDLE
+		&& vkGetQueryPoolResults(m_dev, slot.statistics, 0, count,
+		       sizeof(statistics), statistics.data(), sizeof(Statistics),
+		       VK_QUERY_RESULT_64_BIT)
+		    == VK_SUCCESS };
+
+	// Passes may start out of submission order; find the earliest start,
+	// allowing for the counter wrapping around.
+	auto first { ticks[0] };
+	for (uint32_t i { 1 }; i < count; i++) {
+		if (((ticks[i * 2] - first) & m_timestamp_mask)
+		    > m_timestamp_mask / 2)
+			first = ticks[i * 2];
+	}
+	auto const to_ms { [&](uint64_t from, uint64_t to) {
+		return static_cast<double>((to - from) & m_timestamp_mask)
+		    * static_cast<double>(m_timestamp_period) / 1e6;
+	} };
+
+	Frame frame {
+		.frame_number = slot.frame_number,
+		.gpu_ms = 0.0,
+		.scopes = {},
+	};
+	frame.scopes.reserve(count);
+	for (uint32_t i { 0 }; i < count; i++) {
+		auto const &scope { frame.scopes.emplace_back(Scope {
+		    .name = std::move(slot.scopes[i]),
+		    .start_ms = to_ms(first, ticks[i * 2]),
+		    .duration_ms = to_ms(ticks[i * 2], ticks[i * 2 + 1]),
+		    .statistics = has_statistics
+		        ? std::optional { statistics[i] }
+		        : std::nullopt,
+		}) };
+		frame.gpu_ms
+		    = std::max(frame.gpu_ms, scope.start_ms + scope.duration_ms);
+	}
+	slot.frame_ms = frame.gpu_ms;
+
+	m_history.push_back(std::move(frame));
+	while (m_history.size() > HISTORY_FRAMES)
+		m_history.pop_front();
+}
+
+auto GpuProfiler::frame_ms(uint32_t slot_index) -> std::optional<double>
+{
+	if (slot_index >= m_slots.size())
+		return std::nullopt;
+	auto &slot { m_slots[slot_index] };
+	collect(slot);
+	return slot.frame_ms;
+}
+
+auto GpuProfiler::series(std::string_view name) const -> std::vector<float>
+{
+	std::vector<float> values;
+	values.reserve(m_history.size());
+	for (auto const &frame : m_history) {
+		auto const scope { std::ranges::find(
+			frame.scopes, name, &Scope::name) };
+		values.push_back(scope == frame.scopes.end()
+		        ? 0.0f
+		        : static_cast<float>(scope->duration_ms));
+	}
+	return values;
+}
+
+auto GpuProfiler::export_csv(std::filesystem::path const &path) const -> bool
+{
+	std::ofstream out { path, std::ios::trunc };
+	out << "frame,scope,start_ms,duration_ms";
+	if (m_pipeline_statistics) {
+		out << ",input_vertices,input_primitives,vertex_invocations,"
+		       "clipping_primitives,fragment_invocations,"
+		       "compute_invocations";
+	}
+	out << '\n';
+
+	for (auto const &frame : m_history) {
+		for (auto const &scope : frame.scopes) {
+			out << std::format("{},{},{:.4f},{:.4f}", frame.frame_number,
+			    scope.name, scope.start_ms, scope.duration_ms);
+			if (m_pipeline_statistics) {
+				auto const s { scope.statistics.value_or(Statistics {}) };
+				out << std::format(",{},{},{},{},{},{}", s.input_vertices,
+				    s.input_primitives, s.vertex_invocations,
+				    s.clipping_primitives, s.fragment_invocations,
+				    s.compute_invocations);
+			}
+			out << '\n';
+		}
+	}
+
+	out.flush();
+	if (!out) {
+		m_logger->warn(
+		    CATEGORY, "Failed to write the GPU profile to {}", path.string());
+		return false;
+	}
+	m_logger->info(CATEGORY, "Wrote {} frames of GPU profile to {}",
+	    m_history.size(), path.string());
+	return true;
+}
+
+} // namespace Lunar
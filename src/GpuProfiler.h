@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "Logger.h"
+
+namespace Lunar {
+
+// Times named scopes of each frame on the GPU with timestamp queries, and
+// optionally counts their work with pipeline statistics queries. Every frame
+// slot has its own queries, which are read back once the slot comes around
+// again and its previous frame has completed, so reading never stalls.
+//
+// Scopes are added on one thread; begin() and end() may be recorded from
+// any thread.
+struct GpuProfiler {
+	static constexpr uint32_t MAX_SCOPES { 32 };
+	// Frames of results kept.
+	static constexpr size_t HISTORY_FRAMES { 240 };
+
+	// See VkQueryPipelineStatisticFlagBits.
+	struct Statistics {
+		uint64_t input_vertices { 0 };
+		uint64_t input_primitives { 0 };
+		uint64_t vertex_invocations { 0 };
+		uint64_t clipping_primitives { 0 };
+		uint64_t fragment_invocations { 0 };
+		uint64_t compute_invocations { 0 };
+	};
+
+	struct Scope {
+		std::string name;
+		// From the first scope's start.
+		double start_ms;
+		double duration_ms;
+		std::optional<Statistics> statistics;
+	};
+
+	struct Frame {
+		uint64_t frame_number;
+		// From the first scope's start to the last one's end.
+		double gpu_ms;
+		std::vector<Scope> scopes;
+	};
+
+	// Needs a queue with timestamp support: `timestamp_period` in
+	// nanoseconds per tick and `timestamp_mask` covering its valid bits.
+	auto init(Logger &logger, VkDevice dev, uint32_t slot_count,
+	    float timestamp_period, uint64_t timestamp_mask,
+	    bool pipeline_statistics) -> void;
+	auto destroy() -> void;
+	auto enabled() const -> bool { return !m_slots.empty(); }
+	auto pipeline_statistics() const -> bool { return m_pipeline_statistics; }
+
+	// Collects what `slot` recorded last, which must have completed on the
+	// GPU, and resets its queries in `cmd`. Everything else recorded for
+	// the frame must be submitted after `cmd`.
+	auto begin_frame(VkCommandBuffer cmd, uint32_t slot, uint64_t frame_number)
+	    -> void;
+	// Returns ~0u once the frame has MAX_SCOPES scopes.
+	auto add_scope(std::string_view name) -> uint32_t;
+	auto begin(VkCommandBuffer cmd, uint32_t scope) const -> void;
+	auto end(VkCommandBuffer cmd, uint32_t scope) const -> void;
+	// GPU time of the frame last recorded in `slot`, once it has completed;
+	// collects it without waiting if needed.
+	auto frame_ms(uint32_t slot) -> std::optional<double>;
+
+	// Oldest first.
+	auto history() const -> std::deque<Frame> const & { return m_history; }
+	// Durations of the scope named `name` over the history, 0 where a frame
+	// lacks it.
+	auto series(std::string_view name) const -> std::vector<float>;
+	// Writes the history as CSV, one row per scope.
+	auto export_csv(std::filesystem::path const &path) const -> bool;
+
+private:
+	struct Slot {
+		VkQueryPool timestamps { VK_NULL_HANDLE };
+		VkQueryPool statistics { VK_NULL_HANDLE };
+		std::vector<std::string> scopes;
+		uint64_t frame_number { 0 };
+		bool recorded { false };
+		std::optional<double> frame_ms {};
+	};
+
+	auto collect(Slot &slot) -> void;
+
+	Logger *m_logger { nullptr };
+	VkDevice m_dev { VK_NULL_HANDLE };
+	float m_timestamp_period { 0.0f };
+	uint64_t m_timestamp_mask { 0 };
+	bool m_pipeline_statistics { false };
+
+	std::vector<Slot> m_slots;
+	uint32_t m_current { 0 };
+	std::deque<Frame> m_history;
+};
+
+} // namespace Lunar
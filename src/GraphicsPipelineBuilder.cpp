@@ -1,11 +1,15 @@
 #include "GraphicsPipelineBuilder.h"
 
+#include <array>
+
 #include <vulkan/vulkan_core.h>
 
 #include "Util.h"
 
 namespace Lunar {
 
+constexpr auto CATEGORY { Logger::Category::Renderer };
+
 auto GraphicsPipelineBuilder::clear() -> GraphicsPipelineBuilder &
 {
 	m_input_assembly = {};
@@ -32,6 +36,10 @@ auto GraphicsPipelineBuilder::clear() -> GraphicsPipelineBuilder &
 	m_render_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
 
 	m_shader_stages.clear();
+	m_vertex_spirv = {};
+	m_task_spirv = {};
+	m_mesh_spirv = {};
+	m_fragment_spirv = {};
 
 	return *this;
 }
@@ -40,6 +48,10 @@ auto GraphicsPipelineBuilder::set_shaders(VkShaderModule vs, VkShaderModule fs)
     -> GraphicsPipelineBuilder &
 {
 	m_shader_stages.clear();
+	m_vertex_spirv = {};
+	m_task_spirv = {};
+	m_mesh_spirv = {};
+	m_fragment_spirv = {};
 
 	m_shader_stages.emplace_back(
 	    vkinit::pipeline_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vs));
@@ -49,6 +61,31 @@ auto GraphicsPipelineBuilder::set_shaders(VkShaderModule vs, VkShaderModule fs)
 	return *this;
 }
 
+auto GraphicsPipelineBuilder::set_shaders(std::span<uint8_t const> vs_spirv,
+    std::span<uint8_t const> fs_spirv) -> GraphicsPipelineBuilder &
+{
+	m_shader_stages.clear();
+	m_vertex_spirv = vs_spirv;
+	m_task_spirv = {};
+	m_mesh_spirv = {};
+	m_fragment_spirv = fs_spirv;
+
+	return *this;
+}
+
+auto GraphicsPipelineBuilder::set_mesh_shaders(
+    std::span<uint8_t const> task_spirv, std::span<uint8_t const> mesh_spirv,
+    std::span<uint8_t const> fs_spirv) -> GraphicsPipelineBuilder &
+{
+	m_shader_stages.clear();
+	m_vertex_spirv = {};
+	m_task_spirv = task_spirv;
+	m_mesh_spirv = mesh_spirv;
+	m_fragment_spirv = fs_spirv;
+
+	return *this;
+}
+
 auto GraphicsPipelineBuilder::set_input_topology(VkPrimitiveTopology topology,
     VkBool32 primitive_restart_enable) -> GraphicsPipelineBuilder &
 {
@@ -142,8 +179,80 @@ auto GraphicsPipelineBuilder::disable_depth_testing()
 	return *this;
 }
 
-auto GraphicsPipelineBuilder::build(VkDevice dev) -> VkPipeline
+auto GraphicsPipelineBuilder::enable_depth_test(
+    bool depth_write_enable, VkCompareOp op) -> GraphicsPipelineBuilder &
+{
+	m_depth_stencil.depthTestEnable = VK_TRUE;
+	m_depth_stencil.depthWriteEnable = depth_write_enable;
+	m_depth_stencil.depthCompareOp = op;
+	m_depth_stencil.depthBoundsTestEnable = VK_FALSE;
+	m_depth_stencil.stencilTestEnable = VK_FALSE;
+	m_depth_stencil.front = {};
+	m_depth_stencil.back = {};
+	m_depth_stencil.minDepthBounds = 0.f;
+	m_depth_stencil.maxDepthBounds = 1.f;
+
+	return *this;
+}
+
+auto GraphicsPipelineBuilder::build(PipelineCache &cache, std::string_view name)
+    -> VkPipeline
 {
+	auto const dev { cache.device() };
+
+	// Modules built from SPIR-V only live for the duration of the build.
+	auto stages { m_shader_stages };
+	std::array<VkShaderModule, 3> modules {};
+	defer({
+		for (auto const module : modules) {
+			if (module != VK_NULL_HANDLE)
+				vkDestroyShaderModule(dev, module, nullptr);
+		}
+	});
+	if (!m_vertex_spirv.empty()) {
+		if (!vkutil::load_shader_module(m_vertex_spirv, dev, &modules[0])
+		    || !vkutil::load_shader_module(
+		        m_fragment_spirv, dev, &modules[1])) {
+			m_logger.err(
+			    CATEGORY, "Failed to load shaders for pipeline '{}'", name);
+			return VK_NULL_HANDLE;
+		}
+		stages = {
+			vkinit::pipeline_shader_stage(
+			    VK_SHADER_STAGE_VERTEX_BIT, modules[0]),
+			vkinit::pipeline_shader_stage(
+			    VK_SHADER_STAGE_FRAGMENT_BIT, modules[1]),
+		};
+	} else if (!m_mesh_spirv.empty()) {
+		if (!vkutil::load_shader_module(m_task_spirv, dev, &modules[0])
+		    || !vkutil::load_shader_module(m_mesh_spirv, dev, &modules[1])
+		    || !vkutil::load_shader_module(
+		        m_fragment_spirv, dev, &modules[2])) {
+			m_logger.err(
+			    CATEGORY, "Failed to load shaders for pipeline '{}'", name);
+			return VK_NULL_HANDLE;
+		}
+		stages = {
+			vkinit::pipeline_shader_stage(
+			    VK_SHADER_STAGE_TASK_BIT_EXT, modules[0]),
+			vkinit::pipeline_shader_stage(
+			    VK_SHADER_STAGE_MESH_BIT_EXT, modules[1]),
+			vkinit::pipeline_shader_stage(
+			    VK_SHADER_STAGE_FRAGMENT_BIT, modules[2]),
+		};
+	}
+
+	if (stages.empty() || m_pipeline_layout == VK_NULL_HANDLE) {
+		m_logger.err(CATEGORY,
+		    "Graphics pipeline '{}' is missing shaders or a layout", name);
+		return VK_NULL_HANDLE;
+	}
+
+	// Re-pointed here so copies of the builder stay valid.
+	auto render_info { m_render_info };
+	if (render_info.colorAttachmentCount > 0)
+		render_info.pColorAttachmentFormats = &m_color_attachment_format;
+
 	VkPipelineViewportStateCreateInfo viewport_state_ci {};
 	viewport_state_ci.sType
 	    = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -168,12 +277,15 @@ auto GraphicsPipelineBuilder::build(VkDevice dev) -> VkPipeline
 
 	VkGraphicsPipelineCreateInfo pipeline_ci {};
 	pipeline_ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipeline_ci.pNext = &m_render_info;
-
-	pipeline_ci.stageCount = static_cast<uint32_t>(m_shader_stages.size());
-	pipeline_ci.pStages = m_shader_stages.data();
-	pipeline_ci.pVertexInputState = &vertex_input_ci;
-	pipeline_ci.pInputAssemblyState = &m_input_assembly;
+	pipeline_ci.pNext = &render_info;
+
+	pipeline_ci.stageCount = static_cast<uint32_t>(stages.size());
+	pipeline_ci.pStages = stages.data();
+	// Mesh pipelines have no vertex input stage.
+	auto const mesh_pipeline { !m_mesh_spirv.empty() };
+	pipeline_ci.pVertexInputState = mesh_pipeline ? nullptr : &vertex_input_ci;
+	pipeline_ci.pInputAssemblyState
+	    = mesh_pipeline ? nullptr : &m_input_assembly;
 	pipeline_ci.pViewportState = &viewport_state_ci;
 	pipeline_ci.pRasterizationState = &m_rasterizer;
 	pipeline_ci.pMultisampleState = &m_multisampling;
@@ -193,15 +305,15 @@ auto GraphicsPipelineBuilder::build(VkDevice dev) -> VkPipeline
 
 	pipeline_ci.pDynamicState = &dynamic_ci;
 
-	VkPipeline pip {};
-	if (vkCreateGraphicsPipelines(
-	        dev, VK_NULL_HANDLE, 1, &pipeline_ci, nullptr, &pip)
-	    != VK_SUCCESS) {
-		m_logger.err("Failed to create graphics pipeline");
-		return VK_NULL_HANDLE;
-	}
+	return cache.create_graphics_pipeline(pipeline_ci, name);
+}
 
-	return pip;
+auto GraphicsPipelineBuilder::build_async(JobSystem &jobs, PipelineCache &cache,
+    std::string name) const -> PipelineFuture
+{
+	return jobs.async([builder = *this, &cache, name = std::move(name)]() {
+		return GraphicsPipelineBuilder { builder }.build(cache, name);
+	});
 }
 
 } // namespace Lunar
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include <vulkan/vulkan_core.h>
 
+#include "JobSystem.h"
 #include "Logger.h"
+#include "PipelineCache.h"
 
 namespace Lunar {
 
@@ -18,6 +24,15 @@ struct GraphicsPipelineBuilder {
 	auto clear() -> GraphicsPipelineBuilder &;
 	auto set_shaders(VkShaderModule vs, VkShaderModule fs)
 	    -> GraphicsPipelineBuilder &;
+	// The builder creates and destroys the modules itself, which lets it
+	// build on another thread. The SPIR-V must outlive the build.
+	auto set_shaders(std::span<uint8_t const> vs_spirv,
+	    std::span<uint8_t const> fs_spirv) -> GraphicsPipelineBuilder &;
+	// Task and mesh shaders in place of the vertex stage; the input
+	// assembly state is unused then. Same lifetime rules as above.
+	auto set_mesh_shaders(std::span<uint8_t const> task_spirv,
+	    std::span<uint8_t const> mesh_spirv,
+	    std::span<uint8_t const> fs_spirv) -> GraphicsPipelineBuilder &;
 	auto set_input_topology(VkPrimitiveTopology topology,
 	    VkBool32 primitive_restart_enable = VK_FALSE)
 	    -> GraphicsPipelineBuilder &;
@@ -32,7 +47,12 @@ struct GraphicsPipelineBuilder {
 	auto set_pipeline_layout(VkPipelineLayout layout)
 	    -> GraphicsPipelineBuilder &;
 	auto disable_depth_testing() -> GraphicsPipelineBuilder &;
-	auto build(VkDevice dev) -> VkPipeline;
+	auto enable_depth_test(bool depth_write_enable, VkCompareOp op)
+	    -> GraphicsPipelineBuilder &;
+	auto build(PipelineCache &cache, std::string_view name) -> VkPipeline;
+	// Builds a copy of the current state on `jobs`.
+	auto build_async(JobSystem &jobs, PipelineCache &cache,
+	    std::string name) const -> PipelineFuture;
 
 private:
 	VkPipelineInputAssemblyStateCreateInfo m_input_assembly {};
@@ -45,6 +65,10 @@ private:
 	VkFormat m_color_attachment_format {};
 
 	std::vector<VkPipelineShaderStageCreateInfo> m_shader_stages {};
+	std::span<uint8_t const> m_vertex_spirv {};
+	std::span<uint8_t const> m_task_spirv {};
+	std::span<uint8_t const> m_mesh_spirv {};
+	std::span<uint8_t const> m_fragment_spirv {};
 
 	Logger &m_logger;
 };
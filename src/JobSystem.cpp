@@ -0,0 +1,122 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace Lunar {
+
+auto JobSystem::init(uint32_t worker_count) -> void
+{
+	if (worker_count == 0) {
+		worker_count
+		    = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+
+	m_workers.reserve(worker_count);
+	for (uint32_t i { 0 }; i < worker_count; i++) {
+		m_workers.emplace_back([this, thread = i + 1](std::stop_token stop) {
+			worker_main(stop, thread);
+		});
+	}
+}
+
+auto JobSystem::destroy() -> void
+{
+	for (auto &worker : m_workers)
+		worker.request_stop();
+	m_cv.notify_all();
+	m_workers.clear();
+	m_jobs.clear();
+}
+
+auto JobSystem::submit(Job &&job) -> void
+{
+	if (m_workers.empty()) {
+		job(0);
+		return;
+	}
+
+	{
+		std::scoped_lock lock { m_mutex };
+		m_jobs.emplace_back(std::move(job));
+	}
+	m_cv.notify_one();
+}
+
+auto JobSystem::parallel_for(uint32_t count,
+    std::function<void(uint32_t index, uint32_t thread)> const &fn) -> void
+{
+	if (count == 0)
+		return;
+
+	// Helpers may still be queued after the last index is claimed, so the
+	// shared state outlives this call.
+	struct State {
+		std::function<void(uint32_t, uint32_t)> fn;
+		uint32_t count;
+		std::atomic<uint32_t> next { 0 };
+		std::atomic<uint32_t> done { 0 };
+		std::mutex error_mutex;
+		std::exception_ptr error;
+	};
+	auto state { std::make_shared<State>() };
+	state->fn = fn;
+	state->count = count;
+
+	auto const run { [](State &s, uint32_t thread) {
+		for (auto i { s.next++ }; i < s.count; i = s.next++) {
+			try {
+				s.fn(i, thread);
+			} catch (...) {
+				std::scoped_lock lock { s.error_mutex };
+				if (!s.error)
+					s.error = std::current_exception();
+			}
+			if (++s.done == s.count)
+				s.done.notify_all();
+		}
+	} };
+
+	auto const helpers { std::min(count, thread_count()) - 1 };
+	if (helpers > 0) {
+		{
+			std::scoped_lock lock { m_mutex };
+			for (uint32_t i { 0 }; i < helpers; i++) {
+				m_jobs.emplace_back(
+				    [state, run](uint32_t thread) { run(*state, thread); });
+			}
+		}
+		m_cv.notify_all();
+	}
+
+	run(*state, 0);
+
+	for (auto done { state->done.load() }; done != count;
+	    done = state->done.load()) {
+		state->done.wait(done);
+	}
+
+	// Exceptions thrown on worker threads surface on the caller.
+	if (state->error)
+		std::rethrow_exception(state->error);
+}
+
+auto JobSystem::worker_main(std::stop_token stop, uint32_t thread) -> void
+{
+	while (true) {
+		Job job;
+		{
+			std::unique_lock lock { m_mutex };
+			// Drains the queue before honoring a stop request.
+			if (!m_cv.wait(lock, stop, [&] { return !m_jobs.empty(); }))
+				return;
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+		job(thread);
+	}
+}
+
+} // namespace Lunar
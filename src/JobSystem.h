@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Lunar {
+
+// Fixed pool of worker threads. The thread that owns the pool takes part in
+// every parallel_for as thread 0, so per-thread resources can be indexed by
+// the `thread` argument without locking.
+struct JobSystem {
+	using Job = std::function<void(uint32_t thread)>;
+
+	// 0 picks one worker per hardware thread besides the calling one.
+	auto init(uint32_t worker_count = 0) -> void;
+	auto destroy() -> void;
+
+	auto thread_count() const -> uint32_t
+	{
+		return static_cast<uint32_t>(m_workers.size()) + 1;
+	}
+
+	// Calls fn(index, thread) for every index in [0, count) and returns once
+	// all calls have finished, rethrowing the first exception any of them
+	// threw. Must be called from the owning thread.
+	auto parallel_for(uint32_t count,
+	    std::function<void(uint32_t index, uint32_t thread)> const &fn)
+	    -> void;
+
+	// Runs `job` on a worker thread, or inline when there are no workers.
+	// Queued jobs still run when the system is destroyed.
+	auto submit(Job &&job) -> void;
+
+	// Runs `fn` like submit() and returns a future for its result.
+	template<typename Fn>
+	auto async(Fn &&fn) -> std::shared_future<std::invoke_result_t<Fn>>
+	{
+		using Result = std::invoke_result_t<Fn>;
+		auto task { std::make_shared<std::packaged_task<Result()>>(
+			std::forward<Fn>(fn)) };
+		auto future { task->get_future().share() };
+		submit([task](uint32_t) { (*task)(); });
+		return future;
+	}
+
+private:
+	auto worker_main(std::stop_token stop, uint32_t thread) -> void;
+
+	std::vector<std::jthread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable_any m_cv;
+	std::deque<Job> m_jobs;
+};
+
+} // namespace Lunar
@@ -1,23 +1,20 @@
 #include "Loader.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <span>
+
 #include <fastgltf/core.hpp>
-#include <fastgltf/tools.hpp>
-#include <fastgltf/util.hpp>
 
+#include "MeshCache.h"
+#include "MeshDecoder.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlets.h"
+#include "Util.h"
 #include "VulkanRenderer.h"
 
-namespace fastgltf {
-template<>
-struct ElementTraits<smath::Vec4>
-    : ElementTraitsBase<smath::Vec4, AccessorType::Vec4, float> { };
-template<>
-struct ElementTraits<smath::Vec3>
-    : ElementTraitsBase<smath::Vec3, AccessorType::Vec3, float> { };
-template<>
-struct ElementTraits<smath::Vec2>
-    : ElementTraitsBase<smath::Vec2, AccessorType::Vec2, float> { };
-}
-
 #ifndef __cpp_lib_format_path
 
 #	include <filesystem>
@@ -53,149 +50,418 @@ struct std::formatter<std::filesystem::path, CharT>
 	}
 };
 
+#endif // __cpp_lib_format_path
+
 namespace Lunar {
 
-auto Mesh::load_gltf_meshes(
-    VulkanRenderer &renderer, std::filesystem::path const path)
+constexpr auto CATEGORY { Logger::Category::Loader };
+
+static auto upload_baked(VulkanRenderer &renderer, BakedMeshes const &baked)
+    -> std::vector<std::shared_ptr<Mesh>>
+{
+	std::vector<MeshData> uploads;
+	uploads.reserve(baked.mesh_count());
+	for (size_t m { 0 }; m < baked.mesh_count(); m++)
+		uploads.emplace_back(baked.data(m));
+	// Copies straight from the mapping into staging.
+	auto const gpu_meshes { renderer.upload_meshes(uploads) };
+
+	std::vector<std::shared_ptr<Mesh>> meshes;
+	meshes.reserve(baked.mesh_count());
+	for (size_t m { 0 }; m < baked.mesh_count(); m++) {
+		auto mesh { std::make_shared<Mesh>() };
+		mesh->name = baked.name(m);
+		for (auto const &surface : baked.surfaces(m)) {
+			auto &new_surface { mesh->surfaces.emplace_back(Mesh::Surface {
+			    .base_vertex = surface.base_vertex,
+			    .index_type = surface.index_size == sizeof(uint16_t)
+			        ? VK_INDEX_TYPE_UINT16
+			        : VK_INDEX_TYPE_UINT32,
+			    .bounds = { surface.bounds[0], surface.bounds[1],
+			        surface.bounds[2], surface.bounds[3] },
+			    .lod_count = surface.lod_count,
+			    .lods = {},
+			}) };
+			for (uint32_t l { 0 }; l < surface.lod_count; l++) {
+				auto const &lod { surface.lods[l] };
+				new_surface.lods[l] = Mesh::Lod {
+					.start_index = lod.start_index,
+					.count = lod.count,
+					.error = lod.error,
+					.meshlet_offset = lod.meshlet_offset,
+					.meshlet_count = lod.meshlet_count,
+				};
+			}
+		}
+		mesh->vertex_format = baked.data(m).vertex_format;
+		mesh->position_offset = baked.position_offset(m);
+		mesh->position_scale = baked.position_scale(m);
+		mesh->gpu = gpu_meshes[m];
+		meshes.emplace_back(std::move(mesh));
+	}
+	return meshes;
+}
+
+auto Mesh::load_gltf_meshes(VulkanRenderer &renderer,
+    std::filesystem::path const path, MeshLoadOptions const &options)
     -> std::optional<std::vector<std::shared_ptr<Mesh>>>
 {
-	renderer.logger().debug("Loading GLTF from file: {}", path);
+	renderer.logger().debug(CATEGORY, "Loading GLTF from file: {}", path);
+	auto const start { std::chrono::steady_clock::now() };
+	auto const elapsed_ms { [&] {
+		return std::chrono::duration<double, std::milli>(
+		    std::chrono::steady_clock::now() - start)
+		    .count();
+	} };
+
+	// Meshlets are dead weight without mesh shaders.
+	auto const build_meshlets_enabled { options.meshlets
+		&& renderer.mesh_shading() };
+
+	// A baked copy made by an earlier run skips parsing and decoding.
+	std::optional<uint64_t> source_hash;
+	std::filesystem::path baked_path;
+	if (auto const &directory { renderer.mesh_cache_directory() };
+	    !directory.empty()) {
+		// Bakes of the same file with different options differ.
+		if (auto const hash { BakedMeshes::hash_source(path) }) {
+			auto const variant { static_cast<uint8_t>(
+				static_cast<uint32_t>(options.optimize)
+				| static_cast<uint32_t>(options.vertex_format) << 1
+				| static_cast<uint32_t>(build_meshlets_enabled) << 2
+				| static_cast<uint32_t>(options.lods) << 3) };
+			source_hash = fnv1a({ &variant, 1 }, *hash);
+		}
+		baked_path = BakedMeshes::path_for(directory, path);
+	}
+	if (source_hash) {
+		if (auto const baked { BakedMeshes::load(
+		        renderer.logger(), baked_path, *source_hash) }) {
+			auto meshes { upload_baked(renderer, *baked) };
+			renderer.logger().debug(CATEGORY,
+			    "Loaded {} baked meshes in {:.2f} ms", meshes.size(),
+			    elapsed_ms());
+			return meshes;
+		}
+	}
 
 	auto data = fastgltf::GltfDataBuffer::FromPath(path);
 	if (data.error() != fastgltf::Error::None) {
-		renderer.logger().err("Failed to open glTF file: {} (error {})", path,
+		renderer.logger().err(CATEGORY,
+		    "Failed to open glTF file: {} (error {})", path,
 		    fastgltf::to_underlying(data.error()));
 		return {};
 	}
 
 	constexpr auto gltfOptions { fastgltf::Options::LoadExternalBuffers };
 
-	fastgltf::Parser parser;
+	// Quantized attributes decode on the fast path, so accept them.
+	fastgltf::Parser parser { fastgltf::Extensions::KHR_mesh_quantization };
 
 	auto load { parser.loadGltf(data.get(), path.parent_path(), gltfOptions) };
 	if (load.error() != fastgltf::Error::None) {
-		renderer.logger().err(
-		    "Failed to load glTF: {}", fastgltf::to_underlying(load.error()));
+		renderer.logger().err(CATEGORY, "Failed to load glTF: {}",
+		    fastgltf::to_underlying(load.error()));
 		return {};
 	}
 	fastgltf::Asset gltf { std::move(load.get()) };
 
-	std::vector<std::shared_ptr<Mesh>> meshes;
-
-	std::vector<uint32_t> indices;
-	std::vector<Vertex> vertices;
-	for (auto &mesh : gltf.meshes) {
-		Mesh new_mesh;
-
+	// Decode every primitive into its own slice of two shared arrays, sized
+	// from the accessor counts, so primitives can be processed independently.
+	struct Range {
+		size_t first;
+		size_t count;
+	};
+	struct PrimitiveJob {
+		fastgltf::Primitive const *primitive;
+		size_t mesh;
+		size_t surface;
+		Range vertices;
+		Range indices;
+		// Back faces are visible, so meshlets must not be cone culled.
+		bool double_sided;
+		// Vertices left at the front of the slice after optimization.
+		size_t vertex_count;
+		float acmr_before;
+		float acmr_after;
+		// Levels of detail past the full surface.
+		std::vector<SimplifiedLod> lods;
+		// One per level of detail, starting with the full surface.
+		std::vector<MeshletBlock> meshlets;
+	};
+
+	std::vector<Mesh> new_meshes(gltf.meshes.size());
+	std::vector<PrimitiveJob> primitive_jobs;
+	size_t vertex_total { 0 };
+	size_t index_total { 0 };
+	for (size_t m { 0 }; m < gltf.meshes.size(); m++) {
+		auto const &mesh { gltf.meshes[m] };
+		auto &new_mesh { new_meshes[m] };
 		new_mesh.name = mesh.name;
 
-		indices.clear();
-		vertices.clear();
-
-		for (auto &&p : mesh.primitives) {
-			Surface new_surface;
-			new_surface.start_index = static_cast<uint32_t>(indices.size());
-			new_surface.count = static_cast<uint32_t>(
-			    gltf.accessors[p.indicesAccessor.value()].count);
-
-			size_t initial_vertex = vertices.size();
-
-			{ // Indices
-				auto &accessor = gltf.accessors[p.indicesAccessor.value()];
-				indices.reserve(indices.size() + accessor.count);
-				fastgltf::iterateAccessor<std::uint32_t>(
-				    gltf, accessor, [&](std::uint32_t idx) {
-					    indices.emplace_back(idx + initial_vertex);
-				    });
+		for (auto const &p : mesh.primitives) {
+			auto const position { p.findAttribute("POSITION") };
+			if (!p.indicesAccessor || position == p.attributes.end()) {
+				renderer.logger().warn(CATEGORY,
+				    "Skipping primitive without indices or positions on "
+				    "mesh '{}'",
+				    new_mesh.name);
+				continue;
 			}
 
-			{ // Vertex positions
-				auto &accessor = gltf.accessors[p.findAttribute("POSITION")
-				        ->accessorIndex];
-
-				for (auto pos :
-				    fastgltf::iterateAccessor<smath::Vec3>(gltf, accessor)) {
-					Vertex v {
-						.position = pos,
-						.u = 0,
-						.normal = { 0, 0, 0 },
-						.v = 0,
-						.color = { 1.0f, 1.0f, 1.0f, 1.0f },
-					};
-					vertices.emplace_back(v);
-				}
-			}
+			auto const vertex_count {
+				gltf.accessors[position->accessorIndex].count
+			};
+			auto const index_count {
+				gltf.accessors[p.indicesAccessor.value()].count
+			};
+
+			new_mesh.surfaces.emplace_back(Surface {
+			    .base_vertex = 0,
+			    .index_type = VK_INDEX_TYPE_UINT32,
+			    .bounds = {},
+			    .lod_count = 1,
+			    .lods = {},
+			});
+			primitive_jobs.emplace_back(PrimitiveJob {
+			    .primitive = &p,
+			    .mesh = m,
+			    .surface = new_mesh.surfaces.size() - 1,
+			    .vertices = { vertex_total, vertex_count },
+			    .indices = { index_total, index_count },
+			    .double_sided = p.materialIndex
+			        && gltf.materials[p.materialIndex.value()].doubleSided,
+			    .vertex_count = vertex_count,
+			    .acmr_before = 0.0f,
+			    .acmr_after = 0.0f,
+			    .lods = {},
+			    .meshlets = {},
+			});
+
+			vertex_total += vertex_count;
+			index_total += index_count;
+		}
+	}
 
-			if (auto attr = p.findAttribute("NORMAL")) { // Normals
-				auto &accessor = gltf.accessors[attr->accessorIndex];
-				size_t local_index = 0;
-				for (auto normal :
-				    fastgltf::iterateAccessor<smath::Vec3>(gltf, accessor)) {
-					vertices[initial_vertex + local_index].normal = normal;
-					local_index++;
-				}
-			}
+	std::vector<Vertex> vertices(vertex_total);
+	std::vector<uint32_t> indices(index_total);
+	renderer.jobs().parallel_for(static_cast<uint32_t>(primitive_jobs.size()),
+	    [&](uint32_t job_index, uint32_t) {
+		    auto &job { primitive_jobs[job_index] };
+		    auto const job_vertices { std::span(vertices).subspan(
+			    job.vertices.first, job.vertices.count) };
+		    auto const job_indices { std::span(indices).subspan(
+			    job.indices.first, job.indices.count) };
+
+		    // Indices stay relative to the primitive; the surface's
+		    // base_vertex places them within the mesh.
+		    new_meshes[job.mesh].surfaces[job.surface].bounds
+		        = decode_primitive(gltf, *job.primitive, 0, job_vertices,
+		            job_indices, renderer.logger());
+		    if (options.optimize) {
+			    job.acmr_before = average_cache_miss_ratio(
+			        job_indices, job_vertices.size());
+			    job.vertex_count = optimize_mesh(job_vertices, job_indices);
+			    job.acmr_after
+			        = average_cache_miss_ratio(job_indices, job.vertex_count);
+		    }
+		    auto const used_vertices { job_vertices.first(job.vertex_count) };
+		    if (options.lods) {
+			    job.lods = build_lods(job_indices, used_vertices, MAX_LODS - 1);
+			    if (options.optimize) {
+				    for (auto &lod : job.lods)
+					    optimize_vertex_cache(lod.indices, job.vertex_count);
+			    }
+		    }
+		    if (build_meshlets_enabled) {
+			    job.meshlets.emplace_back(build_meshlets(
+			        job_indices, used_vertices, job.double_sided));
+			    for (auto const &lod : job.lods) {
+				    job.meshlets.emplace_back(build_meshlets(
+				        lod.indices, used_vertices, job.double_sided));
+			    }
+		    }
+	    });
+
+	// Room for every level at 32 bits, which also covers the padding after
+	// 16-bit ranges.
+	auto index_capacity { index_total };
+	for (auto const &job : primitive_jobs) {
+		for (auto const &lod : job.lods)
+			index_capacity += lod.indices.size();
+	}
 
-			if (auto attr = p.findAttribute("TEXCOORD_0")) { // UVs
-				auto &accessor = gltf.accessors[attr->accessorIndex];
-				size_t local_index = 0;
-				for (auto uv :
-				    fastgltf::iterateAccessor<smath::Vec2>(gltf, accessor)) {
-					uv.unpack(vertices[initial_vertex + local_index].u,
-					    vertices[initial_vertex + local_index].v);
-					local_index++;
-				}
+	// Pack each mesh's remaining vertices back to back (slices only move
+	// towards the front) and store indices as 16-bit wherever the surface
+	// has few enough vertices. Surfaces start 4-byte aligned so either
+	// index type can follow.
+	std::vector<std::byte> index_data(index_capacity * sizeof(uint32_t));
+	std::vector<MeshData> uploads;
+	uploads.reserve(new_meshes.size());
+	std::vector<Range> mesh_vertices;
+	mesh_vertices.reserve(new_meshes.size());
+	// Meshlet blocks go back to back per mesh, each 16-byte aligned.
+	std::vector<std::byte> meshlet_data;
+	std::vector<Range> mesh_meshlets;
+	mesh_meshlets.reserve(new_meshes.size());
+	auto const align_meshlets { [&] {
+		meshlet_data.resize((meshlet_data.size() + 15) & ~size_t { 15 });
+		return meshlet_data.size();
+	} };
+	auto const stride { vertex_stride(options.vertex_format) };
+	size_t vertex_cursor { 0 };
+	size_t byte_cursor { 0 };
+	auto job { primitive_jobs.begin() };
+	for (size_t m { 0 }; m < new_meshes.size(); m++) {
+		auto &mesh { new_meshes[m] };
+		auto const first_vertex { vertex_cursor };
+		auto const first_byte { byte_cursor };
+		auto const first_meshlet_byte { align_meshlets() };
+		size_t original_vertices { 0 };
+		size_t triangles { 0 };
+		float misses_before { 0.0f };
+		float misses_after { 0.0f };
+
+		for (; job != primitive_jobs.end() && job->mesh == m; job++) {
+			auto &surface { mesh.surfaces[job->surface] };
+			if (vertex_cursor != job->vertices.first) {
+				std::copy_n(vertices.begin()
+				        + static_cast<ptrdiff_t>(job->vertices.first),
+				    job->vertex_count,
+				    vertices.begin() + static_cast<ptrdiff_t>(vertex_cursor));
 			}
-
-			if (auto attr = p.findAttribute("COLOR_0")) { // Colors
-				auto &accessor = gltf.accessors[attr->accessorIndex];
-				size_t local_index = 0;
-
-				switch (accessor.type) {
-				case fastgltf::AccessorType::Vec3: {
-					for (auto c3 : fastgltf::iterateAccessor<smath::Vec3>(
-					         gltf, accessor)) {
-						auto &dst
-						    = vertices[initial_vertex + local_index].color;
-						dst = { c3.x(), c3.y(), c3.z(), 1.0f };
-						++local_index;
-					}
-					break;
-				}
-				case fastgltf::AccessorType::Vec4: {
-					for (auto c4 : fastgltf::iterateAccessor<smath::Vec4>(
-					         gltf, accessor)) {
-						vertices[initial_vertex + local_index].color = c4;
-						++local_index;
+			surface.base_vertex
+			    = static_cast<uint32_t>(vertex_cursor - first_vertex);
+			vertex_cursor += job->vertex_count;
+
+			auto const narrow { job->vertex_count <= 0x10000 };
+			auto const index_size { narrow ? sizeof(uint16_t)
+				                           : sizeof(uint32_t) };
+			surface.index_type
+			    = narrow ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+			// Every level of detail gets its own range after the full one.
+			auto const pack { [&](Lod &lod, std::span<uint32_t const> source) {
+				lod.start_index = static_cast<uint32_t>(
+				    (byte_cursor - first_byte) / index_size);
+				lod.count = static_cast<uint32_t>(source.size());
+				auto *dst { index_data.data() + byte_cursor };
+				for (size_t i { 0 }; i < source.size(); i++) {
+					if (narrow) {
+						auto const index { static_cast<uint16_t>(source[i]) };
+						std::memcpy(dst + i * index_size, &index, index_size);
+					} else {
+						std::memcpy(
+						    dst + i * index_size, &source[i], index_size);
 					}
-					break;
-				}
-				default:
-					renderer.logger().warn(
-					    "Unsupported COLOR_0 accessor type ({}) on mesh '{}'",
-					    static_cast<int>(accessor.type), new_mesh.name);
-					break;
 				}
+				byte_cursor = (byte_cursor + source.size() * index_size + 3)
+				    & ~size_t { 3 };
+			} };
+			pack(surface.lods[0],
+			    std::span(indices).subspan(
+			        job->indices.first, job->indices.count));
+			surface.lod_count = static_cast<uint32_t>(1 + job->lods.size());
+			for (size_t l { 0 }; l < job->lods.size(); l++) {
+				pack(surface.lods[l + 1], job->lods[l].indices);
+				surface.lods[l + 1].error = job->lods[l].error;
 			}
 
-			constexpr bool OVERRIDE_COLORS = true;
-			if (OVERRIDE_COLORS) {
-				for (auto &vtx : vertices) {
-					vtx.color = smath::Vec4(vtx.normal, 1.f);
-				}
+			for (size_t l { 0 }; l < job->meshlets.size(); l++) {
+				auto &lod { surface.lods[l] };
+				lod.meshlet_offset = static_cast<uint32_t>(
+				    align_meshlets() - first_meshlet_byte);
+				lod.meshlet_count = job->meshlets[l].count;
+				meshlet_data.insert(meshlet_data.end(),
+				    job->meshlets[l].bytes.begin(),
+				    job->meshlets[l].bytes.end());
 			}
 
-			new_mesh.surfaces.emplace_back(new_surface);
+			auto const job_triangles { static_cast<float>(
+				job->indices.count / 3) };
+			original_vertices += job->vertices.count;
+			triangles += job->indices.count / 3;
+			misses_before += job->acmr_before * job_triangles;
+			misses_after += job->acmr_after * job_triangles;
 		}
 
-		new_mesh.mesh_buffers = renderer.upload_mesh(indices, vertices);
+		mesh_vertices.emplace_back(
+		    Range { first_vertex, vertex_cursor - first_vertex });
+		mesh_meshlets.emplace_back(Range {
+		    first_meshlet_byte, meshlet_data.size() - first_meshlet_byte });
+		uploads.emplace_back(MeshData {
+		    .indices = std::span(index_data).subspan(
+		        first_byte, byte_cursor - first_byte),
+		    .vertices = std::as_bytes(std::span(vertices).subspan(
+		        first_vertex, vertex_cursor - first_vertex)),
+		    .vertex_format = VertexFormat::Full,
+		    .meshlets = {},
+		});
+
+		if (options.optimize && triangles > 0) {
+			auto const before_kib { static_cast<double>(
+				original_vertices * sizeof(Vertex)
+				+ triangles * 3 * sizeof(uint32_t)) / 1024.0 };
+			auto const after_kib { static_cast<double>(
+				(vertex_cursor - first_vertex) * stride
+				+ uploads.back().indices.size_bytes()) / 1024.0 };
+			renderer.logger().debug(CATEGORY,
+			    "Mesh '{}': ACMR {:.3f} -> {:.3f}, {} -> {} vertices, "
+			    "{:.1f} -> {:.1f} KiB",
+			    mesh.name, misses_before / static_cast<float>(triangles),
+			    misses_after / static_cast<float>(triangles),
+			    original_vertices, vertex_cursor - first_vertex, before_kib,
+			    after_kib);
+		}
+	}
+
+	// Only now that meshlet_data stopped growing.
+	for (size_t m { 0 }; m < new_meshes.size(); m++) {
+		uploads[m].meshlets = std::span(meshlet_data).subspan(
+		    mesh_meshlets[m].first, mesh_meshlets[m].count);
+	}
+
+	// Quantize against each mesh's own bounds, which the vertex shader
+	// undoes with the mesh's position offset and scale.
+	std::vector<CompactVertex> compact;
+	if (options.vertex_format == VertexFormat::Compact) {
+		compact.resize(vertex_cursor);
+		renderer.jobs().parallel_for(static_cast<uint32_t>(new_meshes.size()),
+		    [&](uint32_t m, uint32_t) {
+			    auto const range { mesh_vertices[m] };
+			    auto const source { std::span(vertices).subspan(
+				    range.first, range.count) };
+			    auto const destination { std::span(compact).subspan(
+				    range.first, range.count) };
+			    auto const quantization { position_quantization(source) };
+			    compact_vertices(source, quantization, destination);
+
+			    auto &mesh { new_meshes[m] };
+			    mesh.vertex_format = VertexFormat::Compact;
+			    mesh.position_offset = quantization.offset;
+			    mesh.position_scale = quantization.scale;
+			    uploads[m].vertices = std::as_bytes(destination);
+			    uploads[m].vertex_format = VertexFormat::Compact;
+		    });
+	}
 
-		meshes.emplace_back(std::make_shared<Mesh>(std::move(new_mesh)));
+	auto const gpu_meshes { renderer.upload_meshes(uploads) };
+	if (source_hash) {
+		BakedMeshes::save(
+		    renderer.logger(), baked_path, *source_hash, new_meshes, uploads);
 	}
 
+	std::vector<std::shared_ptr<Mesh>> meshes;
+	meshes.reserve(new_meshes.size());
+	for (size_t m { 0 }; m < new_meshes.size(); m++) {
+		new_meshes[m].gpu = gpu_meshes[m];
+		meshes.emplace_back(std::make_shared<Mesh>(std::move(new_meshes[m])));
+	}
+
+	renderer.logger().debug(CATEGORY,
+	    "Loaded {} meshes ({} primitives, {} vertices) in {:.2f} ms",
+	    meshes.size(), primitive_jobs.size(), vertex_cursor, elapsed_ms());
+
 	return meshes;
 }
 
-#endif // __cpp_lib_format_path
-
 } // namespace Lunar
@@ -1,29 +1,72 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
 
+#include <vulkan/vulkan_core.h>
+
 #include "Types.h"
 
 namespace Lunar {
 
 struct VulkanRenderer;
 
+struct MeshLoadOptions {
+	// Weld every primitive and reorder it for vertex cache, overdraw and
+	// vertex fetch efficiency before upload.
+	bool optimize { true };
+	VertexFormat vertex_format { VertexFormat::Full };
+	// Build meshlets for the mesh shading path. Skipped when the renderer
+	// cannot use them.
+	bool meshlets { true };
+	// Simplify every surface into coarser levels of detail.
+	bool lods { true };
+};
+
 struct Mesh {
-	struct Surface {
+	// One level of detail of a surface: an index range over the surface's
+	// vertices, which all levels share.
+	struct Lod {
+		// Counted in `index_type` units from the start of the mesh's index
+		// data.
 		uint32_t start_index;
 		uint32_t count;
+		// Object-space distance the level may stray from the full surface.
+		float error;
+		// The level's MeshletBlock, in bytes from the start of the mesh's
+		// meshlet data.
+		uint32_t meshlet_offset;
+		uint32_t meshlet_count;
+	};
+
+	struct Surface {
+		// First vertex of the surface within the mesh; indices are relative
+		// to it.
+		uint32_t base_vertex;
+		VkIndexType index_type;
+		// Object-space bounding sphere: xyz center, w radius.
+		smath::Vec4 bounds;
+		// lods[0] is the full surface; each further level has about half
+		// the triangles of the one before.
+		uint32_t lod_count;
+		std::array<Lod, MAX_LODS> lods;
 	};
 
 	std::string name;
 	std::vector<Surface> surfaces;
-	GPUMeshBuffers mesh_buffers;
+	GPUMesh gpu;
+	VertexFormat vertex_format { VertexFormat::Full };
+	// Compact vertices decode to position_offset + unorm * position_scale.
+	smath::Vec3 position_offset { 0.0f, 0.0f, 0.0f };
+	smath::Vec3 position_scale { 1.0f, 1.0f, 1.0f };
 
-	static auto load_gltf_meshes(
-	    VulkanRenderer &renderer, std::filesystem::path const path)
+	static auto load_gltf_meshes(VulkanRenderer &renderer,
+	    std::filesystem::path const path, MeshLoadOptions const &options = {})
 	    -> std::optional<std::vector<std::shared_ptr<Mesh>>>;
 };
 
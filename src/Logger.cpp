@@ -2,9 +2,17 @@
 
 #include "Util.h"
 
+#include <algorithm>
+#include <charconv>
 #include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstdio>
+#include <exception>
 #include <filesystem>
-#include <iostream>
+#include <functional>
+#include <iterator>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -13,11 +21,13 @@
 #	include <shlobj.h> // SHGetKnownFolderPath
 #	include <windows.h>
 #elif defined(__APPLE__)
+#	include <pthread.h>
 #	include <pwd.h>
 #	include <sys/types.h>
 #	include <unistd.h>
 #else
 #	include <pwd.h>
+#	include <sys/resource.h>
 #	include <unistd.h>
 #endif
 
@@ -31,6 +41,20 @@
 #define FG_GRAY "\033[90m"
 #define ANSI_RESET "\033[0m"
 
+// Longest the writer holds on to a Debug or Info message, and to unflushed
+// file contents.
+constexpr auto FLUSH_INTERVAL { std::chrono::milliseconds(50) };
+// A batch this large is written out without waiting for the ring to empty.
+constexpr size_t BATCH_BYTES { 64 * 1024 };
+// Read and compression buffer for archiving old logs.
+constexpr size_t COMPRESS_CHUNK_BYTES { 256 * 1024 };
+// How long a crashing process waits for its last messages to be written.
+constexpr auto CRASH_FLUSH_TIMEOUT { std::chrono::seconds(1) };
+
+// The logger flushed on a crash; the first one constructed.
+static std::atomic<Logger *> s_crash_logger { nullptr };
+static std::terminate_handler s_previous_terminate { nullptr };
+
 static std::filesystem::path get_log_path(std::string_view app_name)
 {
 #ifdef _WIN32
@@ -53,74 +77,158 @@ static std::filesystem::path get_log_path(std::string_view app_name)
 }
 
 #ifndef __EMSCRIPTEN__
-static int compress_file(std::filesystem::path const &input_path,
-    std::filesystem::path const &output_path)
+// Index N of a log_N.txt or log_N.txt.gz file name.
+static auto log_index(std::string_view name) -> std::optional<int>
+{
+	constexpr std::string_view prefix { "log_" };
+	if (!name.starts_with(prefix))
+		return std::nullopt;
+	name.remove_prefix(prefix.size());
+
+	int index { 0 };
+	auto const [end, ec] { std::from_chars(
+		name.data(), name.data() + name.size(), index) };
+	if (ec != std::errc {} || index < 0)
+		return std::nullopt;
+	auto const extension { name.substr(
+		static_cast<size_t>(end - name.data())) };
+	if (extension != ".txt" && extension != ".txt.gz")
+		return std::nullopt;
+	return index;
+}
+
+static auto log_file_name(int index) -> std::string
 {
-	size_t const chunk_size = 4096;
+	return std::format("log_{}.txt", index);
+}
+
+// Maintenance only competes with the application for spare cycles.
+static auto lower_thread_priority() -> void
+{
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__APPLE__)
+	pthread_set_qos_class_self_np(QOS_CLASS_BACKGROUND, 0);
+#else
+	// Linux applies nice values to single threads.
+	setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), 19);
+#endif
+}
 
+// Compresses into a temporary file that only takes the final name once
+// complete, so an interrupted run leaves the input for the next one.
+static auto compress_file(std::filesystem::path const &input_path,
+    std::filesystem::path const &output_path, std::stop_token const &stop)
+    -> bool
+{
 	std::ifstream in { input_path, std::ios::binary };
 	if (!in)
-		return 1;
+		return false;
 
-	gzFile out { gzopen(output_path.string().c_str(), "wb") };
+	auto tmp_path { output_path };
+	tmp_path += ".tmp";
+	gzFile out { gzopen(tmp_path.string().c_str(), "wb") };
 	if (!out)
-		return 1;
-	defer(gzclose(out));
+		return false;
+	gzbuffer(out, static_cast<unsigned int>(COMPRESS_CHUNK_BYTES));
 
-	std::vector<char> buffer(chunk_size);
-	while (in) {
+	auto ok { true };
+	std::vector<char> buffer(COMPRESS_CHUNK_BYTES);
+	while (ok && in) {
+		if (stop.stop_requested()) {
+			ok = false;
+			break;
+		}
 		in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
-		std::streamsize bytes = in.gcount();
-		if (bytes > 0)
-			gzwrite(out, buffer.data(), static_cast<unsigned int>(bytes));
+		auto const bytes { in.gcount() };
+		if (bytes > 0) {
+			ok = gzwrite(out, buffer.data(), static_cast<unsigned int>(bytes))
+			    == bytes;
+		}
 	}
+	ok = gzclose(out) == Z_OK && ok;
+	in.close();
 
-	std::filesystem::remove(input_path);
-
-	return 0;
+	std::error_code ec;
+	if (ok)
+		std::filesystem::rename(tmp_path, output_path, ec);
+	if (!ok || ec) {
+		std::filesystem::remove(tmp_path, ec);
+		return false;
+	}
+	std::filesystem::remove(input_path, ec);
+	return true;
 }
 #endif
 
-Logger::Logger(std::string_view app_name)
+Logger::Logger(std::string_view app_name, LogRetention const &retention)
 {
 #ifndef __EMSCRIPTEN__
-	auto path { get_log_path(app_name) };
-	auto const exists { std::filesystem::exists(path) };
-	if (exists && !std::filesystem::is_directory(path)) {
-		std::filesystem::remove_all(path);
-	}
-	if (!exists) {
-		std::filesystem::create_directories(path);
+	m_dir = get_log_path(app_name);
+	m_retention = retention;
+	if (std::filesystem::exists(m_dir)
+	    && !std::filesystem::is_directory(m_dir)) {
+		std::filesystem::remove_all(m_dir);
 	}
+	std::filesystem::create_directories(m_dir);
 
+	// Only names are read here; compression and pruning happen on the
+	// maintenance thread.
 	int max { -1 };
-	std::filesystem::directory_iterator iter(path);
-	for (auto const &file : iter) {
-		if (!file.is_regular_file())
-			continue;
+	for (auto const &file : std::filesystem::directory_iterator(m_dir)) {
+		if (auto const index { log_index(file.path().filename().string()) })
+			max = std::max(max, *index);
+	}
+	m_file_index.store(max + 1, std::memory_order_relaxed);
+	m_fout = std::ofstream(m_dir / log_file_name(max + 1),
+	    std::ios::app | std::ios::out);
+#endif // EMSCRIPTEN
 
-		auto name = file.path().filename().stem().string();
-		constexpr std::string_view prefix = "log_";
+	m_entries = std::make_unique<Entry[]>(CAPACITY);
+	for (uint64_t i { 0 }; i < CAPACITY; i++)
+		m_entries[i].sequence.store(i, std::memory_order_relaxed);
+	m_file_batch.reserve(BATCH_BYTES * 2);
+	m_console_batch.reserve(BATCH_BYTES * 2);
+	if (auto const *spec { std::getenv("LUNAR_LOG") })
+		apply_level_spec(spec);
 
-		if (name.rfind(prefix, 0) != 0) {
-			continue;
-		}
+#ifndef __EMSCRIPTEN__
+	m_writer = std::jthread(
+	    [this](std::stop_token stop) { writer_main(std::move(stop)); });
+	m_maintenance = std::jthread(
+	    [this](std::stop_token stop) { maintenance_main(std::move(stop)); });
 
-		int v = std::stoi(name.substr(prefix.size()));
-		if (v > max)
-			max = v;
+	Logger *expected { nullptr };
+	if (s_crash_logger.compare_exchange_strong(expected, this)) {
+		for (auto const signal : { SIGSEGV, SIGABRT, SIGFPE, SIGILL })
+			std::signal(signal, crash_handler);
+		s_previous_terminate = std::set_terminate([] {
+			flush_for_crash();
+			if (s_previous_terminate)
+				s_previous_terminate();
+			std::abort();
+		});
+	}
+#endif // EMSCRIPTEN
+}
 
-		auto ext = file.path().filename().extension().string();
-		if (ext == ".txt") {
-			auto np = file.path();
-			np.replace_extension(ext + ".gz");
-			compress_file(file.path(), np);
-		}
+Logger::~Logger()
+{
+#ifndef __EMSCRIPTEN__
+	Logger *expected { this };
+	if (s_crash_logger.compare_exchange_strong(expected, nullptr)) {
+		std::set_terminate(s_previous_terminate);
+		for (auto const signal : { SIGSEGV, SIGABRT, SIGFPE, SIGILL })
+			std::signal(signal, SIG_DFL);
 	}
-	max++;
 
-	path /= std::format("log_{}.txt", max);
-	m_fout = std::ofstream(path, std::ios::app | std::ios::out);
+	// Maintenance gives up mid-file; the next run picks up where it left
+	// off. It may still log, so the writer stops last and drains whatever
+	// is left before it returns.
+	m_maintenance.request_stop();
+	m_maintenance.join();
+	m_writer.request_stop();
+	m_writer.join();
 #endif // EMSCRIPTEN
 }
 
@@ -141,67 +249,389 @@ auto Logger::err(std::string_view msg) -> void
 	log(Logger::Level::Error, msg);
 }
 
-static std::string get_current_time_string()
+auto Logger::log(Level level, std::string_view msg) -> void
 {
-	auto now { std::chrono::system_clock::now() };
-	auto now_c { std::chrono::system_clock::to_time_t(now) };
-	std::tm tm { *std::gmtime(&now_c) };
-	std::ostringstream oss;
-	oss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
-	return oss.str();
+	log(Category::General, level, msg);
 }
 
-void Logger::log(Level level, std::string_view msg)
+auto Logger::log(Category category, Level level, std::string_view msg) -> void
 {
-	auto time_str = get_current_time_string();
-	std::string level_str;
-	switch (level) {
-	case Logger::Level::Debug:
-		level_str = "DEBUG";
-		break;
-	case Logger::Level::Info:
-		level_str = " INFO";
-		break;
-	case Logger::Level::Warning:
-		level_str = " WARN";
-		break;
-	case Logger::Level::Error:
-		level_str = "ERROR";
-		break;
-	default:
-		std::unreachable();
+	if (enabled(category, level))
+		push(level, std::string(msg));
+}
+
+auto Logger::set_level(Level level) -> void
+{
+	for (auto &category_level : m_levels)
+		category_level.store(level, std::memory_order_relaxed);
+}
+
+static auto parse_level(std::string_view name) -> std::optional<Logger::Level>
+{
+	if (name == "debug")
+		return Logger::Level::Debug;
+	if (name == "info")
+		return Logger::Level::Info;
+	if (name == "warning" || name == "warn")
+		return Logger::Level::Warning;
+	if (name == "error")
+		return Logger::Level::Error;
+	return std::nullopt;
+}
+
+static auto parse_category(std::string_view name)
+    -> std::optional<Logger::Category>
+{
+	if (name == "general")
+		return Logger::Category::General;
+	if (name == "vulkan")
+		return Logger::Category::Vulkan;
+	if (name == "loader")
+		return Logger::Category::Loader;
+	if (name == "renderer")
+		return Logger::Category::Renderer;
+	return std::nullopt;
+}
+
+auto Logger::apply_level_spec(std::string_view spec) -> void
+{
+	while (!spec.empty()) {
+		auto const comma { spec.find(',') };
+		auto const item { spec.substr(0, comma) };
+		spec = comma == std::string_view::npos ? std::string_view {}
+		                                       : spec.substr(comma + 1);
+		if (item.empty())
+			continue;
+
+		auto const equals { item.find('=') };
+		if (equals == std::string_view::npos) {
+			if (auto const level { parse_level(item) })
+				set_level(*level);
+			else
+				warn("Unknown log level '{}' in LUNAR_LOG", item);
+			continue;
+		}
+
+		auto const category { parse_category(item.substr(0, equals)) };
+		auto const level { parse_level(item.substr(equals + 1)) };
+		if (category && level)
+			set_level(*category, *level);
+		else
+			warn("Ignoring '{}' in LUNAR_LOG", item);
 	}
+}
 
-	auto const msg_file { std::format("{} [{}] {}", time_str, level_str, msg) };
-#ifdef _WIN32
-	auto const msg_stdout = msg_file;
-#elif __EMSCRIPTEN__
-	auto const msg_stdout = msg_file;
+auto Logger::push(Level level, std::string &&msg) -> void
+{
+	auto const time { std::chrono::system_clock::now() };
+
+#ifdef __EMSCRIPTEN__
+	// No threads to hand the message to.
+	std::scoped_lock lock { m_wake_mutex };
+	format_entry(level, time, msg);
+	write_batches();
 #else
+	auto pos { m_head.load(std::memory_order_relaxed) };
+	Entry *entry { nullptr };
+	for (;;) {
+		entry = &m_entries[pos & (CAPACITY - 1)];
+		auto const sequence { entry->sequence.load(std::memory_order_acquire) };
+		if (sequence == pos) {
+			if (m_head.compare_exchange_weak(
+			        pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (sequence < pos) {
+			// Full: the writer has not freed this entry from the last lap.
+			if (level < Level::Warning
+			    && m_overflow.load(std::memory_order_relaxed)
+			        == Overflow::Drop) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			wake();
+			std::this_thread::yield();
+			pos = m_head.load(std::memory_order_relaxed);
+		} else {
+			pos = m_head.load(std::memory_order_relaxed);
+		}
+	}
+
+	entry->level = level;
+	entry->time = time;
+	entry->message = std::move(msg);
+	entry->sequence.store(pos + 1, std::memory_order_release);
+
+	// Debug and Info wait for the writer's next round unless the ring is
+	// filling up.
+	if (level >= Level::Warning
+	    || pos - m_tail.load(std::memory_order_relaxed) >= CAPACITY / 2)
+		wake();
+#endif // EMSCRIPTEN
+}
+
+auto Logger::wake() -> void
+{
+	if (!m_writer_idle.load(std::memory_order_seq_cst))
+		return;
+	// Taking the lock orders this against the writer's last check before
+	// it sleeps, so the notification cannot fall in between.
+	{
+		std::scoped_lock lock { m_wake_mutex };
+	}
+	m_wake.notify_one();
+}
+
+auto Logger::flush() -> void
+{
+#ifndef __EMSCRIPTEN__
+	auto const target { m_head.load(std::memory_order_acquire) };
+	m_flush_requested.store(true, std::memory_order_release);
+	wake();
+	wait_flushed(target, std::chrono::steady_clock::time_point::max());
+#endif // EMSCRIPTEN
+}
+
+auto Logger::wait_flushed(uint64_t target,
+    std::chrono::steady_clock::time_point deadline) -> void
+{
+	while (m_flushed.load(std::memory_order_acquire) < target) {
+		if (std::chrono::steady_clock::now() >= deadline)
+			return;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+auto Logger::flush_for_crash() -> void
+{
+	// Not async-signal-safe, but the process is going down regardless and
+	// the messages leading up to the crash are the ones worth having. The
+	// writer is not woken, as the crashing thread may hold the wake mutex;
+	// it comes round within FLUSH_INTERVAL on its own.
+	auto *logger { s_crash_logger.exchange(nullptr) };
+	if (!logger)
+		return;
+	auto const target { logger->m_head.load(std::memory_order_acquire) };
+	logger->m_flush_requested.store(true, std::memory_order_release);
+	logger->wait_flushed(
+	    target, std::chrono::steady_clock::now() + CRASH_FLUSH_TIMEOUT);
+}
+
+auto Logger::crash_handler(int signal) -> void
+{
+	flush_for_crash();
+	std::signal(signal, SIG_DFL);
+	std::raise(signal);
+}
+
+auto Logger::writer_main(std::stop_token stop) -> void
+{
+	m_last_flush = std::chrono::steady_clock::now();
+	while (!stop.stop_requested()) {
+		drain();
+
+		std::unique_lock lock { m_wake_mutex };
+		m_writer_idle.store(true, std::memory_order_seq_cst);
+		m_wake.wait_for(lock, stop, FLUSH_INTERVAL, [&] {
+			auto const tail { m_tail.load(std::memory_order_relaxed) };
+			return m_entries[tail & (CAPACITY - 1)].sequence.load(
+			           std::memory_order_acquire)
+			    == tail + 1
+			    || m_flush_requested.load(std::memory_order_acquire);
+		});
+		m_writer_idle.store(false, std::memory_order_relaxed);
+	}
+
+	m_flush_requested.store(true, std::memory_order_relaxed);
+	drain();
+}
+
+auto Logger::drain() -> void
+{
+	auto tail { m_tail.load(std::memory_order_relaxed) };
+	auto saw_error { false };
+	for (;;) {
+		auto &entry { m_entries[tail & (CAPACITY - 1)] };
+		if (entry.sequence.load(std::memory_order_acquire) != tail + 1)
+			break;
+
+		format_entry(entry.level, entry.time, entry.message);
+		saw_error |= entry.level == Level::Error;
+		entry.sequence.store(tail + CAPACITY, std::memory_order_release);
+		tail++;
+		m_tail.store(tail, std::memory_order_relaxed);
+
+		if (m_file_batch.size() >= BATCH_BYTES)
+			write_batches();
+	}
+
+	if (auto const dropped {
+	        m_dropped.exchange(0, std::memory_order_relaxed) }) {
+		format_entry(Level::Warning, std::chrono::system_clock::now(),
+		    std::format("Dropped {} log messages while the log was full",
+		        dropped));
+	}
+	write_batches();
+
+	auto const now { std::chrono::steady_clock::now() };
+	if (saw_error || m_flush_requested.exchange(false)
+	    || now - m_last_flush >= FLUSH_INTERVAL) {
+#ifndef __EMSCRIPTEN__
+		m_fout.flush();
+#endif // EMSCRIPTEN
+		std::fflush(stderr);
+		m_last_flush = now;
+		m_flushed.store(tail, std::memory_order_release);
+	}
+}
+
+auto Logger::format_entry(Level level,
+    std::chrono::system_clock::time_point time, std::string_view message)
+    -> void
+{
+	// Formatting the date dominates short messages, and most messages in a
+	// batch share their second.
+	auto const second { std::chrono::floor<std::chrono::seconds>(time) };
+	if (second != m_time_second || m_time_string.empty()) {
+		m_time_second = second;
+		m_time_string = std::format("{:%Y-%m-%dT%H:%M:%SZ}", second);
+	}
+
+	std::string_view level_str;
 	char const *color;
 	switch (level) {
 	case Logger::Level::Debug:
+		level_str = "DEBUG";
 		color = FG_GRAY;
 		break;
 	case Logger::Level::Info:
+		level_str = " INFO";
 		color = FG_BLUE;
 		break;
 	case Logger::Level::Warning:
+		level_str = " WARN";
 		color = FG_YELLOW;
 		break;
 	case Logger::Level::Error:
+		level_str = "ERROR";
 		color = FG_RED;
 		break;
 	default:
 		std::unreachable();
 	}
 
-	auto const msg_stdout { std::format(
-		"{}{} [{}] {}" ANSI_RESET, color, time_str, level_str, msg) };
+#ifndef __EMSCRIPTEN__
+	std::format_to(std::back_inserter(m_file_batch), "{} [{}] {}\n",
+	    m_time_string, level_str, message);
+#endif // EMSCRIPTEN
+#if defined(_WIN32) || defined(__EMSCRIPTEN__)
+	(void)color;
+	std::format_to(std::back_inserter(m_console_batch), "{} [{}] {}\n",
+	    m_time_string, level_str, message);
+#else
+	std::format_to(std::back_inserter(m_console_batch),
+	    "{}{} [{}] {}" ANSI_RESET "\n", color, m_time_string, level_str,
+	    message);
 #endif
+}
 
+auto Logger::write_batches() -> void
+{
 #ifndef __EMSCRIPTEN__
-	m_fout << msg_file << std::endl;
+	if (!m_file_batch.empty()) {
+		m_fout.write(m_file_batch.data(),
+		    static_cast<std::streamsize>(m_file_batch.size()));
+		m_file_bytes += m_file_batch.size();
+		m_file_batch.clear();
+		if (m_retention.rotate_bytes != 0
+		    && m_file_bytes >= m_retention.rotate_bytes)
+			rotate();
+	}
 #endif // EMSCRIPTEN
-	std::println(std::cerr, "{}", msg_stdout);
+	if (!m_console_batch.empty()) {
+		std::fwrite(
+		    m_console_batch.data(), 1, m_console_batch.size(), stderr);
+		m_console_batch.clear();
+	}
+}
+
+#ifndef __EMSCRIPTEN__
+auto Logger::rotate() -> void
+{
+	auto const index { m_file_index.load(std::memory_order_relaxed) + 1 };
+	m_fout.close();
+	m_fout = std::ofstream(
+	    m_dir / log_file_name(index), std::ios::app | std::ios::out);
+	m_file_bytes = 0;
+	m_file_index.store(index, std::memory_order_relaxed);
+
+	{
+		std::scoped_lock lock { m_maintenance_mutex };
+		m_maintenance_pending = true;
+	}
+	m_maintenance_wake.notify_one();
+}
+
+auto Logger::maintenance_main(std::stop_token stop) -> void
+{
+	lower_thread_priority();
+	for (;;) {
+		archive_logs(stop);
+
+		std::unique_lock lock { m_maintenance_mutex };
+		if (!m_maintenance_wake.wait(
+		        lock, stop, [&] { return m_maintenance_pending; }))
+			return;
+		m_maintenance_pending = false;
+	}
 }
+
+auto Logger::archive_logs(std::stop_token const &stop) -> void
+{
+	struct Archive {
+		int index;
+		std::filesystem::path path;
+		uintmax_t size;
+	};
+	std::vector<Archive> archives;
+
+	std::error_code ec;
+	for (auto const &file : std::filesystem::directory_iterator(m_dir, ec)) {
+		auto const index { log_index(file.path().filename().string()) };
+		// The file being written is never touched.
+		if (!index || *index >= m_file_index.load(std::memory_order_relaxed))
+			continue;
+		archives.emplace_back(*index, file.path(), file.file_size(ec));
+	}
+
+	// Newest first. Files past the count limit go before anything is
+	// compressed, so runs too short to finish compressing cannot pile up.
+	std::ranges::sort(archives, std::ranges::greater {}, &Archive::index);
+	while (archives.size() > m_retention.max_files) {
+		std::filesystem::remove(archives.back().path, ec);
+		archives.pop_back();
+	}
+
+	for (auto &archive : archives) {
+		if (archive.path.extension() == ".gz")
+			continue;
+		if (stop.stop_requested())
+			return;
+		auto output { archive.path };
+		output += ".gz";
+		if (!compress_file(archive.path, output, stop)) {
+			if (!stop.stop_requested())
+				warn("Failed to compress old log {}", archive.path.string());
+			continue;
+		}
+		archive.path = output;
+		archive.size = std::filesystem::file_size(output, ec);
+	}
+
+	uintmax_t total { 0 };
+	for (auto const &archive : archives) {
+		total += archive.size;
+		if (total > m_retention.max_bytes)
+			std::filesystem::remove(archive.path, ec);
+	}
+}
+#endif // EMSCRIPTEN
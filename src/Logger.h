@@ -1,9 +1,39 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
 #include <format>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <string_view>
+#include <thread>
 
+// Set from the log_min_level build option, as a Logger::Level.
+#ifndef LUNAR_LOG_MIN_LEVEL
+#	define LUNAR_LOG_MIN_LEVEL 0
+#endif
+
+// Which old logs are kept. Logs from earlier runs, and rotated ones, are
+// gzipped in the background; the oldest archives beyond either limit are
+// deleted.
+struct LogRetention {
+	size_t max_files { 20 };
+	uint64_t max_bytes { 64 * 1024 * 1024 };
+	// Starts a new file once the current one reaches this size; 0 keeps
+	// one file per run.
+	uint64_t rotate_bytes { 0 };
+};
+
+// Messages are queued on a lock-free ring and written by a background
+// thread, so logging never waits on the file or the terminal unless the
+// ring is full. Pending messages are written out on destruction, on
+// flush(), and when the process crashes.
 struct Logger {
 	enum class Level {
 		Debug,
@@ -12,7 +42,36 @@ struct Logger {
 		Error,
 	};
 
-	Logger(std::string_view app_name);
+	// What a full ring does to Debug and Info messages. Warnings and errors
+	// always wait for room.
+	enum class Overflow {
+		Drop,
+		Block,
+	};
+
+	// Subsystems with their own minimum level.
+	enum class Category {
+		General,
+		// Validation layer and driver messages.
+		Vulkan,
+		Loader,
+		Renderer,
+	};
+	static constexpr size_t CATEGORY_COUNT { 4 };
+
+	// Lowest level compiled in at all; see the log_min_level option. Calls
+	// below it are discarded before their arguments are formatted.
+	static constexpr Level COMPILED_MIN_LEVEL { static_cast<Level>(
+		LUNAR_LOG_MIN_LEVEL) };
+
+	// Starts with the levels in the LUNAR_LOG environment variable, a comma
+	// separated list of `level` or `category=level`, e.g.
+	// "info,loader=debug".
+	Logger(std::string_view app_name, LogRetention const &retention = {});
+	~Logger();
+
+	Logger(Logger const &) = delete;
+	auto operator=(Logger const &) -> Logger & = delete;
 
 	auto debug(std::string_view msg) -> void;
 	auto info(std::string_view msg) -> void;
@@ -22,31 +81,169 @@ struct Logger {
 	template<typename... Args>
 	auto debug(std::format_string<Args...> fmt, Args &&...args) -> void
 	{
-		log(Level::Debug, std::format(fmt, std::forward<Args>(args)...));
+		debug(Category::General, fmt, std::forward<Args>(args)...);
 	}
 
 	template<typename... Args>
 	auto info(std::format_string<Args...> fmt, Args &&...args) -> void
 	{
-		log(Level::Info, std::format(fmt, std::forward<Args>(args)...));
+		info(Category::General, fmt, std::forward<Args>(args)...);
 	}
 
 	template<typename... Args>
 	auto warn(std::format_string<Args...> fmt, Args &&...args) -> void
 	{
-		log(Level::Warning, std::format(fmt, std::forward<Args>(args)...));
+		warn(Category::General, fmt, std::forward<Args>(args)...);
 	}
 
 	template<typename... Args>
 	auto err(std::format_string<Args...> fmt, Args &&...args) -> void
 	{
-		log(Level::Error, std::format(fmt, std::forward<Args>(args)...));
+		err(Category::General, fmt, std::forward<Args>(args)...);
+	}
+
+	template<typename... Args>
+	auto debug(Category category, std::format_string<Args...> fmt,
+	    Args &&...args) -> void
+	{
+		log_at<Level::Debug>(category, fmt, std::forward<Args>(args)...);
+	}
+
+	template<typename... Args>
+	auto info(Category category, std::format_string<Args...> fmt,
+	    Args &&...args) -> void
+	{
+		log_at<Level::Info>(category, fmt, std::forward<Args>(args)...);
+	}
+
+	template<typename... Args>
+	auto warn(Category category, std::format_string<Args...> fmt,
+	    Args &&...args) -> void
+	{
+		log_at<Level::Warning>(category, fmt, std::forward<Args>(args)...);
+	}
+
+	template<typename... Args>
+	auto err(Category category, std::format_string<Args...> fmt,
+	    Args &&...args) -> void
+	{
+		log_at<Level::Error>(category, fmt, std::forward<Args>(args)...);
+	}
+
+	template<typename... Args>
+	auto log(Category category, Level level, std::format_string<Args...> fmt,
+	    Args &&...args) -> void
+	{
+		if (enabled(category, level))
+			push(level, std::format(fmt, std::forward<Args>(args)...));
 	}
 
 	auto log(Level level, std::string_view msg) -> void;
+	auto log(Category category, Level level, std::string_view msg) -> void;
+
+	// Whether messages at `level` in `category` get written; a relaxed load.
+	auto enabled(Category category, Level level) const -> bool
+	{
+		return level >= COMPILED_MIN_LEVEL
+		    && level >= m_levels[static_cast<size_t>(category)].load(
+		           std::memory_order_relaxed);
+	}
+
+	// Levels below COMPILED_MIN_LEVEL stay off regardless.
+	auto set_level(Level level) -> void;
+	auto set_level(Category category, Level level) -> void
+	{
+		m_levels[static_cast<size_t>(category)].store(
+		    level, std::memory_order_relaxed);
+	}
+
+	// Returns once everything logged before the call is written and the
+	// file flushed.
+	auto flush() -> void;
+
+	auto set_overflow(Overflow overflow) -> void
+	{
+		m_overflow.store(overflow, std::memory_order_relaxed);
+	}
 
 private:
+	struct Entry {
+		// Vyukov's bounded queue: equals the position a producer may claim
+		// while free, and that position + 1 once the entry is published.
+		std::atomic<uint64_t> sequence;
+		Level level;
+		std::chrono::system_clock::time_point time;
+		std::string message;
+	};
+
+	// Entries in the ring; a power of two.
+	static constexpr uint64_t CAPACITY { 4096 };
+
+	template<Level level, typename... Args>
+	auto log_at(Category category, std::format_string<Args...> fmt,
+	    Args &&...args) -> void
+	{
+		if constexpr (level >= COMPILED_MIN_LEVEL) {
+			if (enabled(category, level))
+				push(level, std::format(fmt, std::forward<Args>(args)...));
+		}
+	}
+
+	auto apply_level_spec(std::string_view spec) -> void;
+	auto push(Level level, std::string &&msg) -> void;
+	auto wake() -> void;
+	auto wait_flushed(uint64_t target,
+	    std::chrono::steady_clock::time_point deadline) -> void;
+	auto writer_main(std::stop_token stop) -> void;
+	// Writes out every published entry. Writer thread only.
+	auto drain() -> void;
+	auto format_entry(Level level, std::chrono::system_clock::time_point time,
+	    std::string_view message) -> void;
+	auto write_batches() -> void;
 #ifndef __EMSCRIPTEN__
+	auto rotate() -> void;
+	auto maintenance_main(std::stop_token stop) -> void;
+	// Compresses finished logs and applies the retention limits.
+	auto archive_logs(std::stop_token const &stop) -> void;
+#endif
+	static auto flush_for_crash() -> void;
+	static auto crash_handler(int signal) -> void;
+
+	std::unique_ptr<Entry[]> m_entries;
+	alignas(64) std::atomic<uint64_t> m_head { 0 };
+	// Next entry the writer reads.
+	alignas(64) std::atomic<uint64_t> m_tail { 0 };
+	// Entries before this position are written and flushed.
+	std::atomic<uint64_t> m_flushed { 0 };
+	std::atomic<bool> m_flush_requested { false };
+	std::atomic<uint64_t> m_dropped { 0 };
+	std::atomic<Overflow> m_overflow { Overflow::Block };
+	std::array<std::atomic<Level>, CATEGORY_COUNT> m_levels {};
+
+	// Writer thread state.
+	std::string m_file_batch;
+	std::string m_console_batch;
+	std::chrono::steady_clock::time_point m_last_flush {};
+	std::chrono::sys_seconds m_time_second {};
+	std::string m_time_string;
+
+	// Only taken to sleep and to wake the writer, never to log.
+	std::mutex m_wake_mutex;
+	std::condition_variable_any m_wake;
+	std::atomic<bool> m_writer_idle { false };
+#ifndef __EMSCRIPTEN__
+	std::filesystem::path m_dir;
+	LogRetention m_retention;
+	// Index of the file being written; older ones belong to maintenance.
+	std::atomic<int> m_file_index { 0 };
+	// Writer thread only.
+	uint64_t m_file_bytes { 0 };
 	std::ofstream m_fout;
+
+	std::mutex m_maintenance_mutex;
+	std::condition_variable_any m_maintenance_wake;
+	bool m_maintenance_pending { false };
+	std::jthread m_maintenance;
 #endif
+	std::jthread m_writer;
 };
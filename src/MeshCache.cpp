@@ -0,0 +1,427 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#include "Meshlets.h"
+#include "Util.h"
+
+namespace Lunar {
+
+constexpr auto CATEGORY { Logger::Category::Loader };
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr))
+    , m_size(std::exchange(other.m_size, 0))
+{
+}
+
+auto MappedFile::operator=(MappedFile &&other) noexcept -> MappedFile &
+{
+	if (this != &other) {
+		unmap();
+		m_data = std::exchange(other.m_data, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile() { unmap(); }
+
+auto MappedFile::open(std::filesystem::path const &path)
+    -> std::optional<MappedFile>
+{
+	MappedFile file;
+#ifdef _WIN32
+	auto const handle { CreateFileW(path.c_str(), GENERIC_READ,
+		FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+		nullptr) };
+	if (handle == INVALID_HANDLE_VALUE)
+		return std::nullopt;
+
+	LARGE_INTEGER size {};
+	HANDLE mapping { nullptr };
+	if (GetFileSizeEx(handle, &size) && size.QuadPart > 0) {
+		mapping = CreateFileMappingW(
+		    handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	}
+	CloseHandle(handle);
+	if (mapping == nullptr)
+		return std::nullopt;
+
+	// The view keeps the mapping alive.
+	auto const *data { MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) };
+	CloseHandle(mapping);
+	if (data == nullptr)
+		return std::nullopt;
+	file.m_size = static_cast<size_t>(size.QuadPart);
+#else
+	auto const fd { ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+	if (fd < 0)
+		return std::nullopt;
+
+	struct stat st {};
+	void *data { MAP_FAILED };
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+		    MAP_PRIVATE, fd, 0);
+	}
+	::close(fd);
+	if (data == MAP_FAILED)
+		return std::nullopt;
+	file.m_size = static_cast<size_t>(st.st_size);
+#endif
+	file.m_data = static_cast<std::byte const *>(data);
+	return file;
+}
+
+auto MappedFile::unmap() -> void
+{
+	if (m_data == nullptr)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+#else
+	munmap(const_cast<std::byte *>(m_data), m_size);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+
+static auto as_u8(std::span<std::byte const> bytes)
+    -> std::span<uint8_t const>
+{
+	return { reinterpret_cast<uint8_t const *>(bytes.data()), bytes.size() };
+}
+
+static auto align_up(uint64_t value, uint64_t alignment) -> uint64_t
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+auto BakedMeshes::hash_source(std::filesystem::path const &source)
+    -> std::optional<uint64_t>
+{
+	auto const file { MappedFile::open(source) };
+	if (!file)
+		return std::nullopt;
+	return fnv1a(as_u8(file->bytes()));
+}
+
+auto BakedMeshes::path_for(std::filesystem::path const &directory,
+    std::filesystem::path const &source) -> std::filesystem::path
+{
+	std::error_code ec;
+	auto const absolute { std::filesystem::weakly_canonical(source, ec) };
+	auto const key { (ec ? source : absolute).generic_string() };
+	auto const key_hash { fnv1a(as_u8(std::as_bytes(std::span(key)))) };
+	return directory
+	    / std::format("{}-{:016x}.lmesh", source.stem().string(), key_hash);
+}
+
+auto BakedMeshes::load(Logger &logger, std::filesystem::path const &path,
+    uint64_t source_hash) -> std::optional<BakedMeshes>
+{
+	auto file { MappedFile::open(path) };
+	if (!file) {
+		logger.debug(CATEGORY, "No baked meshes at {}", path.string());
+		return std::nullopt;
+	}
+	auto const bytes { file->bytes() };
+
+	auto const reject { [&](std::string_view reason) {
+		logger.info(CATEGORY, "Baked meshes at {} {}, reparsing",
+		    path.string(), reason);
+		return std::nullopt;
+	} };
+
+	Header header {};
+	if (bytes.size() < sizeof(header))
+		return reject("are truncated");
+	std::memcpy(&header, bytes.data(), sizeof(header));
+	if (header.magic != MAGIC || header.version != VERSION
+	    || header.vertex_size != sizeof(Vertex))
+		return reject("have an unknown format");
+	if (header.source_hash != source_hash)
+		return reject("are stale");
+
+	// The tables and the ranges they give are validated, not the blobs:
+	// that would mean the per-vertex pass this format exists to avoid.
+	// Files are replaced atomically, so a torn write cannot be picked up.
+	auto const tables_end { sizeof(Header)
+		+ uint64_t { header.mesh_count } * sizeof(MeshRecord)
+		+ uint64_t { header.surface_count } * sizeof(SurfaceRecord)
+		+ header.names_size };
+	if (header.file_size != bytes.size()
+	    || header.vertex_offset % BLOB_ALIGNMENT != 0
+	    || header.index_offset % BLOB_ALIGNMENT != 0
+	    || header.meshlet_offset % BLOB_ALIGNMENT != 0
+	    || tables_end > header.vertex_offset
+	    || header.vertex_offset > header.index_offset
+	    || header.vertex_bytes > header.index_offset - header.vertex_offset
+	    || header.index_offset > header.meshlet_offset
+	    || header.index_bytes > header.meshlet_offset - header.index_offset
+	    || header.meshlet_offset > header.file_size
+	    || header.meshlet_bytes > header.file_size - header.meshlet_offset)
+		return reject("are corrupt");
+
+	BakedMeshes baked {};
+	auto const *tables { bytes.data() + sizeof(Header) };
+	baked.m_meshes = { reinterpret_cast<MeshRecord const *>(tables),
+		header.mesh_count };
+	tables += baked.m_meshes.size_bytes();
+	baked.m_surfaces = { reinterpret_cast<SurfaceRecord const *>(tables),
+		header.surface_count };
+	tables += baked.m_surfaces.size_bytes();
+	baked.m_names = { reinterpret_cast<char const *>(tables),
+		header.names_size };
+	baked.m_vertices = bytes.subspan(header.vertex_offset, header.vertex_bytes);
+	baked.m_indices = bytes.subspan(header.index_offset, header.index_bytes);
+	baked.m_meshlets
+	    = bytes.subspan(header.meshlet_offset, header.meshlet_bytes);
+
+	for (auto const &surface : baked.m_surfaces) {
+		if (surface.lod_count == 0 || surface.lod_count > MAX_LODS)
+			return reject("are corrupt");
+	}
+
+	for (auto const &mesh : baked.m_meshes) {
+		auto const format { static_cast<VertexFormat>(mesh.vertex_format) };
+		if (uint64_t { mesh.name_offset } + mesh.name_size > header.names_size
+		    || uint64_t { mesh.first_surface } + mesh.surface_count
+		        > header.surface_count
+		    || (format != VertexFormat::Full
+		        && format != VertexFormat::Compact)
+		    || mesh.vertex_bytes % vertex_stride(format) != 0
+		    || mesh.first_vertex_byte + mesh.vertex_bytes > header.vertex_bytes
+		    || mesh.first_index_byte + mesh.index_bytes > header.index_bytes
+		    || mesh.first_meshlet_byte % 16 != 0
+		    || mesh.first_meshlet_byte + mesh.meshlet_bytes
+		        > header.meshlet_bytes)
+			return reject("are corrupt");
+
+		// Ranges are uploaded as-is, so one out of bounds would have the GPU
+		// read past the mesh's data.
+		auto const vertex_count { mesh.vertex_bytes / vertex_stride(format) };
+		for (auto const &surface : baked.m_surfaces.subspan(
+		         mesh.first_surface, mesh.surface_count)) {
+			if ((surface.index_size != 2 && surface.index_size != 4)
+			    || surface.base_vertex > vertex_count)
+				return reject("are corrupt");
+			auto const index_count { mesh.index_bytes / surface.index_size };
+			for (uint32_t l { 0 }; l < surface.lod_count; l++) {
+				auto const &lod { surface.lods[l] };
+				if (uint64_t { lod.start_index } + lod.count > index_count
+				    || lod.meshlet_offset % 16 != 0
+				    || lod.meshlet_offset
+				            + uint64_t { lod.meshlet_count } * sizeof(Meshlet)
+				        > mesh.meshlet_bytes)
+					return reject("are corrupt");
+			}
+		}
+	}
+
+	baked.m_file = std::move(*file);
+	return baked;
+}
+
+auto BakedMeshes::save(Logger &logger, std::filesystem::path const &path,
+    uint64_t source_hash, std::span<Mesh const> meshes,
+    std::span<MeshData const> data) -> bool
+{
+	static_assert(std::is_trivially_copyable_v<Vertex>);
+	static_assert(std::is_trivially_copyable_v<SurfaceRecord>);
+
+	std::vector<MeshRecord> mesh_records;
+	std::vector<SurfaceRecord> surface_records;
+	std::string names;
+	Header header {
+		.magic = MAGIC,
+		.version = VERSION,
+		.source_hash = source_hash,
+		.vertex_size = sizeof(Vertex),
+		.mesh_count = static_cast<uint32_t>(meshes.size()),
+		.surface_count = 0,
+		.names_size = 0,
+		.vertex_bytes = 0,
+		.index_bytes = 0,
+		.meshlet_bytes = 0,
+		.vertex_offset = 0,
+		.index_offset = 0,
+		.meshlet_offset = 0,
+		.file_size = 0,
+	};
+	for (size_t m { 0 }; m < meshes.size(); m++) {
+		auto const &mesh { meshes[m] };
+		auto const &offset { mesh.position_offset };
+		auto const &scale { mesh.position_scale };
+		mesh_records.emplace_back(MeshRecord {
+		    .name_offset = static_cast<uint32_t>(names.size()),
+		    .name_size = static_cast<uint32_t>(mesh.name.size()),
+		    .first_surface = static_cast<uint32_t>(surface_records.size()),
+		    .surface_count = static_cast<uint32_t>(mesh.surfaces.size()),
+		    .vertex_format = static_cast<uint32_t>(data[m].vertex_format),
+		    .position_offset = { offset.x(), offset.y(), offset.z() },
+		    .position_scale = { scale.x(), scale.y(), scale.z() },
+		    .padding = 0,
+		    .first_vertex_byte = header.vertex_bytes,
+		    .vertex_bytes = data[m].vertices.size(),
+		    .first_index_byte = header.index_bytes,
+		    .index_bytes = data[m].indices.size(),
+		    .first_meshlet_byte = header.meshlet_bytes,
+		    .meshlet_bytes = data[m].meshlets.size(),
+		});
+		names += mesh.name;
+		for (auto const &surface : mesh.surfaces) {
+			auto &record { surface_records.emplace_back(SurfaceRecord {
+			    .base_vertex = surface.base_vertex,
+			    .index_size = surface.index_type == VK_INDEX_TYPE_UINT16
+			        ? 2u
+			        : 4u,
+			    .bounds = { surface.bounds.x(), surface.bounds.y(),
+			        surface.bounds.z(), surface.bounds.w() },
+			    .lod_count = surface.lod_count,
+			    .lods = {},
+			}) };
+			for (uint32_t l { 0 }; l < surface.lod_count; l++) {
+				auto const &lod { surface.lods[l] };
+				record.lods[l] = LodRecord {
+					.start_index = lod.start_index,
+					.count = lod.count,
+					.error = lod.error,
+					.meshlet_offset = lod.meshlet_offset,
+					.meshlet_count = lod.meshlet_count,
+				};
+			}
+		}
+		header.vertex_bytes += data[m].vertices.size();
+		header.index_bytes += data[m].indices.size();
+		// Keeps every mesh's meshlet blocks 16-byte aligned.
+		header.meshlet_bytes
+		    += align_up(data[m].meshlets.size(), uint64_t { 16 });
+	}
+	header.surface_count = static_cast<uint32_t>(surface_records.size());
+	header.names_size = static_cast<uint32_t>(names.size());
+
+	auto const tables_end { sizeof(Header)
+		+ mesh_records.size() * sizeof(MeshRecord)
+		+ surface_records.size() * sizeof(SurfaceRecord) + names.size() };
+	header.vertex_offset = align_up(tables_end, BLOB_ALIGNMENT);
+	header.index_offset = align_up(
+	    header.vertex_offset + header.vertex_bytes, BLOB_ALIGNMENT);
+	header.meshlet_offset = align_up(
+	    header.index_offset + header.index_bytes, BLOB_ALIGNMENT);
+	header.file_size = header.meshlet_offset + header.meshlet_bytes;
+
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	// Same scheme as the pipeline cache: write next to the destination and
+	// rename over it, so a crash never leaves a torn file to be mapped.
+	auto tmp_path { path };
+	tmp_path += ".tmp";
+	{
+		std::ofstream out { tmp_path, std::ios::binary | std::ios::trunc };
+		auto const write { [&](void const *bytes, size_t size) {
+			out.write(static_cast<char const *>(bytes),
+			    static_cast<std::streamsize>(size));
+		} };
+		auto const pad_to { [&](uint64_t offset) {
+			std::vector<char> const zeros(
+			    offset - static_cast<uint64_t>(out.tellp()));
+			write(zeros.data(), zeros.size());
+		} };
+
+		write(&header, sizeof(header));
+		write(mesh_records.data(), mesh_records.size() * sizeof(MeshRecord));
+		write(surface_records.data(),
+		    surface_records.size() * sizeof(SurfaceRecord));
+		write(names.data(), names.size());
+		pad_to(header.vertex_offset);
+		for (auto const &mesh : data)
+			write(mesh.vertices.data(), mesh.vertices.size_bytes());
+		pad_to(header.index_offset);
+		for (auto const &mesh : data)
+			write(mesh.indices.data(), mesh.indices.size_bytes());
+		pad_to(header.meshlet_offset);
+		for (size_t m { 0 }; m < data.size(); m++) {
+			write(data[m].meshlets.data(), data[m].meshlets.size_bytes());
+			pad_to(header.meshlet_offset + mesh_records[m].first_meshlet_byte
+			    + align_up(data[m].meshlets.size(), uint64_t { 16 }));
+		}
+		out.flush();
+		if (!out) {
+			logger.warn(CATEGORY, "Failed to write baked meshes to {}",
+			    tmp_path.string());
+			std::filesystem::remove(tmp_path, ec);
+			return false;
+		}
+	}
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		logger.warn(
+		    CATEGORY, "Failed to replace baked meshes: {}", ec.message());
+		std::filesystem::remove(tmp_path, ec);
+		return false;
+	}
+
+	logger.info(CATEGORY, "Baked {} meshes ({} KiB) to {}", meshes.size(),
+	    header.file_size / 1024, path.string());
+	return true;
+}
+
+auto BakedMeshes::name(size_t mesh) const -> std::string_view
+{
+	auto const &record { m_meshes[mesh] };
+	return m_names.substr(record.name_offset, record.name_size);
+}
+
+auto BakedMeshes::surfaces(size_t mesh) const
+    -> std::span<SurfaceRecord const>
+{
+	auto const &record { m_meshes[mesh] };
+	return m_surfaces.subspan(record.first_surface, record.surface_count);
+}
+
+auto BakedMeshes::data(size_t mesh) const -> MeshData
+{
+	auto const &record { m_meshes[mesh] };
+	return MeshData {
+		.indices
+		= m_indices.subspan(record.first_index_byte, record.index_bytes),
+		.vertices
+		= m_vertices.subspan(record.first_vertex_byte, record.vertex_bytes),
+		.vertex_format = static_cast<VertexFormat>(record.vertex_format),
+		.meshlets = m_meshlets.subspan(
+		    record.first_meshlet_byte, record.meshlet_bytes),
+	};
+}
+
+auto BakedMeshes::position_offset(size_t mesh) const -> smath::Vec3
+{
+	auto const &offset { m_meshes[mesh].position_offset };
+	return { offset[0], offset[1], offset[2] };
+}
+
+auto BakedMeshes::position_scale(size_t mesh) const -> smath::Vec3
+{
+	auto const &scale { m_meshes[mesh].position_scale };
+	return { scale[0], scale[1], scale[2] };
+}
+
+} // namespace Lunar
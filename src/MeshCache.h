@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include "Loader.h"
+#include "Logger.h"
+#include "Types.h"
+
+namespace Lunar {
+
+// Read-only memory mapping of a whole file.
+struct MappedFile {
+	MappedFile() = default;
+	MappedFile(MappedFile &&other) noexcept;
+	auto operator=(MappedFile &&other) noexcept -> MappedFile &;
+	MappedFile(MappedFile const &) = delete;
+	auto operator=(MappedFile const &) -> MappedFile & = delete;
+	~MappedFile();
+
+	// Empty if the file cannot be opened or is empty.
+	static auto open(std::filesystem::path const &path)
+	    -> std::optional<MappedFile>;
+
+	auto bytes() const -> std::span<std::byte const>
+	{
+		return { m_data, m_size };
+	}
+
+private:
+	auto unmap() -> void;
+
+	std::byte const *m_data { nullptr };
+	size_t m_size { 0 };
+};
+
+// Meshes baked from a glTF file, with vertices and indices stored in their
+// GPU layout in page-aligned blobs. Loading one is a mapping plus a copy into
+// staging; nothing is decoded per vertex.
+//
+// A baked file is only used when its header matches the content hash of the
+// source file and this build's format version and Vertex size. Buffers
+// referenced by a .gltf are not part of the hash, so self-contained .glb
+// files are the ones that should be cached.
+struct BakedMeshes {
+	// Bump whenever the loader changes what it bakes, e.g. Vertex contents.
+	static constexpr uint32_t VERSION { 6 };
+
+	struct LodRecord {
+		uint32_t start_index;
+		uint32_t count;
+		float error;
+		uint32_t meshlet_offset;
+		uint32_t meshlet_count;
+	};
+
+	struct SurfaceRecord {
+		uint32_t base_vertex;
+		uint32_t index_size;
+		float bounds[4];
+		uint32_t lod_count;
+		LodRecord lods[MAX_LODS];
+	};
+
+	// 64-bit hash of the file's contents; empty if it cannot be read.
+	static auto hash_source(std::filesystem::path const &source)
+	    -> std::optional<uint64_t>;
+	// Where the baked copy of `source` lives inside `directory`.
+	static auto path_for(std::filesystem::path const &directory,
+	    std::filesystem::path const &source) -> std::filesystem::path;
+
+	// Maps `path` if it holds meshes baked from a source with `source_hash`.
+	static auto load(Logger &logger, std::filesystem::path const &path,
+	    uint64_t source_hash) -> std::optional<BakedMeshes>;
+	// Bakes `meshes`, whose geometry is `data` (one entry per mesh), to
+	// `path`. The file is replaced atomically.
+	static auto save(Logger &logger, std::filesystem::path const &path,
+	    uint64_t source_hash, std::span<Mesh const> meshes,
+	    std::span<MeshData const> data) -> bool;
+
+	auto mesh_count() const -> size_t { return m_meshes.size(); }
+	auto name(size_t mesh) const -> std::string_view;
+	auto surfaces(size_t mesh) const -> std::span<SurfaceRecord const>;
+	// Points into the mapping; valid while this object lives.
+	auto data(size_t mesh) const -> MeshData;
+	// Dequantization of compact vertex positions, see Mesh.
+	auto position_offset(size_t mesh) const -> smath::Vec3;
+	auto position_scale(size_t mesh) const -> smath::Vec3;
+
+private:
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t source_hash;
+		uint32_t vertex_size;
+		uint32_t mesh_count;
+		uint32_t surface_count;
+		uint32_t names_size;
+		uint64_t vertex_bytes;
+		uint64_t index_bytes;
+		uint64_t meshlet_bytes;
+		uint64_t vertex_offset;
+		uint64_t index_offset;
+		uint64_t meshlet_offset;
+		uint64_t file_size;
+	};
+
+	struct MeshRecord {
+		uint32_t name_offset;
+		uint32_t name_size;
+		uint32_t first_surface;
+		uint32_t surface_count;
+		uint32_t vertex_format;
+		float position_offset[3];
+		float position_scale[3];
+		uint32_t padding;
+		uint64_t first_vertex_byte;
+		uint64_t vertex_bytes;
+		uint64_t first_index_byte;
+		uint64_t index_bytes;
+		uint64_t first_meshlet_byte;
+		uint64_t meshlet_bytes;
+	};
+
+	static constexpr uint32_t MAGIC { 0x48534d4c }; // "LMSH"
+	// Blob alignment; a multiple of the page size on every supported OS.
+	static constexpr uint64_t BLOB_ALIGNMENT { 64 * 1024 };
+
+	MappedFile m_file;
+	std::span<MeshRecord const> m_meshes;
+	std::span<SurfaceRecord const> m_surfaces;
+	std::string_view m_names;
+	std::span<std::byte const> m_vertices;
+	std::span<std::byte const> m_indices;
+	std::span<std::byte const> m_meshlets;
+};
+
+} // namespace Lunar
@@ -0,0 +1,515 @@
+#include "MeshDecoder.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#endif
+
+#include <fastgltf/tools.hpp>
+#include <fastgltf/util.hpp>
+
+namespace fastgltf {
+template<>
+struct ElementTraits<smath::Vec4>
+    : ElementTraitsBase<smath::Vec4, AccessorType::Vec4, float> { };
+template<>
+struct ElementTraits<smath::Vec3>
+    : ElementTraitsBase<smath::Vec3, AccessorType::Vec3, float> { };
+template<>
+struct ElementTraits<smath::Vec2>
+    : ElementTraitsBase<smath::Vec2, AccessorType::Vec2, float> { };
+}
+
+namespace Lunar {
+
+constexpr auto CATEGORY { Logger::Category::Loader };
+
+// Colors are replaced by the normals while there is no material support, to
+// make the shading visible.
+constexpr bool OVERRIDE_COLORS = true;
+
+// Vertices per block in the fast path. Four float scratch arrays of this many
+// vec4s stay well inside L1.
+constexpr size_t BLOCK { 256 };
+
+constexpr Vertex DEFAULT_VERTEX {
+	.position = { 0, 0, 0 },
+	.u = 0,
+	.normal = { 0, 0, 0 },
+	.v = 0,
+	.color = { 1.0f, 1.0f, 1.0f, 1.0f },
+};
+
+// Sphere around the box `min`..`max`, grown to contain every vertex.
+static auto bounding_sphere(std::span<Vertex const> vertices,
+    smath::Vec3 const &min, smath::Vec3 const &max) -> smath::Vec4
+{
+	if (vertices.empty())
+		return { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	smath::Vec3 const center { (min.x() + max.x()) * 0.5f,
+		(min.y() + max.y()) * 0.5f, (min.z() + max.z()) * 0.5f };
+
+	float radius_sq { 0.0f };
+	for (auto const &vtx : vertices) {
+		auto const dx { vtx.position.x() - center.x() };
+		auto const dy { vtx.position.y() - center.y() };
+		auto const dz { vtx.position.z() - center.z() };
+		radius_sq = std::max(radius_sq, dx * dx + dy * dy + dz * dz);
+	}
+
+	return { center.x(), center.y(), center.z(), std::sqrt(radius_sq) };
+}
+
+static auto compute_bounds(std::span<Vertex const> vertices) -> smath::Vec4
+{
+	if (vertices.empty())
+		return { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	auto min { vertices[0].position };
+	auto max { vertices[0].position };
+	for (auto const &vtx : vertices) {
+		auto const &p { vtx.position };
+		min = { std::min(min.x(), p.x()), std::min(min.y(), p.y()),
+			std::min(min.z(), p.z()) };
+		max = { std::max(max.x(), p.x()), std::max(max.y(), p.y()),
+			std::max(max.z(), p.z()) };
+	}
+
+	return bounding_sphere(vertices, min, max);
+}
+
+// Strided view of one accessor's elements inside its buffer.
+struct AttributeStream {
+	std::byte const *data { nullptr };
+	size_t stride { 0 };
+	fastgltf::ComponentType component {};
+	uint32_t components { 0 };
+	// Normalized integers map to [0, 1] or [-1, 1]; everything else is
+	// converted as is.
+	float scale { 1.0f };
+	float min { std::numeric_limits<float>::lowest() };
+};
+
+static auto buffer_bytes(fastgltf::Buffer const &buffer) -> std::byte const *
+{
+	return std::visit(
+	    [](auto const &source) -> std::byte const * {
+		    if constexpr (requires { source.bytes.data(); }) {
+			    return reinterpret_cast<std::byte const *>(
+			        source.bytes.data());
+		    } else {
+			    return nullptr;
+		    }
+	    },
+	    buffer.data);
+}
+
+// Returns an empty stream when the accessor cannot take the fast path:
+// sparse, not backed by loaded bytes, out of range, or of a component type
+// the block decoder does not convert.
+static auto make_stream(fastgltf::Asset const &gltf,
+    fastgltf::Accessor const &accessor, size_t count) -> AttributeStream
+{
+	if (accessor.sparse || !accessor.bufferViewIndex
+	    || accessor.count != count)
+		return {};
+
+	AttributeStream stream {
+		.data = nullptr,
+		.stride = 0,
+		.component = accessor.componentType,
+		.components = static_cast<uint32_t>(
+		    fastgltf::getNumComponents(accessor.type)),
+	};
+
+	auto const normalized_range { [&]() -> float {
+		switch (accessor.componentType) {
+		case fastgltf::ComponentType::Byte:
+			return 127.0f;
+		case fastgltf::ComponentType::UnsignedByte:
+			return 255.0f;
+		case fastgltf::ComponentType::Short:
+			return 32767.0f;
+		case fastgltf::ComponentType::UnsignedShort:
+			return 65535.0f;
+		default:
+			return 0.0f;
+		}
+	}() };
+	if (accessor.componentType != fastgltf::ComponentType::Float
+	    && normalized_range == 0.0f)
+		return {};
+	if (accessor.normalized && normalized_range > 0.0f) {
+		stream.scale = 1.0f / normalized_range;
+		auto const is_signed { accessor.componentType
+			    == fastgltf::ComponentType::Byte
+			|| accessor.componentType == fastgltf::ComponentType::Short };
+		if (is_signed)
+			stream.min = -1.0f;
+	}
+
+	auto const &view { gltf.bufferViews[*accessor.bufferViewIndex] };
+	auto const element_size {
+		fastgltf::getElementByteSize(accessor.type, accessor.componentType)
+	};
+	stream.stride = view.byteStride.value_or(element_size);
+	if (count > 0
+	    && accessor.byteOffset + (count - 1) * stream.stride + element_size
+	        > view.byteLength)
+		return {};
+
+	auto const *bytes { buffer_bytes(gltf.buffers[view.bufferIndex]) };
+	if (bytes == nullptr)
+		return {};
+	stream.data = bytes + view.byteOffset + accessor.byteOffset;
+
+	return stream;
+}
+
+#if defined(__SSE2__)
+// Widens eight 16-bit lanes to floats, then scales and clamps them.
+template<bool Signed>
+static auto widen_16(__m128i words, float *dst, __m128 scale, __m128 min)
+    -> void
+{
+	__m128i lo, hi;
+	if constexpr (Signed) {
+		lo = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+		hi = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+	} else {
+		auto const zero { _mm_setzero_si128() };
+		lo = _mm_unpacklo_epi16(words, zero);
+		hi = _mm_unpackhi_epi16(words, zero);
+	}
+	_mm_storeu_ps(dst, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), scale), min));
+	_mm_storeu_ps(
+	    dst + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), scale), min));
+}
+#endif
+
+// Converts `count` packed integers to `max(value * scale, min)`.
+template<typename T>
+static auto to_float(T const *src, float *dst, size_t count, float scale,
+    float min) -> void
+{
+	size_t i { 0 };
+#if defined(__SSE2__)
+	auto const vscale { _mm_set1_ps(scale) };
+	auto const vmin { _mm_set1_ps(min) };
+	if constexpr (sizeof(T) == 1) {
+		for (; i + 16 <= count; i += 16) {
+			auto const bytes { _mm_loadu_si128(
+				reinterpret_cast<__m128i const *>(src + i)) };
+			if constexpr (std::is_signed_v<T>) {
+				widen_16<true>(
+				    _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8),
+				    dst + i, vscale, vmin);
+				widen_16<true>(
+				    _mm_srai_epi16(_mm_unpackhi_epi8(bytes, bytes), 8),
+				    dst + i + 8, vscale, vmin);
+			} else {
+				auto const zero { _mm_setzero_si128() };
+				widen_16<false>(_mm_unpacklo_epi8(bytes, zero), dst + i,
+				    vscale, vmin);
+				widen_16<false>(_mm_unpackhi_epi8(bytes, zero), dst + i + 8,
+				    vscale, vmin);
+			}
+		}
+	} else if constexpr (sizeof(T) == 2) {
+		for (; i + 8 <= count; i += 8) {
+			auto const words { _mm_loadu_si128(
+				reinterpret_cast<__m128i const *>(src + i)) };
+			widen_16<std::is_signed_v<T>>(words, dst + i, vscale, vmin);
+		}
+	}
+#endif
+	for (; i < count; i++)
+		dst[i] = std::max(static_cast<float>(src[i]) * scale, min);
+}
+
+// Gathers `count` elements starting at `first` into `out` as packed floats.
+template<typename T>
+static auto read_block(AttributeStream const &stream, size_t first,
+    size_t count, float *out) -> void
+{
+	auto const element { stream.components * sizeof(T) };
+	auto const *src { stream.data + first * stream.stride };
+
+	if constexpr (std::is_same_v<T, float>) {
+		if (stream.stride == element) {
+			std::memcpy(out, src, count * element);
+			return;
+		}
+		for (size_t i { 0 }; i < count; i++) {
+			std::memcpy(out + i * stream.components, src + i * stream.stride,
+			    element);
+		}
+	} else {
+		std::array<T, BLOCK * 4> scratch;
+		if (stream.stride == element) {
+			std::memcpy(scratch.data(), src, count * element);
+		} else {
+			for (size_t i { 0 }; i < count; i++) {
+				std::memcpy(scratch.data() + i * stream.components,
+				    src + i * stream.stride, element);
+			}
+		}
+		to_float(scratch.data(), out, count * stream.components, stream.scale,
+		    stream.min);
+	}
+}
+
+static auto read_block(AttributeStream const &stream, size_t first,
+    size_t count, float *out) -> void
+{
+	switch (stream.component) {
+	case fastgltf::ComponentType::Byte:
+		return read_block<int8_t>(stream, first, count, out);
+	case fastgltf::ComponentType::UnsignedByte:
+		return read_block<uint8_t>(stream, first, count, out);
+	case fastgltf::ComponentType::Short:
+		return read_block<int16_t>(stream, first, count, out);
+	case fastgltf::ComponentType::UnsignedShort:
+		return read_block<uint16_t>(stream, first, count, out);
+	case fastgltf::ComponentType::Float:
+		return read_block<float>(stream, first, count, out);
+	default:
+		std::unreachable();
+	}
+}
+
+template<typename T>
+static auto rebase_indices(
+    std::byte const *src, std::span<uint32_t> dst, uint32_t base_vertex)
+    -> void
+{
+	for (size_t i { 0 }; i < dst.size(); i++) {
+		T index;
+		std::memcpy(&index, src + i * sizeof(T), sizeof(T));
+		dst[i] = static_cast<uint32_t>(index) + base_vertex;
+	}
+}
+
+// Returns false if the accessor needs the generic path.
+static auto decode_indices(fastgltf::Asset const &gltf,
+    fastgltf::Accessor const &accessor, std::span<uint32_t> indices,
+    uint32_t base_vertex) -> bool
+{
+	if (accessor.sparse || !accessor.bufferViewIndex
+	    || accessor.count != indices.size())
+		return false;
+
+	auto const &view { gltf.bufferViews[*accessor.bufferViewIndex] };
+	auto const element_size {
+		fastgltf::getElementByteSize(accessor.type, accessor.componentType)
+	};
+	// Index data is always tightly packed.
+	if (view.byteStride.value_or(element_size) != element_size
+	    || accessor.byteOffset + indices.size() * element_size
+	        > view.byteLength)
+		return false;
+
+	auto const *bytes { buffer_bytes(gltf.buffers[view.bufferIndex]) };
+	if (bytes == nullptr)
+		return false;
+	auto const *src { bytes + view.byteOffset + accessor.byteOffset };
+
+	switch (accessor.componentType) {
+	case fastgltf::ComponentType::UnsignedByte:
+		rebase_indices<uint8_t>(src, indices, base_vertex);
+		return true;
+	case fastgltf::ComponentType::UnsignedShort:
+		rebase_indices<uint16_t>(src, indices, base_vertex);
+		return true;
+	case fastgltf::ComponentType::UnsignedInt:
+		rebase_indices<uint32_t>(src, indices, base_vertex);
+		return true;
+	default:
+		return false;
+	}
+}
+
+auto decode_primitive(fastgltf::Asset const &gltf,
+    fastgltf::Primitive const &primitive, uint32_t base_vertex,
+    std::span<Vertex> vertices, std::span<uint32_t> indices, Logger &logger)
+    -> smath::Vec4
+{
+	auto const generic { [&]() {
+		return decode_primitive_generic(
+		    gltf, primitive, base_vertex, vertices, indices, logger);
+	} };
+
+	// Absent attributes stay empty; present ones that cannot take the fast
+	// path send the whole primitive down the generic one.
+	bool fast { true };
+	auto const stream { [&](std::string_view name,
+		                    std::initializer_list<fastgltf::AccessorType>
+		                        types) -> AttributeStream {
+		auto const it { primitive.findAttribute(name) };
+		if (it == primitive.attributes.end())
+			return {};
+
+		auto const &accessor { gltf.accessors[it->accessorIndex] };
+		auto const result { make_stream(gltf, accessor, vertices.size()) };
+		if (result.data == nullptr
+		    || std::ranges::find(types, accessor.type) == types.end())
+			fast = false;
+		return result;
+	} };
+
+	auto const position { stream(
+		"POSITION", { fastgltf::AccessorType::Vec3 }) };
+	auto const normal { stream("NORMAL", { fastgltf::AccessorType::Vec3 }) };
+	auto const uv { stream("TEXCOORD_0", { fastgltf::AccessorType::Vec2 }) };
+	auto const color { stream("COLOR_0",
+		{ fastgltf::AccessorType::Vec3, fastgltf::AccessorType::Vec4 }) };
+	if (!fast || position.data == nullptr)
+		return generic();
+
+	if (!decode_indices(gltf, gltf.accessors[primitive.indicesAccessor.value()],
+	        indices, base_vertex))
+		return generic();
+
+	std::array<float, BLOCK * 3> positions;
+	std::array<float, BLOCK * 3> normals;
+	std::array<float, BLOCK * 2> uvs;
+	std::array<float, BLOCK * 4> colors;
+
+	smath::Vec3 min { std::numeric_limits<float>::max(),
+		std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	smath::Vec3 max { std::numeric_limits<float>::lowest(),
+		std::numeric_limits<float>::lowest(),
+		std::numeric_limits<float>::lowest() };
+
+	for (size_t first { 0 }; first < vertices.size(); first += BLOCK) {
+		auto const count { std::min(BLOCK, vertices.size() - first) };
+
+		read_block(position, first, count, positions.data());
+		if (normal.data)
+			read_block(normal, first, count, normals.data());
+		if (uv.data)
+			read_block(uv, first, count, uvs.data());
+		if (color.data)
+			read_block(color, first, count, colors.data());
+
+		for (size_t i { 0 }; i < count; i++) {
+			auto vertex { DEFAULT_VERTEX };
+
+			auto const *p { &positions[i * 3] };
+			vertex.position = { p[0], p[1], p[2] };
+			min = { std::min(min.x(), p[0]), std::min(min.y(), p[1]),
+				std::min(min.z(), p[2]) };
+			max = { std::max(max.x(), p[0]), std::max(max.y(), p[1]),
+				std::max(max.z(), p[2]) };
+
+			if (normal.data) {
+				auto const *n { &normals[i * 3] };
+				vertex.normal = { n[0], n[1], n[2] };
+			}
+			if (uv.data) {
+				vertex.u = uvs[i * 2];
+				vertex.v = uvs[i * 2 + 1];
+			}
+			if (color.data) {
+				auto const *c { &colors[i * color.components] };
+				vertex.color = { c[0], c[1], c[2],
+					color.components == 4 ? c[3] : 1.0f };
+			}
+			if (OVERRIDE_COLORS)
+				vertex.color = smath::Vec4(vertex.normal, 1.f);
+
+			vertices[first + i] = vertex;
+		}
+	}
+
+	return bounding_sphere(vertices, min, max);
+}
+
+auto decode_primitive_generic(fastgltf::Asset const &gltf,
+    fastgltf::Primitive const &primitive, uint32_t base_vertex,
+    std::span<Vertex> vertices, std::span<uint32_t> indices, Logger &logger)
+    -> smath::Vec4
+{
+	fastgltf::copyFromAccessor<uint32_t>(gltf,
+	    gltf.accessors[primitive.indicesAccessor.value()], indices.data());
+	for (auto &index : indices)
+		index += base_vertex;
+
+	std::ranges::fill(vertices, DEFAULT_VERTEX);
+
+	auto const attribute { [&](std::string_view name)
+		                       -> fastgltf::Accessor const * {
+		auto const it { primitive.findAttribute(name) };
+		if (it == primitive.attributes.end())
+			return nullptr;
+
+		auto const &accessor { gltf.accessors[it->accessorIndex] };
+		if (accessor.count != vertices.size()) {
+			logger.warn(CATEGORY,
+			    "Ignoring {} with {} elements for {} vertices", name,
+			    accessor.count, vertices.size());
+			return nullptr;
+		}
+		return &accessor;
+	} };
+
+	if (auto const accessor { attribute("POSITION") }) {
+		fastgltf::iterateAccessorWithIndex<smath::Vec3>(
+		    gltf, *accessor, [&](smath::Vec3 position, size_t i) {
+			    vertices[i].position = position;
+		    });
+	}
+
+	if (auto const accessor { attribute("NORMAL") }) {
+		fastgltf::iterateAccessorWithIndex<smath::Vec3>(gltf, *accessor,
+		    [&](smath::Vec3 normal, size_t i) { vertices[i].normal = normal; });
+	}
+
+	if (auto const accessor { attribute("TEXCOORD_0") }) {
+		fastgltf::iterateAccessorWithIndex<smath::Vec2>(
+		    gltf, *accessor, [&](smath::Vec2 uv, size_t i) {
+			    uv.unpack(vertices[i].u, vertices[i].v);
+		    });
+	}
+
+	if (auto const accessor { attribute("COLOR_0") }) {
+		switch (accessor->type) {
+		case fastgltf::AccessorType::Vec3:
+			fastgltf::iterateAccessorWithIndex<smath::Vec3>(
+			    gltf, *accessor, [&](smath::Vec3 c3, size_t i) {
+				    vertices[i].color = { c3.x(), c3.y(), c3.z(), 1.0f };
+			    });
+			break;
+		case fastgltf::AccessorType::Vec4:
+			fastgltf::iterateAccessorWithIndex<smath::Vec4>(gltf, *accessor,
+			    [&](smath::Vec4 c4, size_t i) { vertices[i].color = c4; });
+			break;
+		default:
+			logger.warn(CATEGORY, "Unsupported COLOR_0 accessor type ({})",
+			    static_cast<int>(accessor->type));
+			break;
+		}
+	}
+
+	auto const bounds { compute_bounds(vertices) };
+
+	if (OVERRIDE_COLORS) {
+		for (auto &vtx : vertices) {
+			vtx.color = smath::Vec4(vtx.normal, 1.f);
+		}
+	}
+
+	return bounds;
+}
+
+} // namespace Lunar
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <fastgltf/types.hpp>
+#include <smath.hpp>
+
+#include "Logger.h"
+#include "Types.h"
+
+namespace Lunar {
+
+// Decodes one glTF primitive into preallocated ranges and returns its
+// object-space bounding sphere (xyz center, w radius). `vertices` and
+// `indices` must be sized from the POSITION and index accessor counts;
+// indices are rebased by `base_vertex`. Disjoint ranges may be decoded
+// concurrently.
+//
+// Vertices are decoded in small blocks: each attribute of a block is
+// converted to floats in scratch space (with SIMD for normalized and
+// quantized integer data), then every Vertex of the block is written once.
+// Anything the fast path does not handle falls back to
+// decode_primitive_generic().
+auto decode_primitive(fastgltf::Asset const &gltf,
+    fastgltf::Primitive const &primitive, uint32_t base_vertex,
+    std::span<Vertex> vertices, std::span<uint32_t> indices, Logger &logger)
+    -> smath::Vec4;
+
+// One pass per attribute through fastgltf's accessor iteration. Handles any
+// accessor, including sparse ones; also the baseline for the loader
+// benchmark.
+auto decode_primitive_generic(fastgltf::Asset const &gltf,
+    fastgltf::Primitive const &primitive, uint32_t base_vertex,
+    std::span<Vertex> vertices, std::span<uint32_t> indices, Logger &logger)
+    -> smath::Vec4;
+
+} // namespace Lunar
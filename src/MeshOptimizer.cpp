@@ -0,0 +1,511 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "Util.h"
+
+namespace Lunar {
+
+static_assert(sizeof(Vertex) == 48, "Vertex must not contain padding");
+
+// Post-transform cache sizes. The simulated FIFO for the overdraw clusters
+// matches average_cache_miss_ratio(); the LRU that drives the triangle
+// scoring is larger, as in Forsyth's reference.
+constexpr uint32_t FIFO_CACHE_SIZE { 16 };
+constexpr uint32_t LRU_CACHE_SIZE { 32 };
+
+// Fewer triangles than this are never split off as their own overdraw
+// cluster; smaller clusters cost more cache misses than sorting them saves.
+constexpr size_t MIN_CLUSTER_TRIANGLES { 32 };
+
+auto average_cache_miss_ratio(std::span<uint32_t const> indices,
+    size_t vertex_count, uint32_t cache_size) -> float
+{
+	if (indices.size() < 3)
+		return 0.0f;
+
+	// A vertex is still cached while fewer than `cache_size` misses happened
+	// since it was loaded.
+	std::vector<uint32_t> cached_at(vertex_count, 0);
+	uint32_t timestamp { cache_size + 1 };
+	size_t misses { 0 };
+	for (auto const index : indices) {
+		if (timestamp - cached_at[index] > cache_size) {
+			cached_at[index] = timestamp++;
+			misses++;
+		}
+	}
+	return static_cast<float>(misses)
+	    / static_cast<float>(indices.size() / 3);
+}
+
+static auto hash_vertex(Vertex const &vertex) -> uint64_t
+{
+	auto const hash { fnv1a(
+		{ reinterpret_cast<uint8_t const *>(&vertex), sizeof(Vertex) }) };
+	return hash ^ (hash >> 32);
+}
+
+auto weld_vertices(std::span<Vertex> vertices, std::span<uint32_t> indices)
+    -> size_t
+{
+	// Open addressing over unique vertex indices. Unique vertices are moved
+	// to the front as they are found, so a slot only ever refers to a vertex
+	// that will not be overwritten again.
+	size_t capacity { 1 };
+	while (capacity < vertices.size() * 2)
+		capacity *= 2;
+	std::vector<uint32_t> table(capacity, ~0u);
+	std::vector<uint32_t> remap(vertices.size());
+
+	size_t unique { 0 };
+	for (size_t v { 0 }; v < vertices.size(); v++) {
+		auto slot { hash_vertex(vertices[v]) & (capacity - 1) };
+		while (table[slot] != ~0u
+		    && std::memcmp(&vertices[table[slot]], &vertices[v], sizeof(Vertex))
+		        != 0)
+			slot = (slot + 1) & (capacity - 1);
+
+		if (table[slot] == ~0u) {
+			table[slot] = static_cast<uint32_t>(unique);
+			vertices[unique++] = vertices[v];
+		}
+		remap[v] = table[slot];
+	}
+
+	for (auto &index : indices)
+		index = remap[index];
+	return unique;
+}
+
+static auto forsyth_score(int32_t cache_position, uint32_t live_triangles)
+    -> float
+{
+	if (live_triangles == 0)
+		return -1.0f;
+
+	float score { 0.0f };
+	if (cache_position >= 0) {
+		// The last triangle's vertices get a fixed score so that the next
+		// triangle does not simply reuse the same edge.
+		if (cache_position < 3) {
+			score = 0.75f;
+		} else {
+			auto const scale { 1.0f
+				/ static_cast<float>(LRU_CACHE_SIZE - 3) };
+			score = std::pow(
+			    1.0f - static_cast<float>(cache_position - 3) * scale, 1.5f);
+		}
+	}
+	// Favour vertices with few triangles left, to finish them off.
+	score += 2.0f / std::sqrt(static_cast<float>(live_triangles));
+	return score;
+}
+
+auto optimize_vertex_cache(std::span<uint32_t> indices, size_t vertex_count)
+    -> void
+{
+	auto const triangle_count { indices.size() / 3 };
+	if (triangle_count < 2)
+		return;
+
+	// Triangles adjacent to each vertex; the first `live[v]` entries of a
+	// vertex's list are the ones not emitted yet.
+	std::vector<uint32_t> live(vertex_count, 0);
+	for (auto const index : indices)
+		live[index]++;
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (size_t v { 0 }; v < vertex_count; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i { 0 }; i < indices.size(); i++)
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<int32_t> cache_position(vertex_count, -1);
+	std::vector<float> vertex_scores(vertex_count);
+	for (size_t v { 0 }; v < vertex_count; v++)
+		vertex_scores[v] = forsyth_score(-1, live[v]);
+
+	auto const triangle_score { [&](size_t t) {
+		return vertex_scores[indices[t * 3]]
+		    + vertex_scores[indices[t * 3 + 1]]
+		    + vertex_scores[indices[t * 3 + 2]];
+	} };
+	std::vector<float> triangle_scores(triangle_count);
+	for (size_t t { 0 }; t < triangle_count; t++)
+		triangle_scores[t] = triangle_score(t);
+
+	constexpr auto NONE { std::numeric_limits<size_t>::max() };
+	auto best { static_cast<size_t>(
+		std::ranges::max_element(triangle_scores) - triangle_scores.begin()) };
+
+	std::vector<uint8_t> emitted(triangle_count, 0);
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	std::array<uint32_t, LRU_CACHE_SIZE + 3> cache;
+	std::array<uint32_t, LRU_CACHE_SIZE + 3> new_cache;
+	size_t cache_count { 0 };
+	size_t cursor { 0 };
+
+	for (size_t n { 0 }; n < triangle_count; n++) {
+		// Nothing in the cache has triangles left: continue with the first
+		// remaining triangle in input order.
+		if (best == NONE) {
+			while (emitted[cursor])
+				cursor++;
+			best = cursor;
+		}
+
+		auto const triangle { best };
+		emitted[triangle] = 1;
+		std::array<uint32_t, 3> const corners { indices[triangle * 3],
+			indices[triangle * 3 + 1], indices[triangle * 3 + 2] };
+		output.insert(output.end(), corners.begin(), corners.end());
+
+		for (auto const v : corners) {
+			auto const begin { adjacency.begin() + offsets[v] };
+			auto const end { begin + live[v] };
+			std::iter_swap(std::find(begin, end, triangle), end - 1);
+			live[v]--;
+		}
+
+		// Move the triangle's vertices to the front of the LRU cache.
+		size_t new_count { 0 };
+		for (auto const v : corners)
+			new_cache[new_count++] = v;
+		for (size_t i { 0 }; i < cache_count; i++) {
+			auto const v { cache[i] };
+			if (v != corners[0] && v != corners[1] && v != corners[2])
+				new_cache[new_count++] = v;
+		}
+
+		for (size_t i { 0 }; i < new_count; i++) {
+			auto const v { new_cache[i] };
+			cache_position[v]
+			    = i < LRU_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+			vertex_scores[v] = forsyth_score(cache_position[v], live[v]);
+		}
+
+		// Only triangles touching the cache changed score, and the next one
+		// is picked among them.
+		best = NONE;
+		float best_score { -1.0f };
+		for (size_t i { 0 }; i < new_count; i++) {
+			auto const v { new_cache[i] };
+			for (size_t a { offsets[v] }; a < offsets[v] + live[v]; a++) {
+				auto const t { adjacency[a] };
+				triangle_scores[t] = triangle_score(t);
+				if (i < LRU_CACHE_SIZE && triangle_scores[t] > best_score) {
+					best_score = triangle_scores[t];
+					best = t;
+				}
+			}
+		}
+
+		cache_count = std::min<size_t>(new_count, LRU_CACHE_SIZE);
+		std::copy_n(new_cache.begin(), cache_count, cache.begin());
+	}
+
+	std::ranges::copy(output, indices.begin());
+}
+
+auto optimize_overdraw(std::span<uint32_t> indices,
+    std::span<Vertex const> vertices, float threshold) -> void
+{
+	auto const triangle_count { indices.size() / 3 };
+	if (triangle_count < MIN_CLUSTER_TRIANGLES * 2)
+		return;
+
+	std::vector<uint8_t> misses(triangle_count);
+	{
+		std::vector<uint32_t> cached_at(vertices.size(), 0);
+		uint32_t timestamp { FIFO_CACHE_SIZE + 1 };
+		for (size_t t { 0 }; t < triangle_count; t++) {
+			for (size_t k { 0 }; k < 3; k++) {
+				auto const v { indices[t * 3 + k] };
+				if (timestamp - cached_at[v] > FIFO_CACHE_SIZE) {
+					cached_at[v] = timestamp++;
+					misses[t]++;
+				}
+			}
+		}
+	}
+
+	// Triangles that miss on every vertex start from a cold cache anyway,
+	// so cutting there is free. Longer runs are additionally cut where the
+	// run so far is no worse than `threshold` times the whole run.
+	std::vector<size_t> clusters;
+	for (size_t start { 0 }; start < triangle_count;) {
+		auto end { start + 1 };
+		while (end < triangle_count && misses[end] != 3)
+			end++;
+
+		size_t total { 0 };
+		for (auto t { start }; t < end; t++)
+			total += misses[t];
+		auto const target { static_cast<float>(total)
+			/ static_cast<float>(end - start) * threshold };
+
+		auto cluster { start };
+		size_t run_misses { 0 };
+		clusters.emplace_back(cluster);
+		for (auto t { start }; t + 1 < end; t++) {
+			run_misses += misses[t];
+			auto const size { t + 1 - cluster };
+			if (size >= MIN_CLUSTER_TRIANGLES
+			    && end - (t + 1) >= MIN_CLUSTER_TRIANGLES
+			    && static_cast<float>(run_misses) / static_cast<float>(size)
+			        <= target) {
+				cluster = t + 1;
+				run_misses = 0;
+				clusters.emplace_back(cluster);
+			}
+		}
+		start = end;
+	}
+	if (clusters.size() < 2)
+		return;
+
+	// Area-weighted centroid and normal of every cluster.
+	struct Cluster {
+		size_t begin;
+		size_t end;
+		std::array<float, 3> centroid;
+		std::array<float, 3> normal;
+		float area;
+		float key;
+	};
+	std::vector<Cluster> sorted;
+	sorted.reserve(clusters.size());
+	std::array<float, 3> mesh_centroid { 0.0f, 0.0f, 0.0f };
+	float mesh_area { 0.0f };
+	for (size_t c { 0 }; c < clusters.size(); c++) {
+		Cluster cluster {
+			.begin = clusters[c],
+			.end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count,
+			.centroid = { 0.0f, 0.0f, 0.0f },
+			.normal = { 0.0f, 0.0f, 0.0f },
+			.area = 0.0f,
+			.key = 0.0f,
+		};
+		for (auto t { cluster.begin }; t < cluster.end; t++) {
+			auto const &a { vertices[indices[t * 3]].position };
+			auto const &b { vertices[indices[t * 3 + 1]].position };
+			auto const &p { vertices[indices[t * 3 + 2]].position };
+			std::array<float, 3> const ab { b.x() - a.x(), b.y() - a.y(),
+				b.z() - a.z() };
+			std::array<float, 3> const ac { p.x() - a.x(), p.y() - a.y(),
+				p.z() - a.z() };
+			std::array<float, 3> const normal { ab[1] * ac[2] - ab[2] * ac[1],
+				ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+			auto const area { std::sqrt(normal[0] * normal[0]
+				+ normal[1] * normal[1] + normal[2] * normal[2]) };
+			std::array<float, 3> const center { a.x() + b.x() + p.x(),
+				a.y() + b.y() + p.y(), a.z() + b.z() + p.z() };
+			for (size_t k { 0 }; k < 3; k++) {
+				cluster.normal[k] += normal[k];
+				cluster.centroid[k] += center[k] / 3.0f * area;
+			}
+			cluster.area += area;
+		}
+		for (size_t k { 0 }; k < 3; k++) {
+			mesh_centroid[k] += cluster.centroid[k];
+			if (cluster.area > 0.0f)
+				cluster.centroid[k] /= cluster.area;
+		}
+		mesh_area += cluster.area;
+		sorted.emplace_back(cluster);
+	}
+	if (mesh_area > 0.0f) {
+		for (auto &value : mesh_centroid)
+			value /= mesh_area;
+	}
+
+	for (auto &cluster : sorted) {
+		auto const length { std::sqrt(cluster.normal[0] * cluster.normal[0]
+			+ cluster.normal[1] * cluster.normal[1]
+			+ cluster.normal[2] * cluster.normal[2]) };
+		if (length == 0.0f)
+			continue;
+		for (size_t k { 0 }; k < 3; k++) {
+			cluster.key += (cluster.centroid[k] - mesh_centroid[k])
+			    * cluster.normal[k] / length;
+		}
+	}
+	std::ranges::stable_sort(
+	    sorted, [](auto const &a, auto const &b) { return a.key > b.key; });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (auto const &cluster : sorted) {
+		output.insert(output.end(), indices.begin() + cluster.begin * 3,
+		    indices.begin() + cluster.end * 3);
+	}
+	std::ranges::copy(output, indices.begin());
+}
+
+auto optimize_vertex_fetch(std::span<Vertex> vertices,
+    std::span<uint32_t> indices) -> size_t
+{
+	std::vector<uint32_t> remap(vertices.size(), ~0u);
+	std::vector<Vertex> fetched;
+	fetched.reserve(vertices.size());
+	for (auto &index : indices) {
+		if (remap[index] == ~0u) {
+			remap[index] = static_cast<uint32_t>(fetched.size());
+			fetched.emplace_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	std::ranges::copy(fetched, vertices.begin());
+	return fetched.size();
+}
+
+auto optimize_mesh(std::span<Vertex> vertices, std::span<uint32_t> indices)
+    -> size_t
+{
+	auto const unique { weld_vertices(vertices, indices) };
+	optimize_vertex_cache(indices, unique);
+	optimize_overdraw(indices, vertices.first(unique));
+	return optimize_vertex_fetch(vertices.first(unique), indices);
+}
+
+auto position_quantization(std::span<Vertex const> vertices)
+    -> PositionQuantization
+{
+	if (vertices.empty())
+		return { { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f } };
+
+	auto min { vertices[0].position };
+	auto max { vertices[0].position };
+	for (auto const &vertex : vertices) {
+		auto const &p { vertex.position };
+		min = { std::min(min.x(), p.x()), std::min(min.y(), p.y()),
+			std::min(min.z(), p.z()) };
+		max = { std::max(max.x(), p.x()), std::max(max.y(), p.y()),
+			std::max(max.z(), p.z()) };
+	}
+	return { min,
+		{ max.x() - min.x(), max.y() - min.y(), max.z() - min.z() } };
+}
+
+static auto to_unorm16(float value) -> uint16_t
+{
+	return static_cast<uint16_t>(
+	    std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+static auto to_snorm16(float value) -> int16_t
+{
+	return static_cast<int16_t>(
+	    std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+static auto to_unorm8(float value) -> uint8_t
+{
+	return static_cast<uint8_t>(
+	    std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+// IEEE binary16 with round to nearest even, as unpackHalf2x16 expects.
+static auto to_half(float value) -> uint16_t
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	auto const sign { (bits >> 16) & 0x8000u };
+	auto const float_exponent { static_cast<int32_t>((bits >> 23) & 0xffu) };
+	auto mantissa { bits & 0x7fffffu };
+
+	if (float_exponent == 0xff) // Infinity or NaN.
+		return static_cast<uint16_t>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+
+	auto const exponent { float_exponent - 127 + 15 };
+	if (exponent >= 31)
+		return static_cast<uint16_t>(sign | 0x7c00u);
+	if (exponent <= 0) {
+		if (exponent < -10)
+			return static_cast<uint16_t>(sign);
+		// Subnormal: shift the full significand down into 10 bits.
+		mantissa |= 0x800000u;
+		auto const shift { static_cast<uint32_t>(14 - exponent) };
+		auto half { mantissa >> shift };
+		auto const rest { mantissa & ((1u << shift) - 1) };
+		auto const halfway { 1u << (shift - 1) };
+		if (rest > halfway || (rest == halfway && (half & 1u)))
+			half++;
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	auto half { sign | (static_cast<uint32_t>(exponent) << 10)
+		| (mantissa >> 13) };
+	auto const rest { mantissa & 0x1fffu };
+	// A carry out of the mantissa correctly bumps the exponent.
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+		half++;
+	return static_cast<uint16_t>(half);
+}
+
+// Octahedral encoding: the unit sphere projected onto an octahedron, whose
+// lower half is folded over the upper one.
+static auto encode_normal(smath::Vec3 const &normal) -> std::array<int16_t, 2>
+{
+	auto const length { std::abs(normal.x()) + std::abs(normal.y())
+		+ std::abs(normal.z()) };
+	if (length == 0.0f)
+		return { 0, 0 };
+
+	auto x { normal.x() / length };
+	auto y { normal.y() / length };
+	if (normal.z() < 0.0f) {
+		auto const folded_x { (1.0f - std::abs(y)) * std::copysign(1.0f, x) };
+		auto const folded_y { (1.0f - std::abs(x)) * std::copysign(1.0f, y) };
+		x = folded_x;
+		y = folded_y;
+	}
+	return { to_snorm16(x), to_snorm16(y) };
+}
+
+auto compact_vertices(std::span<Vertex const> vertices,
+    PositionQuantization const &quantization, std::span<CompactVertex> out)
+    -> void
+{
+	auto const inverse { [](float scale) {
+		return scale > 0.0f ? 1.0f / scale : 0.0f;
+	} };
+	std::array<float, 3> const offset { quantization.offset.x(),
+		quantization.offset.y(), quantization.offset.z() };
+	std::array<float, 3> const inverse_scale { inverse(quantization.scale.x()),
+		inverse(quantization.scale.y()), inverse(quantization.scale.z()) };
+
+	for (size_t i { 0 }; i < vertices.size(); i++) {
+		auto const &vertex { vertices[i] };
+		std::array<float, 3> const position { vertex.position.x(),
+			vertex.position.y(), vertex.position.z() };
+		auto const normal { encode_normal(vertex.normal) };
+
+		CompactVertex compact {};
+		for (size_t k { 0 }; k < 3; k++) {
+			compact.position[k] = to_unorm16(
+			    (position[k] - offset[k]) * inverse_scale[k]);
+		}
+		compact.normal[0] = normal[0];
+		compact.normal[1] = normal[1];
+		compact.uv[0] = to_half(vertex.u);
+		compact.uv[1] = to_half(vertex.v);
+		compact.color[0] = to_unorm8(vertex.color.x());
+		compact.color[1] = to_unorm8(vertex.color.y());
+		compact.color[2] = to_unorm8(vertex.color.z());
+		compact.color[3] = to_unorm8(vertex.color.w());
+		out[i] = compact;
+	}
+}
+
+} // namespace Lunar
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "Types.h"
+
+namespace Lunar {
+
+// Passes over one indexed triangle list whose indices refer to `vertices`.
+// They follow the usual order: weld, vertex cache, overdraw, vertex fetch;
+// optimize_mesh() runs all of them.
+
+// Transformed vertices per triangle with a FIFO post-transform cache of
+// `cache_size` entries: 3 is the worst case, ~0.5 the best a regular grid
+// reaches.
+auto average_cache_miss_ratio(std::span<uint32_t const> indices,
+    size_t vertex_count, uint32_t cache_size = 16) -> float;
+
+// Merges bitwise identical vertices and moves the unique ones to the front,
+// in order of first appearance. Returns how many there are.
+auto weld_vertices(std::span<Vertex> vertices, std::span<uint32_t> indices)
+    -> size_t;
+
+// Reorders triangles to maximize post-transform cache hits, after Forsyth's
+// linear-speed vertex cache optimization.
+auto optimize_vertex_cache(std::span<uint32_t> indices, size_t vertex_count)
+    -> void;
+
+// Splits the cache-optimized triangle order into clusters and sorts them so
+// outward-facing clusters far from the center draw first, which lets depth
+// testing reject more of what lies behind them. Splits are only made where
+// the cluster's miss ratio stays within `threshold` of the input's.
+auto optimize_overdraw(std::span<uint32_t> indices,
+    std::span<Vertex const> vertices, float threshold = 1.05f) -> void;
+
+// Renumbers vertices in order of first use and drops unreferenced ones.
+// Returns the new vertex count.
+auto optimize_vertex_fetch(std::span<Vertex> vertices,
+    std::span<uint32_t> indices) -> size_t;
+
+// All of the above. Returns the new vertex count; the vertices live at the
+// front of `vertices`.
+auto optimize_mesh(std::span<Vertex> vertices, std::span<uint32_t> indices)
+    -> size_t;
+
+// Maps compact unorm16 positions onto a bounding box:
+// position = offset + unorm * scale.
+struct PositionQuantization {
+	smath::Vec3 offset;
+	smath::Vec3 scale;
+};
+
+// The bounding box of `vertices`.
+auto position_quantization(std::span<Vertex const> vertices)
+    -> PositionQuantization;
+
+// Encodes `vertices` into `out`, which must be as large.
+auto compact_vertices(std::span<Vertex const> vertices,
+    PositionQuantization const &quantization, std::span<CompactVertex> out)
+    -> void;
+
+} // namespace Lunar
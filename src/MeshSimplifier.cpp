@@ -0,0 +1,354 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace Lunar {
+
+// Levels below this many triangles are not worth their own index range.
+constexpr size_t MIN_LOD_TRIANGLES { 64 };
+// A level must have at most this share of its predecessor's triangles.
+constexpr float MAX_LOD_RATIO { 0.75f };
+// Triangles around a collapse may not turn further than ~75 degrees.
+constexpr double MIN_NORMAL_COSINE { 0.25 };
+
+using Double3 = std::array<double, 3>;
+
+// Symmetric 4x4 matrix summing squared distances to planes, weighted by
+// triangle area: a00 a01 a02 a03 a11 a12 a13 a22 a23 a33, then the total
+// weight so costs come out as squared distances.
+using Quadric = std::array<double, 11>;
+
+static auto subtract(Double3 const &a, Double3 const &b) -> Double3
+{
+	return { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+}
+
+static auto dot(Double3 const &a, Double3 const &b) -> double
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static auto cross(Double3 const &a, Double3 const &b) -> Double3
+{
+	return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+		a[0] * b[1] - a[1] * b[0] };
+}
+
+static auto plane_quadric(Double3 const &a, Double3 const &b,
+    Double3 const &c) -> Quadric
+{
+	auto const normal { cross(subtract(b, a), subtract(c, a)) };
+	auto const length { std::sqrt(dot(normal, normal)) };
+	if (length == 0.0)
+		return {};
+
+	// Twice the area, which only scales every cost alike.
+	auto const weight { length };
+	auto const x { normal[0] / length };
+	auto const y { normal[1] / length };
+	auto const z { normal[2] / length };
+	auto const d { -dot({ x, y, z }, a) };
+	return {
+		weight * x * x,
+		weight * x * y,
+		weight * x * z,
+		weight * x * d,
+		weight * y * y,
+		weight * y * z,
+		weight * y * d,
+		weight * z * z,
+		weight * z * d,
+		weight * d * d,
+		weight,
+	};
+}
+
+static auto add(Quadric &q, Quadric const &other) -> void
+{
+	for (size_t i { 0 }; i < q.size(); i++)
+		q[i] += other[i];
+}
+
+// Mean squared distance of `p` to the planes in `q`.
+static auto evaluate(Quadric const &q, Double3 const &p) -> double
+{
+	if (q[10] == 0.0)
+		return 0.0;
+	auto const x { p[0] };
+	auto const y { p[1] };
+	auto const z { p[2] };
+	auto const sum { q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z
+		+ 2.0 * q[3] * x + q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y
+		+ q[7] * z * z + 2.0 * q[8] * z + q[9] };
+	return std::max(sum, 0.0) / q[10];
+}
+
+auto build_lods(std::span<uint32_t const> indices,
+    std::span<Vertex const> vertices, size_t max_levels)
+    -> std::vector<SimplifiedLod>
+{
+	std::vector<SimplifiedLod> lods;
+	if (max_levels == 0 || indices.size() / 3 < MIN_LOD_TRIANGLES * 2)
+		return lods;
+
+	// Vertices at the same position form one group, which collapses as a
+	// whole; its members differ only in attributes.
+	std::vector<uint32_t> order(vertices.size());
+	for (uint32_t v { 0 }; v < order.size(); v++)
+		order[v] = v;
+	auto const key { [&](uint32_t v) {
+		auto const &p { vertices[v].position };
+		return std::array { p.x(), p.y(), p.z() };
+	} };
+	std::ranges::sort(
+	    order, [&](uint32_t a, uint32_t b) { return key(a) < key(b); });
+
+	std::vector<uint32_t> group(vertices.size());
+	std::vector<Double3> positions;
+	for (size_t i { 0 }; i < order.size(); i++) {
+		if (i == 0 || key(order[i]) != key(order[i - 1])) {
+			auto const &p { vertices[order[i]].position };
+			positions.push_back({ p.x(), p.y(), p.z() });
+		}
+		group[order[i]] = static_cast<uint32_t>(positions.size() - 1);
+	}
+	auto const group_count { positions.size() };
+
+	std::vector<uint32_t> triangles(indices.begin(), indices.end());
+	auto triangle_count { triangles.size() / 3 };
+	auto const corner_group { [&](size_t t, size_t k) {
+		return group[triangles[t * 3 + k]];
+	} };
+	auto const degenerate { [&](size_t t) {
+		auto const a { corner_group(t, 0) };
+		auto const b { corner_group(t, 1) };
+		auto const c { corner_group(t, 2) };
+		return a == b || b == c || c == a;
+	} };
+
+	std::vector<Quadric> quadrics(group_count, Quadric {});
+	for (size_t t { 0 }; t < triangle_count; t++) {
+		auto const q { plane_quadric(positions[corner_group(t, 0)],
+			positions[corner_group(t, 1)], positions[corner_group(t, 2)]) };
+		for (size_t k { 0 }; k < 3; k++)
+			add(quadrics[corner_group(t, k)], q);
+	}
+
+	// Edges used by exactly one triangle lie on an open border, and more
+	// than two make the surface non-manifold; either way their ends stay.
+	std::vector<bool> locked(group_count, false);
+	{
+		std::vector<uint64_t> edges;
+		edges.reserve(triangles.size());
+		for (size_t t { 0 }; t < triangle_count; t++) {
+			if (degenerate(t))
+				continue;
+			for (size_t k { 0 }; k < 3; k++) {
+				auto const a { corner_group(t, k) };
+				auto const b { corner_group(t, (k + 1) % 3) };
+				edges.push_back(static_cast<uint64_t>(std::min(a, b)) << 32
+				    | std::max(a, b));
+			}
+		}
+		std::ranges::sort(edges);
+		for (size_t i { 0 }; i < edges.size();) {
+			auto j { i };
+			while (j < edges.size() && edges[j] == edges[i])
+				j++;
+			if (j - i != 2) {
+				locked[edges[i] >> 32] = true;
+				locked[edges[i] & 0xffffffff] = true;
+			}
+			i = j;
+		}
+	}
+
+	// Drop triangles that were degenerate to begin with.
+	auto const compact { [&] {
+		size_t live { 0 };
+		for (size_t t { 0 }; t < triangle_count; t++) {
+			if (degenerate(t))
+				continue;
+			std::copy_n(triangles.begin() + static_cast<ptrdiff_t>(t * 3), 3,
+			    triangles.begin() + static_cast<ptrdiff_t>(live * 3));
+			live++;
+		}
+		triangle_count = live;
+		triangles.resize(live * 3);
+	} };
+	compact();
+
+	struct Collapse {
+		double cost;
+		uint32_t from;
+		uint32_t to;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> adjacency_offsets(group_count + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<bool> touched(group_count);
+	std::vector<bool> dead;
+	// (vertex in `from`, vertex in `to`) pairs of one collapse.
+	std::vector<std::array<uint32_t, 2>> partners;
+
+	// Collapses cheapest-first, touching each group at most once per pass,
+	// until `target` triangles remain or nothing more can go.
+	double max_cost { 0.0 };
+	auto const simplify_to { [&](size_t target) {
+		while (triangle_count > target) {
+			// Triangles around each group.
+			std::ranges::fill(adjacency_offsets, 0u);
+			for (size_t t { 0 }; t < triangle_count; t++) {
+				for (size_t k { 0 }; k < 3; k++)
+					adjacency_offsets[corner_group(t, k) + 1]++;
+			}
+			for (size_t g { 0 }; g < group_count; g++)
+				adjacency_offsets[g + 1] += adjacency_offsets[g];
+			adjacency.resize(triangle_count * 3);
+			{
+				auto cursor { adjacency_offsets };
+				for (size_t t { 0 }; t < triangle_count; t++) {
+					for (size_t k { 0 }; k < 3; k++) {
+						adjacency[cursor[corner_group(t, k)]++]
+						    = static_cast<uint32_t>(t);
+					}
+				}
+			}
+			auto const around { [&](uint32_t g) {
+				return std::span(adjacency)
+				    .subspan(adjacency_offsets[g],
+				        adjacency_offsets[g + 1] - adjacency_offsets[g]);
+			} };
+
+			// Interior edges show up in two triangles, once each way round;
+			// border edges only join locked groups.
+			collapses.clear();
+			for (size_t t { 0 }; t < triangle_count; t++) {
+				for (size_t k { 0 }; k < 3; k++) {
+					auto const a { corner_group(t, k) };
+					auto const b { corner_group(t, (k + 1) % 3) };
+					if (a > b)
+						continue;
+					if (!locked[a]) {
+						collapses.emplace_back(
+						    evaluate(quadrics[a], positions[b]), a, b);
+					}
+					if (!locked[b]) {
+						collapses.emplace_back(
+						    evaluate(quadrics[b], positions[a]), b, a);
+					}
+				}
+			}
+			std::ranges::sort(collapses, {}, &Collapse::cost);
+
+			touched.assign(group_count, false);
+			dead.assign(triangle_count, false);
+			size_t removed { 0 };
+			for (auto const &collapse : collapses) {
+				if (triangle_count - removed <= target)
+					break;
+				auto const from { collapse.from };
+				auto const to { collapse.to };
+				if (touched[from] || touched[to])
+					continue;
+
+				// Every vertex of `from` merges into a vertex of `to` it
+				// shares a triangle with, so seams keep their sides apart.
+				partners.clear();
+				auto const corner_in { [&](uint32_t t, uint32_t g) {
+					for (size_t k { 0 }; k < 3; k++) {
+						if (corner_group(t, k) == g)
+							return triangles[t * 3 + k];
+					}
+					return ~0u;
+				} };
+				for (auto const t : around(from)) {
+					if (dead[t])
+						continue;
+					auto const b { corner_in(t, to) };
+					auto const a { corner_in(t, from) };
+					if (b != ~0u
+					    && std::ranges::find(partners, a,
+					           [](auto const &p) { return p[0]; })
+					        == partners.end())
+						partners.push_back({ a, b });
+				}
+
+				auto valid { true };
+				for (auto const t : around(from)) {
+					if (dead[t])
+						continue;
+					auto const a { corner_in(t, from) };
+					if (std::ranges::find(partners, a,
+					        [](auto const &p) { return p[0]; })
+					    == partners.end()) {
+						valid = false;
+						break;
+					}
+					if (corner_in(t, to) != ~0u)
+						continue;
+
+					// Triangles that keep their area must not flip over.
+					std::array<Double3, 3> p {};
+					for (size_t k { 0 }; k < 3; k++)
+						p[k] = positions[corner_group(t, k)];
+					auto const before { cross(
+						subtract(p[1], p[0]), subtract(p[2], p[0])) };
+					for (size_t k { 0 }; k < 3; k++) {
+						if (corner_group(t, k) == from)
+							p[k] = positions[to];
+					}
+					auto const after { cross(
+						subtract(p[1], p[0]), subtract(p[2], p[0])) };
+					if (dot(before, after) <= MIN_NORMAL_COSINE
+					        * std::sqrt(dot(before, before)
+					            * dot(after, after))) {
+						valid = false;
+						break;
+					}
+				}
+				if (!valid)
+					continue;
+
+				for (auto const t : around(from)) {
+					if (dead[t])
+						continue;
+					for (size_t k { 0 }; k < 3; k++) {
+						auto &index { triangles[t * 3 + k] };
+						if (group[index] != from)
+							continue;
+						index = std::ranges::find(partners, index,
+						    [](auto const &p) { return p[0]; })->at(1);
+					}
+					if (degenerate(t)) {
+						dead[t] = true;
+						removed++;
+					}
+				}
+				add(quadrics[to], quadrics[from]);
+				max_cost = std::max(max_cost, collapse.cost);
+				touched[from] = true;
+				touched[to] = true;
+			}
+
+			if (removed == 0)
+				break;
+			compact();
+		}
+	} };
+
+	auto previous { triangle_count };
+	while (lods.size() < max_levels && previous / 2 >= MIN_LOD_TRIANGLES) {
+		simplify_to(previous / 2);
+		if (static_cast<float>(triangle_count)
+		    > MAX_LOD_RATIO * static_cast<float>(previous))
+			break;
+		lods.emplace_back(triangles, static_cast<float>(std::sqrt(max_cost)));
+		previous = triangle_count;
+	}
+	return lods;
+}
+
+} // namespace Lunar
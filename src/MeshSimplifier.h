@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Types.h"
+
+namespace Lunar {
+
+// A coarser copy of a triangle list that indexes the same vertices.
+struct SimplifiedLod {
+	std::vector<uint32_t> indices;
+	// Object-space distance by which the level may stray from the original
+	// surface, as estimated from the collapsed quadrics.
+	float error;
+};
+
+// Builds up to `max_levels` levels of detail by quadric edge collapse
+// (Garland and Heckbert), each with about half the triangles of the one
+// before. Vertices are only ever merged into a neighbour, never moved, so
+// every level shares `vertices`. Open borders stay in place and attribute
+// seams only collapse along themselves. Stops early once a level no longer
+// pays for its indices.
+auto build_lods(std::span<uint32_t const> indices,
+    std::span<Vertex const> vertices, size_t max_levels)
+    -> std::vector<SimplifiedLod>;
+
+} // namespace Lunar
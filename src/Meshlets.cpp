@@ -0,0 +1,193 @@
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace Lunar {
+
+namespace {
+
+using Float3 = std::array<float, 3>;
+
+auto to_float3(smath::Vec3 const &v) -> Float3
+{
+	return { v.x(), v.y(), v.z() };
+}
+
+auto subtract(Float3 const &a, Float3 const &b) -> Float3
+{
+	return { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+}
+
+auto dot(Float3 const &a, Float3 const &b) -> float
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+auto cross(Float3 const &a, Float3 const &b) -> Float3
+{
+	return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+		a[0] * b[1] - a[1] * b[0] };
+}
+
+// Meshlet under construction.
+struct Cluster {
+	std::vector<uint32_t> vertices;
+	std::vector<uint8_t> triangles;
+};
+
+auto compute_bounds(Cluster const &cluster, std::span<Vertex const> vertices,
+    Meshlet &meshlet) -> void
+{
+	Float3 min { to_float3(vertices[cluster.vertices[0]].position) };
+	Float3 max { min };
+	for (auto const v : cluster.vertices) {
+		auto const p { to_float3(vertices[v].position) };
+		for (size_t k { 0 }; k < 3; k++) {
+			min[k] = std::min(min[k], p[k]);
+			max[k] = std::max(max[k], p[k]);
+		}
+	}
+	Float3 const center { (min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f,
+		(min[2] + max[2]) * 0.5f };
+	float radius_squared { 0.0f };
+	for (auto const v : cluster.vertices) {
+		auto const d { subtract(to_float3(vertices[v].position), center) };
+		radius_squared = std::max(radius_squared, dot(d, d));
+	}
+
+	std::vector<Float3> normals;
+	normals.reserve(cluster.triangles.size() / 3);
+	Float3 axis { 0.0f, 0.0f, 0.0f };
+	for (size_t t { 0 }; t < cluster.triangles.size(); t += 3) {
+		auto const corner { [&](size_t k) {
+			return to_float3(
+			    vertices[cluster.vertices[cluster.triangles[t + k]]].position);
+		} };
+		auto const a { corner(0) };
+		auto const normal { cross(
+			subtract(corner(1), a), subtract(corner(2), a)) };
+		auto const length { std::sqrt(dot(normal, normal)) };
+		// Degenerate triangles face nowhere and never draw.
+		if (length == 0.0f)
+			continue;
+		normals.push_back(
+		    { normal[0] / length, normal[1] / length, normal[2] / length });
+		for (size_t k { 0 }; k < 3; k++)
+			axis[k] += normals.back()[k];
+	}
+
+	std::ranges::copy(center, meshlet.center);
+	meshlet.radius = std::sqrt(radius_squared);
+	meshlet.cone_axis[0] = 0.0f;
+	meshlet.cone_axis[1] = 0.0f;
+	meshlet.cone_axis[2] = 0.0f;
+	meshlet.cone_cutoff = 1.0f;
+
+	auto const axis_length { std::sqrt(dot(axis, axis)) };
+	if (normals.empty() || axis_length == 0.0f)
+		return;
+	axis = { axis[0] / axis_length, axis[1] / axis_length,
+		axis[2] / axis_length };
+	auto min_dot { 1.0f };
+	for (auto const &normal : normals)
+		min_dot = std::min(min_dot, dot(axis, normal));
+	// Past ~84 degrees of spread the cone would almost never reject.
+	if (min_dot <= 0.1f)
+		return;
+
+	std::ranges::copy(axis, meshlet.cone_axis);
+	meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+} // namespace
+
+auto build_meshlets(std::span<uint32_t const> indices,
+    std::span<Vertex const> vertices, bool double_sided) -> MeshletBlock
+{
+	std::vector<Cluster> clusters;
+	// Position of each vertex in the current cluster, or 0xff.
+	std::vector<uint8_t> local(vertices.size(), 0xff);
+	static_assert(MESHLET_MAX_VERTICES < 0xff);
+
+	Cluster cluster;
+	auto const flush { [&] {
+		if (cluster.triangles.empty())
+			return;
+		for (auto const v : cluster.vertices)
+			local[v] = 0xff;
+		clusters.emplace_back(std::move(cluster));
+		cluster = {};
+	} };
+
+	for (size_t t { 0 }; t + 2 < indices.size(); t += 3) {
+		std::array<uint32_t, 3> const corners { indices[t], indices[t + 1],
+			indices[t + 2] };
+		size_t new_vertices { 0 };
+		for (size_t k { 0 }; k < 3; k++) {
+			auto const repeated { (k > 0 && corners[k] == corners[0])
+				|| (k > 1 && corners[k] == corners[1]) };
+			if (local[corners[k]] == 0xff && !repeated)
+				new_vertices++;
+		}
+		if (cluster.vertices.size() + new_vertices > MESHLET_MAX_VERTICES
+		    || cluster.triangles.size() / 3 >= MESHLET_MAX_TRIANGLES)
+			flush();
+
+		for (auto const v : corners) {
+			if (local[v] == 0xff) {
+				local[v] = static_cast<uint8_t>(cluster.vertices.size());
+				cluster.vertices.push_back(v);
+			}
+			cluster.triangles.push_back(local[v]);
+		}
+	}
+	flush();
+
+	// Records first, so they stay 16-byte aligned for the shaders, then the
+	// vertex indices, then the triangles of each meshlet starting on a
+	// 4-byte boundary.
+	size_t vertex_total { 0 };
+	size_t triangle_bytes { 0 };
+	for (auto const &c : clusters) {
+		vertex_total += c.vertices.size();
+		triangle_bytes += (c.triangles.size() + 3) & ~size_t { 3 };
+	}
+	auto const vertex_start { clusters.size() * sizeof(Meshlet) };
+	auto const triangle_start { vertex_start
+		+ vertex_total * sizeof(uint32_t) };
+
+	MeshletBlock block {
+		.bytes = std::vector<std::byte>(triangle_start + triangle_bytes),
+		.count = static_cast<uint32_t>(clusters.size()),
+	};
+	auto vertex_cursor { vertex_start };
+	auto triangle_cursor { triangle_start };
+	for (size_t i { 0 }; i < clusters.size(); i++) {
+		auto const &c { clusters[i] };
+		Meshlet meshlet {};
+		compute_bounds(c, vertices, meshlet);
+		if (double_sided)
+			meshlet.cone_cutoff = 1.0f;
+		meshlet.vertex_offset
+		    = static_cast<uint32_t>(vertex_cursor / sizeof(uint32_t));
+		meshlet.triangle_offset = static_cast<uint32_t>(triangle_cursor);
+		meshlet.vertex_count = static_cast<uint32_t>(c.vertices.size());
+		meshlet.triangle_count = static_cast<uint32_t>(c.triangles.size() / 3);
+
+		std::memcpy(block.bytes.data() + i * sizeof(Meshlet), &meshlet,
+		    sizeof(Meshlet));
+		std::memcpy(block.bytes.data() + vertex_cursor, c.vertices.data(),
+		    c.vertices.size() * sizeof(uint32_t));
+		std::memcpy(block.bytes.data() + triangle_cursor, c.triangles.data(),
+		    c.triangles.size());
+		vertex_cursor += c.vertices.size() * sizeof(uint32_t);
+		triangle_cursor += (c.triangles.size() + 3) & ~size_t { 3 };
+	}
+
+	return block;
+}
+
+} // namespace Lunar
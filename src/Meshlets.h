@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Types.h"
+
+namespace Lunar {
+
+// Meshlets are small clusters of a surface's triangles. The task shader
+// culls them individually and the mesh shader draws the survivors.
+
+// Per-meshlet output limits the mesh shader is compiled for.
+constexpr uint32_t MESHLET_MAX_VERTICES { 64 };
+constexpr uint32_t MESHLET_MAX_TRIANGLES { 124 };
+// Meshlets culled by one task shader workgroup.
+constexpr uint32_t MESHLET_TASK_SIZE { 32 };
+
+// Mirrors `Meshlet` in shaders/common.glsl. Offsets are relative to the
+// start of the surface's meshlet block.
+struct Meshlet {
+	// Bounding sphere in mesh space.
+	float center[3];
+	float radius;
+	// Normal cone: every triangle faces away from a viewer at `v` when
+	// dot(center - v, cone_axis) >= cone_cutoff * |center - v| + radius.
+	// A cutoff of 1 never culls.
+	float cone_axis[3];
+	float cone_cutoff;
+	// In uint32_t units; surface-relative vertex indices.
+	uint32_t vertex_offset;
+	// In bytes; three uint8_t indices into the meshlet's vertices per
+	// triangle.
+	uint32_t triangle_offset;
+	uint32_t vertex_count;
+	uint32_t triangle_count;
+};
+static_assert(sizeof(Meshlet) == 48);
+
+// A surface's meshlets laid out for upload: the Meshlet records, then their
+// vertex indices, then their triangles.
+struct MeshletBlock {
+	std::vector<std::byte> bytes;
+	uint32_t count { 0 };
+};
+
+// Splits the triangle list into meshlets, keeping the triangle order, so
+// the cache-optimized order of optimize_mesh() also gives compact meshlets.
+// Meshlets of `double_sided` surfaces get cones that never cull.
+auto build_meshlets(std::span<uint32_t const> indices,
+    std::span<Vertex const> vertices, bool double_sided) -> MeshletBlock;
+
+} // namespace Lunar
@@ -0,0 +1,80 @@
+#include "OffsetAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace Lunar {
+
+auto OffsetAllocator::init(uint64_t capacity) -> void
+{
+	m_free.clear();
+	m_capacity = capacity;
+	m_free_bytes = capacity;
+	if (capacity > 0)
+		m_free.emplace(0, capacity);
+}
+
+auto OffsetAllocator::allocate(uint64_t size, uint64_t alignment)
+    -> std::optional<uint64_t>
+{
+	if (size == 0)
+		return {};
+
+	for (auto it = m_free.begin(); it != m_free.end(); it++) {
+		auto const [block_offset, block_size] = *it;
+
+		auto const aligned { (block_offset + alignment - 1) / alignment
+			* alignment };
+		auto const padding { aligned - block_offset };
+		if (padding + size > block_size)
+			continue;
+
+		m_free.erase(it);
+		if (padding > 0)
+			m_free.emplace(block_offset, padding);
+		if (padding + size < block_size)
+			m_free.emplace(aligned + size, block_size - padding - size);
+
+		m_free_bytes -= size;
+		return aligned;
+	}
+
+	return {};
+}
+
+auto OffsetAllocator::free(uint64_t offset, uint64_t size) -> void
+{
+	assert(offset + size <= m_capacity);
+
+	m_free_bytes += size;
+
+	auto next { m_free.lower_bound(offset) };
+
+	if (next != m_free.begin()) {
+		auto prev { std::prev(next) };
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			m_free.erase(prev);
+		}
+	}
+
+	if (next != m_free.end() && offset + size == next->first) {
+		size += next->second;
+		next = m_free.erase(next);
+	}
+
+	m_free.emplace_hint(next, offset, size);
+}
+
+auto OffsetAllocator::largest_free_block() const -> uint64_t
+{
+	uint64_t largest { 0 };
+	for (auto const &[offset, size] : m_free) {
+		largest = std::max(largest, size);
+	}
+	return largest;
+}
+
+} // namespace Lunar
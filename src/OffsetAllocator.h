@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+
+namespace Lunar {
+
+// First-fit allocator over a linear range of bytes. It only hands out
+// offsets; the memory itself belongs to whoever owns the allocator. Freed
+// ranges are coalesced with their neighbours.
+struct OffsetAllocator {
+	auto init(uint64_t capacity) -> void;
+
+	auto allocate(uint64_t size, uint64_t alignment) -> std::optional<uint64_t>;
+	auto free(uint64_t offset, uint64_t size) -> void;
+
+	auto capacity() const -> uint64_t { return m_capacity; }
+	auto free_bytes() const -> uint64_t { return m_free_bytes; }
+	auto largest_free_block() const -> uint64_t;
+
+private:
+	// Free ranges keyed by offset.
+	std::map<uint64_t, uint64_t> m_free;
+	uint64_t m_capacity { 0 };
+	uint64_t m_free_bytes { 0 };
+};
+
+} // namespace Lunar
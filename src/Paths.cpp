@@ -0,0 +1,43 @@
+#include "Paths.h"
+
+#include <cstdlib>
+
+#ifdef _WIN32
+#	include <shlobj.h> // SHGetKnownFolderPath
+#	include <windows.h>
+#else
+#	include <pwd.h>
+#	include <unistd.h>
+#endif
+
+namespace Lunar {
+
+#ifndef _WIN32
+static auto home_directory() -> std::filesystem::path
+{
+	auto const *home { getenv("HOME") };
+	if (!home)
+		home = getpwuid(getuid())->pw_dir;
+	return home;
+}
+#endif
+
+auto cache_directory(std::string_view app_name) -> std::filesystem::path
+{
+#ifdef _WIN32
+	PWSTR path = nullptr;
+	SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, nullptr, &path);
+	std::wstring wpath(path);
+	CoTaskMemFree(path);
+	return std::filesystem::path(wpath) / app_name / "cache";
+#elif defined(__APPLE__)
+	return home_directory() / "Library" / "Caches" / app_name;
+#else
+	auto const *xdg_cache { getenv("XDG_CACHE_HOME") };
+	if (xdg_cache && *xdg_cache)
+		return std::filesystem::path(xdg_cache) / app_name;
+	return home_directory() / ".cache" / app_name;
+#endif
+}
+
+} // namespace Lunar
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+namespace Lunar {
+
+// Per-user directory for regenerable data ($XDG_CACHE_HOME/<app> on Linux).
+// Not created; callers create it when they first write.
+auto cache_directory(std::string_view app_name) -> std::filesystem::path;
+
+} // namespace Lunar
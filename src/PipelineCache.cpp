@@ -0,0 +1,285 @@
+#include "PipelineCache.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "Util.h"
+
+namespace Lunar {
+
+constexpr auto CATEGORY { Logger::Category::Renderer };
+
+auto PipelineCache::init(Logger &logger, VkPhysicalDevice phys_dev,
+    VkDevice dev, std::filesystem::path path, uint64_t content_hash) -> void
+{
+	m_logger = &logger;
+	m_dev = dev;
+	m_path = std::move(path);
+
+	VkPhysicalDeviceIDProperties id_props {};
+	id_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+	VkPhysicalDeviceProperties2 props {};
+	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	props.pNext = &id_props;
+	vkGetPhysicalDeviceProperties2(phys_dev, &props);
+
+	m_expected.magic = MAGIC;
+	m_expected.version = VERSION;
+	m_expected.vendor_id = props.properties.vendorID;
+	m_expected.device_id = props.properties.deviceID;
+	m_expected.driver_version = props.properties.driverVersion;
+	std::memcpy(m_expected.pipeline_cache_uuid,
+	    props.properties.pipelineCacheUUID, VK_UUID_SIZE);
+	std::memcpy(m_expected.driver_uuid, id_props.driverUUID, VK_UUID_SIZE);
+	m_expected.content_hash = content_hash;
+
+	auto const data { load() };
+	m_warm = !data.empty();
+	m_saved_hash = fnv1a(data);
+
+	VkPipelineCacheCreateInfo cache_ci {};
+	cache_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cache_ci.initialDataSize = data.size();
+	cache_ci.pInitialData = data.empty() ? nullptr : data.data();
+	VK_CHECK(logger, vkCreatePipelineCache(dev, &cache_ci, nullptr, &m_cache));
+}
+
+auto PipelineCache::destroy() -> void
+{
+	if (m_cache == VK_NULL_HANDLE)
+		return;
+
+	save();
+	vkDestroyPipelineCache(m_dev, m_cache, nullptr);
+	m_cache = VK_NULL_HANDLE;
+}
+
+auto PipelineCache::load() -> std::vector<uint8_t>
+{
+	if (m_path.empty())
+		return {};
+
+	std::ifstream in { m_path, std::ios::binary | std::ios::ate };
+	if (!in) {
+		m_logger->info(CATEGORY, "No pipeline cache at {}", m_path.string());
+		return {};
+	}
+	auto const file_size { static_cast<size_t>(in.tellg()) };
+	in.seekg(0);
+
+	FileHeader header {};
+	if (file_size < sizeof(header)
+	    || !in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+		m_logger->warn(CATEGORY, "Pipeline cache is truncated, starting cold");
+		return {};
+	}
+
+	auto const reject { [&](std::string_view reason) {
+		m_logger->info(CATEGORY, "Pipeline cache {}, starting cold", reason);
+		return std::vector<uint8_t> {};
+	} };
+	if (header.magic != MAGIC || header.version != VERSION)
+		return reject("has an unknown format");
+	if (header.vendor_id != m_expected.vendor_id
+	    || header.device_id != m_expected.device_id)
+		return reject("was written for another device");
+	if (header.driver_version != m_expected.driver_version
+	    || std::memcmp(header.driver_uuid, m_expected.driver_uuid,
+	           VK_UUID_SIZE)
+	        != 0
+	    || std::memcmp(header.pipeline_cache_uuid,
+	           m_expected.pipeline_cache_uuid, VK_UUID_SIZE)
+	        != 0)
+		return reject("was written by another driver");
+	if (header.content_hash != m_expected.content_hash)
+		return reject("was built from different shaders");
+	if (header.data_size != file_size - sizeof(header))
+		return reject("is truncated");
+
+	std::vector<uint8_t> data(header.data_size);
+	if (!in.read(reinterpret_cast<char *>(data.data()),
+	        static_cast<std::streamsize>(data.size())))
+		return reject("could not be read");
+	if (hash(data) != header.data_hash)
+		return reject("is corrupt");
+
+	// The driver validates its own header too, but an explicit check keeps a
+	// mismatch from silently producing a cold cache.
+	VkPipelineCacheHeaderVersionOne driver_header {};
+	if (data.size() < sizeof(driver_header))
+		return reject("is truncated");
+	std::memcpy(&driver_header, data.data(), sizeof(driver_header));
+	if (driver_header.vendorID != m_expected.vendor_id
+	    || driver_header.deviceID != m_expected.device_id
+	    || std::memcmp(driver_header.pipelineCacheUUID,
+	           m_expected.pipeline_cache_uuid, VK_UUID_SIZE)
+	        != 0)
+		return reject("has a mismatched driver header");
+
+	m_logger->info(CATEGORY, "Loaded {} KiB pipeline cache from {}",
+	    data.size() / 1024, m_path.string());
+	return data;
+}
+
+auto PipelineCache::save() -> void
+{
+	if (m_path.empty() || m_cache == VK_NULL_HANDLE)
+		return;
+
+	size_t size {};
+	VK_CHECK(*m_logger, vkGetPipelineCacheData(m_dev, m_cache, &size, nullptr));
+	std::vector<uint8_t> data(size);
+	VK_CHECK(*m_logger,
+	    vkGetPipelineCacheData(m_dev, m_cache, &size, data.data()));
+	data.resize(size);
+
+	auto const data_hash { hash(data) };
+	if (data_hash == m_saved_hash)
+		return;
+
+	auto header { m_expected };
+	header.data_size = data.size();
+	header.data_hash = data_hash;
+
+	std::error_code ec;
+	std::filesystem::create_directories(m_path.parent_path(), ec);
+
+	// Write next to the destination and rename over it, so a crash mid-write
+	// never leaves a torn cache behind.
+	auto tmp_path { m_path };
+	tmp_path += ".tmp";
+	{
+		std::ofstream out { tmp_path, std::ios::binary | std::ios::trunc };
+		out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+		out.write(reinterpret_cast<char const *>(data.data()),
+		    static_cast<std::streamsize>(data.size()));
+		out.flush();
+		if (!out) {
+			m_logger->warn(CATEGORY, "Failed to write pipeline cache to {}",
+			    tmp_path.string());
+			std::filesystem::remove(tmp_path, ec);
+			return;
+		}
+	}
+	std::filesystem::rename(tmp_path, m_path, ec);
+	if (ec) {
+		m_logger->warn(
+		    CATEGORY, "Failed to replace pipeline cache: {}", ec.message());
+		std::filesystem::remove(tmp_path, ec);
+		return;
+	}
+
+	m_saved_hash = data_hash;
+	m_logger->info(CATEGORY, "Saved {} KiB pipeline cache to {}",
+	    size / 1024, m_path.string());
+}
+
+auto PipelineCache::stats() -> Stats
+{
+	std::scoped_lock lock { m_stats_mutex };
+	return m_stats;
+}
+
+auto PipelineCache::create_graphics_pipeline(
+    VkGraphicsPipelineCreateInfo ci, std::string_view name) -> VkPipeline
+{
+	VkPipelineCreationFeedback feedback {};
+	std::vector<VkPipelineCreationFeedback> stage_feedback(ci.stageCount);
+	VkPipelineCreationFeedbackCreateInfo feedback_ci {};
+	feedback_ci.sType
+	    = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+	feedback_ci.pNext = ci.pNext;
+	feedback_ci.pPipelineCreationFeedback = &feedback;
+	feedback_ci.pipelineStageCreationFeedbackCount = ci.stageCount;
+	feedback_ci.pPipelineStageCreationFeedbacks = stage_feedback.data();
+	ci.pNext = &feedback_ci;
+
+	auto const start { std::chrono::steady_clock::now() };
+	VkPipeline pipeline {};
+	VK_CHECK(*m_logger,
+	    vkCreateGraphicsPipelines(m_dev, m_cache, 1, &ci, nullptr, &pipeline));
+	auto const wall { std::chrono::steady_clock::now() - start };
+
+	record(name, feedback,
+	    static_cast<uint64_t>(
+	        std::chrono::duration_cast<std::chrono::nanoseconds>(wall)
+	            .count()));
+	return pipeline;
+}
+
+auto PipelineCache::create_compute_pipeline(
+    VkComputePipelineCreateInfo ci, std::string_view name) -> VkPipeline
+{
+	VkPipelineCreationFeedback feedback {};
+	VkPipelineCreationFeedback stage_feedback {};
+	VkPipelineCreationFeedbackCreateInfo feedback_ci {};
+	feedback_ci.sType
+	    = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+	feedback_ci.pNext = ci.pNext;
+	feedback_ci.pPipelineCreationFeedback = &feedback;
+	feedback_ci.pipelineStageCreationFeedbackCount = 1;
+	feedback_ci.pPipelineStageCreationFeedbacks = &stage_feedback;
+	ci.pNext = &feedback_ci;
+
+	auto const start { std::chrono::steady_clock::now() };
+	VkPipeline pipeline {};
+	VK_CHECK(*m_logger,
+	    vkCreateComputePipelines(m_dev, m_cache, 1, &ci, nullptr, &pipeline));
+	auto const wall { std::chrono::steady_clock::now() - start };
+
+	record(name, feedback,
+	    static_cast<uint64_t>(
+	        std::chrono::duration_cast<std::chrono::nanoseconds>(wall)
+	            .count()));
+	return pipeline;
+}
+
+auto PipelineCache::create_compute_pipeline(VkPipelineLayout layout,
+    std::span<uint8_t const> spirv, std::string_view name) -> VkPipeline
+{
+	VkShaderModule module {};
+	if (!vkutil::load_shader_module(spirv, m_dev, &module)) {
+		m_logger->err(
+		    CATEGORY, "Failed to load shader for pipeline '{}'", name);
+		return VK_NULL_HANDLE;
+	}
+	defer(vkDestroyShaderModule(m_dev, module, nullptr));
+
+	VkComputePipelineCreateInfo ci {};
+	ci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	ci.layout = layout;
+	ci.stage = vkinit::pipeline_shader_stage(VK_SHADER_STAGE_COMPUTE_BIT, module);
+
+	return create_compute_pipeline(ci, name);
+}
+
+auto PipelineCache::record(std::string_view name,
+    VkPipelineCreationFeedback const &feedback, uint64_t wall_ns) -> void
+{
+	constexpr auto CACHE_HIT {
+		VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT
+	};
+
+	// Drivers may not fill in feedback; fall back to our own timing.
+	auto const valid {
+		(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT) != 0
+	};
+	auto const duration_ns { valid ? feedback.duration : wall_ns };
+	auto const hit { valid && (feedback.flags & CACHE_HIT) != 0 };
+
+	{
+		std::scoped_lock lock { m_stats_mutex };
+		m_stats.pipelines++;
+		m_stats.cache_hits += hit ? 1 : 0;
+		m_stats.creation_ns += duration_ns;
+		m_stats.last_created = std::chrono::steady_clock::now();
+	}
+
+	m_logger->debug(CATEGORY, "Pipeline '{}' created in {:.3f} ms{}", name,
+	    static_cast<double>(duration_ns) / 1e6,
+	    hit ? " (cache hit)" : (valid ? "" : " (no feedback)"));
+}
+
+} // namespace Lunar
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "Logger.h"
+
+namespace Lunar {
+
+// Pipeline that may still be compiling on the job system.
+struct PipelineFuture {
+	PipelineFuture() = default;
+	PipelineFuture(std::shared_future<VkPipeline> future)
+	    : m_future(std::move(future))
+	{
+	}
+
+	auto ready() const -> bool
+	{
+		return m_future.valid()
+		    && m_future.wait_for(std::chrono::seconds(0))
+		    == std::future_status::ready;
+	}
+	// VK_NULL_HANDLE while compiling; rethrows if compilation failed.
+	auto get() const -> VkPipeline
+	{
+		return ready() ? m_future.get() : VK_NULL_HANDLE;
+	}
+	// Blocks until compilation ends. VK_NULL_HANDLE if it failed, so it is
+	// safe to use during teardown.
+	auto wait() const -> VkPipeline
+	{
+		if (!m_future.valid())
+			return VK_NULL_HANDLE;
+		try {
+			return m_future.get();
+		} catch (...) {
+			return VK_NULL_HANDLE;
+		}
+	}
+
+private:
+	std::shared_future<VkPipeline> m_future;
+};
+
+// VkPipelineCache persisted to disk. The file is only reused when it was
+// written for the same device, driver and embedded shaders; otherwise the
+// cache starts empty. Pipelines created through it report how long they took
+// and whether the driver served them from the cache. Pipeline creation may be
+// called from any thread.
+struct PipelineCache {
+	struct Stats {
+		uint32_t pipelines { 0 };
+		uint32_t cache_hits { 0 };
+		uint64_t creation_ns { 0 };
+		std::chrono::steady_clock::time_point last_created {};
+	};
+
+
+	// An empty `path` keeps the cache in memory only. `content_hash` covers
+	// everything the cached pipelines were built from, i.e. the SPIR-V.
+	auto init(Logger &logger, VkPhysicalDevice phys_dev, VkDevice dev,
+	    std::filesystem::path path, uint64_t content_hash) -> void;
+	// Saves and destroys the cache.
+	auto destroy() -> void;
+	// Writes the cache if its contents changed since it was loaded or last
+	// saved. The file is replaced atomically.
+	auto save() -> void;
+
+	auto handle() const -> VkPipelineCache { return m_cache; }
+	auto device() const -> VkDevice { return m_dev; }
+	// Whether a valid cache file was loaded at startup.
+	auto warm() const -> bool { return m_warm; }
+	auto stats() -> Stats;
+
+	auto create_graphics_pipeline(VkGraphicsPipelineCreateInfo ci,
+	    std::string_view name) -> VkPipeline;
+	auto create_compute_pipeline(VkComputePipelineCreateInfo ci,
+	    std::string_view name) -> VkPipeline;
+	// Creates the shader module itself, so it can run on any thread.
+	auto create_compute_pipeline(VkPipelineLayout layout,
+	    std::span<uint8_t const> spirv, std::string_view name) -> VkPipeline;
+
+private:
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendor_id;
+		uint32_t device_id;
+		uint32_t driver_version;
+		uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+		uint8_t driver_uuid[VK_UUID_SIZE];
+		uint64_t content_hash;
+		uint64_t data_size;
+		uint64_t data_hash;
+	};
+
+	static constexpr uint32_t MAGIC { 0x4843504c }; // "LPCH"
+	static constexpr uint32_t VERSION { 1 };
+
+	auto load() -> std::vector<uint8_t>;
+	auto record(std::string_view name,
+	    VkPipelineCreationFeedback const &feedback, uint64_t wall_ns) -> void;
+
+	Logger *m_logger { nullptr };
+	VkDevice m_dev { VK_NULL_HANDLE };
+	VkPipelineCache m_cache { VK_NULL_HANDLE };
+	std::filesystem::path m_path;
+	FileHeader m_expected {};
+	uint64_t m_saved_hash { 0 };
+	bool m_warm { false };
+
+	std::mutex m_stats_mutex;
+	Stats m_stats {};
+};
+
+} // namespace Lunar
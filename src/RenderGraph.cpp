@@ -0,0 +1,488 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+
+#include "Util.h"
+
+namespace Lunar {
+
+constexpr auto CATEGORY { Logger::Category::Renderer };
+
+static auto aspect_of(VkFormat format) -> VkImageAspectFlags
+{
+	switch (format) {
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT;
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	case VK_FORMAT_S8_UINT:
+		return VK_IMAGE_ASPECT_STENCIL_BIT;
+	default:
+		return VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+}
+
+auto RenderGraph::Pass::read(
+    RGImage image, VkImageLayout layout, SyncScope scope) -> Pass &
+{
+	m_uses.emplace_back(Use { true, image.index, layout, scope, Access::Read });
+	return *this;
+}
+
+auto RenderGraph::Pass::write(
+    RGImage image, VkImageLayout layout, SyncScope scope) -> Pass &
+{
+	m_uses.emplace_back(
+	    Use { true, image.index, layout, scope, Access::Write });
+	return *this;
+}
+
+auto RenderGraph::Pass::read_write(
+    RGImage image, VkImageLayout layout, SyncScope scope) -> Pass &
+{
+	m_uses.emplace_back(
+	    Use { true, image.index, layout, scope, Access::ReadWrite });
+	return *this;
+}
+
+auto RenderGraph::Pass::read(RGBuffer buffer, SyncScope scope) -> Pass &
+{
+	m_uses.emplace_back(Use { false, buffer.index, VK_IMAGE_LAYOUT_UNDEFINED,
+	    scope, Access::Read });
+	return *this;
+}
+
+auto RenderGraph::Pass::write(RGBuffer buffer, SyncScope scope) -> Pass &
+{
+	m_uses.emplace_back(Use { false, buffer.index, VK_IMAGE_LAYOUT_UNDEFINED,
+	    scope, Access::Write });
+	return *this;
+}
+
+auto RenderGraph::Pass::read_write(RGBuffer buffer, SyncScope scope) -> Pass &
+{
+	m_uses.emplace_back(Use { false, buffer.index, VK_IMAGE_LAYOUT_UNDEFINED,
+	    scope, Access::ReadWrite });
+	return *this;
+}
+
+auto RenderGraph::Pass::side_effect() -> Pass &
+{
+	m_side_effect = true;
+	return *this;
+}
+
+auto RenderGraph::Pass::execute(Execute &&function) -> Pass &
+{
+	m_execute = std::move(function);
+	return *this;
+}
+
+auto RenderGraph::init(Logger &logger, VkDevice dev, VmaAllocator allocator)
+    -> void
+{
+	m_logger = &logger;
+	m_dev = dev;
+	m_vma = allocator;
+}
+
+auto RenderGraph::destroy() -> void
+{
+	for (auto &slot : m_slots)
+		destroy_slot(slot);
+	m_slots.clear();
+	m_passes.clear();
+	m_images.clear();
+	m_buffers.clear();
+}
+
+auto RenderGraph::begin(uint32_t frame_slot) -> void
+{
+	m_slot = frame_slot;
+	if (m_slots.size() <= frame_slot)
+		m_slots.resize(frame_slot + 1);
+
+	m_passes.clear();
+	m_images.clear();
+	m_buffers.clear();
+	m_stats = {};
+}
+
+auto RenderGraph::import_image(VkImage image, VkImageView view,
+    VkExtent2D extent, VkImageLayout initial_layout, SyncScope initial_scope,
+    VkImageAspectFlags aspect) -> RGImage
+{
+	m_images.emplace_back(ImageResource {
+	    .image = image,
+	    .view = view,
+	    .extent = extent,
+	    .aspect = aspect,
+	    .state = { initial_layout, initial_scope, sync::NONE },
+	});
+	return { static_cast<uint32_t>(m_images.size() - 1) };
+}
+
+auto RenderGraph::import_buffer(VkBuffer buffer, SyncScope initial_scope)
+    -> RGBuffer
+{
+	m_buffers.emplace_back(BufferResource {
+	    .buffer = buffer,
+	    .state = { VK_IMAGE_LAYOUT_UNDEFINED, initial_scope, sync::NONE },
+	});
+	return { static_cast<uint32_t>(m_buffers.size() - 1) };
+}
+
+auto RenderGraph::create_image(ImageDesc const &desc) -> RGImage
+{
+	m_images.emplace_back(ImageResource {
+	    .extent = desc.extent,
+	    .aspect = aspect_of(desc.format),
+	    .state = { VK_IMAGE_LAYOUT_UNDEFINED, sync::NONE, sync::NONE },
+	    .transient = true,
+	    .desc = desc,
+	});
+	return { static_cast<uint32_t>(m_images.size() - 1) };
+}
+
+auto RenderGraph::export_image(
+    RGImage image, VkImageLayout layout, SyncScope scope) -> void
+{
+	auto &resource { m_images.at(image.index) };
+	resource.exported = true;
+	resource.export_layout = layout;
+	resource.export_scope = scope;
+}
+
+auto RenderGraph::add_pass(std::string name) -> Pass &
+{
+	auto &pass { m_passes.emplace_back() };
+	pass.m_name = std::move(name);
+	return pass;
+}
+
+auto RenderGraph::execute(JobSystem &jobs, CommandSource const &acquire,
+    GpuProfiler *profiler) -> std::vector<VkCommandBuffer>
+{
+	cull();
+	place_transients();
+
+	std::vector<Recording> recordings;
+	for (auto &pass : m_passes) {
+		m_stats.passes++;
+		if (!pass.m_live) {
+			m_stats.culled_passes++;
+			continue;
+		}
+
+		auto &recording { recordings.emplace_back(
+			Recording { &pass, {}, {}, ~0u }) };
+		if (profiler != nullptr)
+			recording.scope = profiler->add_scope(pass.m_name);
+		auto &barriers { recording.before };
+		for (auto const &use : pass.m_uses) {
+			auto const writes { use.access != Access::Read };
+			SyncScope src {};
+
+			if (!use.is_image) {
+				auto &buffer { m_buffers[use.resource] };
+				if (advance(buffer.state, VK_IMAGE_LAYOUT_UNDEFINED, use.scope,
+				        writes, src)) {
+					barriers.buffer(buffer.buffer, src, use.scope);
+				}
+				continue;
+			}
+
+			auto &image { m_images[use.resource] };
+			if (!image.touched && image.alias_of != ~0u) {
+				// The memory's previous occupant must be done before this
+				// image's initial transition clobbers it.
+				auto const &previous { m_images[image.alias_of].state };
+				image.state.write = {
+					previous.write.stage | previous.readers.stage,
+					VK_ACCESS_2_NONE,
+				};
+			}
+			image.touched = true;
+			auto const old_layout { image.state.layout };
+			if (advance(image.state, use.layout, use.scope, writes, src)) {
+				barriers.image(image.image, old_layout, src, use.layout,
+				    use.scope, BarrierBuilder::range(image.aspect));
+			}
+		}
+		if (!barriers.empty())
+			m_stats.barriers++;
+	}
+
+	BarrierBuilder exports;
+	for (auto &image : m_images) {
+		if (!image.exported || image.image == VK_NULL_HANDLE)
+			continue;
+
+		SyncScope src {};
+		auto const old_layout { image.state.layout };
+		if (advance(image.state, image.export_layout, image.export_scope,
+		        false, src)) {
+			exports.image(image.image, old_layout, src, image.export_layout,
+			    image.export_scope, BarrierBuilder::range(image.aspect));
+		}
+	}
+	if (!exports.empty()) {
+		m_stats.barriers++;
+		if (recordings.empty())
+			recordings.emplace_back(Recording { nullptr, {}, {}, ~0u });
+		recordings.back().after = std::move(exports);
+	}
+
+	std::vector<VkCommandBuffer> buffers(recordings.size());
+	jobs.parallel_for(static_cast<uint32_t>(recordings.size()),
+	    [&](uint32_t index, uint32_t thread) {
+		    auto &recording { recordings[index] };
+		    auto const cmd { acquire(thread) };
+
+		    VkCommandBufferBeginInfo begin_info {};
+		    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		    VK_CHECK(*m_logger, vkBeginCommandBuffer(cmd, &begin_info));
+
+		    auto const profiled { recording.scope != ~0u };
+		    if (profiled)
+			    profiler->begin(cmd, recording.scope);
+		    recording.before.record(cmd);
+		    if (recording.pass && recording.pass->m_execute)
+			    recording.pass->m_execute(cmd, *this);
+		    if (profiled)
+			    profiler->end(cmd, recording.scope);
+		    recording.after.record(cmd);
+
+		    VK_CHECK(*m_logger, vkEndCommandBuffer(cmd));
+		    buffers[index] = cmd;
+	    });
+
+	return buffers;
+}
+
+auto RenderGraph::advance(State &state, VkImageLayout layout, SyncScope scope,
+    bool writes, SyncScope &src) -> bool
+{
+	if (writes || layout != state.layout) {
+		src = {
+			state.write.stage | state.readers.stage,
+			state.write.access,
+		};
+		auto const transition { layout != state.layout };
+		state.layout = layout;
+		if (writes) {
+			state.write = scope;
+			state.readers = sync::NONE;
+		} else {
+			// Readers in other stages chain onto the stages that waited for
+			// the transition.
+			state.write = { scope.stage, VK_ACCESS_2_NONE };
+			state.readers = scope;
+		}
+		return transition || src.stage != VK_PIPELINE_STAGE_2_NONE;
+	}
+
+	// Read-after-read needs nothing once this stage has seen the last write.
+	if ((scope.stage & ~state.readers.stage) == 0
+	    && (scope.access & ~state.readers.access) == 0)
+		return false;
+
+	src = state.write;
+	state.readers.stage |= scope.stage;
+	state.readers.access |= scope.access;
+	return src.stage != VK_PIPELINE_STAGE_2_NONE;
+}
+
+// Walks the passes backwards from the exported images and side-effecting
+// passes, keeping only the passes whose writes are eventually consumed.
+auto RenderGraph::cull() -> void
+{
+	std::vector<bool> needed_images(m_images.size());
+	std::vector<bool> needed_buffers(m_buffers.size());
+	for (size_t i { 0 }; i < m_images.size(); i++)
+		needed_images[i] = m_images[i].exported;
+
+	auto const needed { [&](Pass::Use const &use) {
+		return use.is_image ? needed_images[use.resource]
+		                    : needed_buffers[use.resource];
+	} };
+	auto const set_needed { [&](Pass::Use const &use, bool value) {
+		if (use.is_image)
+			needed_images[use.resource] = value;
+		else
+			needed_buffers[use.resource] = value;
+	} };
+
+	for (auto it { m_passes.rbegin() }; it != m_passes.rend(); it++) {
+		auto &pass { *it };
+		pass.m_live = pass.m_side_effect;
+		for (auto const &use : pass.m_uses) {
+			if (use.access != Access::Read && needed(use))
+				pass.m_live = true;
+		}
+		if (!pass.m_live)
+			continue;
+
+		// A full overwrite satisfies every later reader by itself.
+		for (auto const &use : pass.m_uses) {
+			if (use.access == Access::Write)
+				set_needed(use, false);
+		}
+		for (auto const &use : pass.m_uses) {
+			if (use.access != Access::Write)
+				set_needed(use, true);
+		}
+	}
+}
+
+// Assigns every transient used by a live pass to a memory block, sharing a
+// block between images whose live ranges do not overlap, then (re)creates the
+// slot's images if the assignment differs from last time.
+auto RenderGraph::place_transients() -> void
+{
+	uint32_t order { 0 };
+	for (auto const &pass : m_passes) {
+		if (!pass.m_live)
+			continue;
+		for (auto const &use : pass.m_uses) {
+			if (!use.is_image || !m_images[use.resource].transient)
+				continue;
+			auto &image { m_images[use.resource] };
+			image.first_use = std::min(image.first_use, order);
+			image.last_use = std::max(image.last_use, order);
+		}
+		order++;
+	}
+
+	std::vector<uint32_t> transients;
+	for (uint32_t i { 0 }; i < m_images.size(); i++) {
+		if (m_images[i].transient)
+			transients.emplace_back(i);
+	}
+	std::ranges::stable_sort(transients, [&](uint32_t a, uint32_t b) {
+		return m_images[a].first_use < m_images[b].first_use;
+	});
+
+	struct Block {
+		VkMemoryRequirements requirements;
+		uint32_t last_use;
+		uint32_t occupant;
+	};
+	std::vector<Block> blocks;
+	std::vector<Placement> placements(transients.size());
+	std::vector<VkImageCreateInfo> create_infos(transients.size());
+
+	for (size_t i { 0 }; i < transients.size(); i++) {
+		auto const index { transients[i] };
+		auto &image { m_images[index] };
+		placements[i] = { image.desc, ~0u };
+		if (image.first_use == ~0u)
+			continue;
+
+		create_infos[i] = vkinit::image_create_info(image.desc.format,
+		    image.desc.usage,
+		    { image.desc.extent.width, image.desc.extent.height, 1 });
+
+		VkDeviceImageMemoryRequirements info_requirements {};
+		info_requirements.sType
+		    = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+		info_requirements.pCreateInfo = &create_infos[i];
+		VkMemoryRequirements2 requirements {};
+		requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+		vkGetDeviceImageMemoryRequirements(
+		    m_dev, &info_requirements, &requirements);
+		auto const &req { requirements.memoryRequirements };
+		m_stats.unaliased_bytes += req.size;
+
+		auto block { std::ranges::find_if(blocks, [&](Block const &b) {
+			return b.last_use < image.first_use
+			    && (b.requirements.memoryTypeBits & req.memoryTypeBits) != 0;
+		}) };
+		if (block == blocks.end()) {
+			blocks.emplace_back(Block { req, image.last_use, index });
+			image.block = static_cast<uint32_t>(blocks.size() - 1);
+		} else {
+			block->requirements.size
+			    = std::max(block->requirements.size, req.size);
+			block->requirements.alignment
+			    = std::max(block->requirements.alignment, req.alignment);
+			block->requirements.memoryTypeBits &= req.memoryTypeBits;
+			block->last_use = image.last_use;
+			image.alias_of = block->occupant;
+			block->occupant = index;
+			image.block = static_cast<uint32_t>(block - blocks.begin());
+		}
+		placements[i].block = image.block;
+	}
+
+	for (auto const &block : blocks)
+		m_stats.transient_bytes += block.requirements.size;
+
+	auto &slot { m_slots.at(m_slot) };
+	if (slot.placements != placements) {
+		destroy_slot(slot);
+
+		VmaAllocationCreateInfo alloc_ci {};
+		alloc_ci.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		for (auto const &block : blocks) {
+			VmaAllocation allocation {};
+			VK_CHECK(*m_logger,
+			    vmaAllocateMemory(m_vma, &block.requirements, &alloc_ci,
+			        &allocation, nullptr));
+			slot.blocks.emplace_back(allocation);
+		}
+
+		slot.images.resize(transients.size());
+		for (size_t i { 0 }; i < transients.size(); i++) {
+			slot.images[i] = {};
+			if (placements[i].block == ~0u)
+				continue;
+
+			VK_CHECK(*m_logger,
+			    vmaCreateAliasingImage(m_vma,
+			        slot.blocks.at(placements[i].block), &create_infos[i],
+			        &slot.images[i].image));
+
+			auto const view_ci { vkinit::imageview_create_info(
+				placements[i].desc.format, slot.images[i].image,
+				aspect_of(placements[i].desc.format)) };
+			VK_CHECK(*m_logger,
+			    vkCreateImageView(
+			        m_dev, &view_ci, nullptr, &slot.images[i].view));
+		}
+		slot.placements = std::move(placements);
+
+		m_logger->info(CATEGORY,
+		    "Render graph slot {}: {} transient images in {} KiB ({} KiB "
+		    "without aliasing)",
+		    m_slot, transients.size(), m_stats.transient_bytes / 1024,
+		    m_stats.unaliased_bytes / 1024);
+	}
+
+	for (size_t i { 0 }; i < transients.size(); i++) {
+		auto &image { m_images[transients[i]] };
+		image.image = slot.images[i].image;
+		image.view = slot.images[i].view;
+	}
+}
+
+auto RenderGraph::destroy_slot(SlotCache &slot) -> void
+{
+	for (auto const &image : slot.images) {
+		if (image.view != VK_NULL_HANDLE)
+			vkDestroyImageView(m_dev, image.view, nullptr);
+		if (image.image != VK_NULL_HANDLE)
+			vkDestroyImage(m_dev, image.image, nullptr);
+	}
+	for (auto allocation : slot.blocks)
+		vmaFreeMemory(m_vma, allocation);
+
+	slot = {};
+}
+
+} // namespace Lunar
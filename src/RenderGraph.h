@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan_core.h>
+
+#include "BarrierBuilder.h"
+#include "GpuProfiler.h"
+#include "JobSystem.h"
+#include "Logger.h"
+
+namespace Lunar {
+
+struct RGImage {
+	uint32_t index { ~0u };
+};
+
+struct RGBuffer {
+	uint32_t index { ~0u };
+};
+
+// A frame described as passes that declare how they use images and buffers.
+// Executing the graph drops passes whose results are never consumed, records
+// only the barriers the declared accesses require (batched per pass), and
+// places transient images with disjoint lifetimes in shared memory.
+//
+// The graph is rebuilt every frame; transient images are cached per frame
+// slot and only reallocated when the frame's transient layout changes.
+struct RenderGraph {
+	enum class Access : uint8_t {
+		Read,
+		Write,
+		ReadWrite,
+	};
+
+	struct ImageDesc {
+		VkFormat format;
+		VkExtent2D extent;
+		VkImageUsageFlags usage;
+
+		auto operator==(ImageDesc const &other) const -> bool
+		{
+			return format == other.format
+			    && extent.width == other.extent.width
+			    && extent.height == other.extent.height
+			    && usage == other.usage;
+		}
+	};
+
+	// Pass callbacks run concurrently on the job system's threads, each into
+	// its own command buffer.
+	using Execute
+	    = std::function<void(VkCommandBuffer cmd, RenderGraph const &graph)>;
+	// Returns an unrecorded primary command buffer owned by `thread`.
+	using CommandSource = std::function<VkCommandBuffer(uint32_t thread)>;
+
+	struct Pass {
+		auto read(RGImage image, VkImageLayout layout, SyncScope scope)
+		    -> Pass &;
+		auto write(RGImage image, VkImageLayout layout, SyncScope scope)
+		    -> Pass &;
+		// Write that depends on the previous contents, e.g. a LOAD_OP_LOAD
+		// attachment.
+		auto read_write(RGImage image, VkImageLayout layout, SyncScope scope)
+		    -> Pass &;
+		auto read(RGBuffer buffer, SyncScope scope) -> Pass &;
+		auto write(RGBuffer buffer, SyncScope scope) -> Pass &;
+		auto read_write(RGBuffer buffer, SyncScope scope) -> Pass &;
+		// Keeps the pass alive even if nothing consumes what it writes.
+		auto side_effect() -> Pass &;
+		auto execute(Execute &&function) -> Pass &;
+
+	private:
+		friend struct RenderGraph;
+
+		struct Use {
+			bool is_image;
+			uint32_t resource;
+			VkImageLayout layout;
+			SyncScope scope;
+			Access access;
+		};
+
+		std::string m_name;
+		std::vector<Use> m_uses;
+		Execute m_execute;
+		bool m_side_effect { false };
+		bool m_live { false };
+	};
+
+	struct Stats {
+		uint32_t passes { 0 };
+		uint32_t culled_passes { 0 };
+		uint32_t barriers { 0 };
+		VkDeviceSize transient_bytes { 0 };
+		VkDeviceSize unaliased_bytes { 0 };
+	};
+
+	auto init(Logger &logger, VkDevice dev, VmaAllocator allocator) -> void;
+	auto destroy() -> void;
+
+	// Starts a new graph for `frame_slot`. The slot's previous submission
+	// must have completed, since its transient images may be recreated.
+	auto begin(uint32_t frame_slot) -> void;
+
+	// `initial_scope` is the work that must finish before the first pass
+	// touches the image, e.g. the previous frame's last read.
+	auto import_image(VkImage image, VkImageView view, VkExtent2D extent,
+	    VkImageLayout initial_layout, SyncScope initial_scope,
+	    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT) -> RGImage;
+	auto import_buffer(VkBuffer buffer, SyncScope initial_scope) -> RGBuffer;
+	// Transient image whose contents only live for the duration of the frame.
+	auto create_image(ImageDesc const &desc) -> RGImage;
+	// Marks the image as a graph output, transitioned to `layout` at the end.
+	auto export_image(RGImage image, VkImageLayout layout, SyncScope scope)
+	    -> void;
+
+	auto add_pass(std::string name) -> Pass &;
+
+	// Culls, places transients and derives barriers on the calling thread,
+	// then records every live pass into its own primary command buffer in
+	// parallel. Returns the buffers in the order they must be submitted.
+	// With a profiler, each live pass, barriers included, is a scope named
+	// after it.
+	auto execute(JobSystem &jobs, CommandSource const &acquire,
+	    GpuProfiler *profiler = nullptr) -> std::vector<VkCommandBuffer>;
+
+	auto image(RGImage image) const -> VkImage
+	{
+		return m_images.at(image.index).image;
+	}
+	auto view(RGImage image) const -> VkImageView
+	{
+		return m_images.at(image.index).view;
+	}
+	auto extent(RGImage image) const -> VkExtent2D
+	{
+		return m_images.at(image.index).extent;
+	}
+	auto buffer(RGBuffer buffer) const -> VkBuffer
+	{
+		return m_buffers.at(buffer.index).buffer;
+	}
+
+	auto stats() const -> Stats const & { return m_stats; }
+
+private:
+	// Last write (or transition) that later accesses must depend on, and the
+	// stages that have already been made to wait for it.
+	struct State {
+		VkImageLayout layout;
+		SyncScope write;
+		SyncScope readers;
+	};
+
+	struct ImageResource {
+		VkImage image { VK_NULL_HANDLE };
+		VkImageView view { VK_NULL_HANDLE };
+		VkExtent2D extent {};
+		VkImageAspectFlags aspect { VK_IMAGE_ASPECT_COLOR_BIT };
+		State state {};
+		bool transient { false };
+		ImageDesc desc {};
+		bool exported { false };
+		VkImageLayout export_layout { VK_IMAGE_LAYOUT_UNDEFINED };
+		SyncScope export_scope {};
+		// Live pass range, used to place transients.
+		uint32_t first_use { ~0u };
+		uint32_t last_use { 0 };
+		uint32_t block { ~0u };
+		// Transient that used the same memory earlier in the frame.
+		uint32_t alias_of { ~0u };
+		bool touched { false };
+	};
+
+	struct BufferResource {
+		VkBuffer buffer { VK_NULL_HANDLE };
+		State state {};
+	};
+
+	struct Placement {
+		ImageDesc desc;
+		uint32_t block;
+
+		auto operator==(Placement const &) const -> bool = default;
+	};
+
+	struct TransientImage {
+		VkImage image;
+		VkImageView view;
+	};
+
+	struct Recording {
+		Pass *pass;
+		BarrierBuilder before;
+		BarrierBuilder after;
+		uint32_t scope { ~0u };
+	};
+
+	struct SlotCache {
+		std::vector<Placement> placements;
+		std::vector<VmaAllocation> blocks;
+		std::vector<TransientImage> images;
+	};
+
+	// Moves `state` past one access. Returns true and fills `src` when the
+	// access has to wait on earlier work.
+	static auto advance(State &state, VkImageLayout layout, SyncScope scope,
+	    bool writes, SyncScope &src) -> bool;
+	auto cull() -> void;
+	auto place_transients() -> void;
+	auto destroy_slot(SlotCache &slot) -> void;
+
+	Logger *m_logger { nullptr };
+	VkDevice m_dev { VK_NULL_HANDLE };
+	VmaAllocator m_vma { nullptr };
+
+	uint32_t m_slot { 0 };
+	std::vector<SlotCache> m_slots;
+
+	std::deque<Pass> m_passes;
+	std::vector<ImageResource> m_images;
+	std::vector<BufferResource> m_buffers;
+	Stats m_stats {};
+};
+
+} // namespace Lunar
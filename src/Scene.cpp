@@ -0,0 +1,24 @@
+#include "Scene.h"
+
+namespace Lunar {
+
+auto Scene::add(std::shared_ptr<Mesh> const &mesh, smath::Mat4 const &transform)
+    -> void
+{
+	for (uint32_t surface { 0 }; surface < mesh->surfaces.size(); surface++) {
+		m_instances.emplace_back(Instance {
+		    .mesh = mesh,
+		    .surface = surface,
+		    .transform = transform,
+		});
+	}
+	m_generation++;
+}
+
+auto Scene::clear() -> void
+{
+	m_instances.clear();
+	m_generation++;
+}
+
+} // namespace Lunar
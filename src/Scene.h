@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <smath.hpp>
+
+#include "Loader.h"
+
+namespace Lunar {
+
+// Flat list of mesh surfaces to draw. The renderer mirrors it into a GPU
+// instance table and only rebuilds that table when `generation()` changes,
+// so a static scene costs nothing per frame on the CPU.
+struct Scene {
+	struct Instance {
+		std::shared_ptr<Mesh> mesh;
+		uint32_t surface;
+		smath::Mat4 transform;
+	};
+
+	// Adds one instance per surface of `mesh`.
+	auto add(std::shared_ptr<Mesh> const &mesh, smath::Mat4 const &transform)
+	    -> void;
+	auto clear() -> void;
+
+	auto instances() const -> std::vector<Instance> const &
+	{
+		return m_instances;
+	}
+	auto generation() const -> uint64_t { return m_generation; }
+
+private:
+	std::vector<Instance> m_instances;
+	uint64_t m_generation { 0 };
+};
+
+} // namespace Lunar
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+// SPIR-V compiled by shaders/meson.build and embedded into the binary. Kept in
+// one place so the pipeline cache can key itself on their contents.
+namespace Lunar::shaders {
+
+alignas(4) inline constexpr uint8_t cull_comp[] {
+#embed "cull_comp.spv"
+};
+alignas(4) inline constexpr uint8_t fullscreen_vert[] {
+#embed "fullscreen_vert.spv"
+};
+alignas(4) inline constexpr uint8_t gradient_comp[] {
+#embed "gradient_comp.spv"
+};
+alignas(4) inline constexpr uint8_t mesh_indirect_vert[] {
+#embed "mesh_indirect_vert.spv"
+};
+alignas(4) inline constexpr uint8_t meshlet_mesh[] {
+#embed "meshlet_mesh.spv"
+};
+alignas(4) inline constexpr uint8_t meshlet_task[] {
+#embed "meshlet_task.spv"
+};
+alignas(4) inline constexpr uint8_t triangle_frag[] {
+#embed "triangle_frag.spv"
+};
+alignas(4) inline constexpr uint8_t triangle_vert[] {
+#embed "triangle_vert.spv"
+};
+alignas(4) inline constexpr uint8_t triangle_mesh_frag[] {
+#embed "triangle_mesh_frag.spv"
+};
+alignas(4) inline constexpr uint8_t triangle_mesh_vert[] {
+#embed "triangle_mesh_vert.spv"
+};
+alignas(4) inline constexpr uint8_t upscale_frag[] {
+#embed "upscale_frag.spv"
+};
+
+inline constexpr std::array<std::span<uint8_t const>, 11> all {
+	cull_comp,
+	fullscreen_vert,
+	gradient_comp,
+	mesh_indirect_vert,
+	meshlet_mesh,
+	meshlet_task,
+	triangle_frag,
+	triangle_vert,
+	triangle_mesh_frag,
+	triangle_mesh_vert,
+	upscale_frag,
+};
+
+} // namespace Lunar::shaders
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
 #include <smath.hpp>
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan_core.h>
@@ -22,13 +29,48 @@ struct AllocatedBuffer {
 	VmaAllocationInfo info;
 };
 
+// One per recording thread and frame slot. The pool is reset as a whole once
+// the slot's previous submission has completed; command buffers are kept and
+// handed out again in order.
+struct ThreadCommandPool {
+	VkCommandPool pool { VK_NULL_HANDLE };
+	std::vector<VkCommandBuffer> buffers;
+	uint32_t used { 0 };
+};
+
 struct FrameData {
-	VkCommandPool command_pool;
-	VkCommandBuffer main_command_buffer;
+	std::vector<ThreadCommandPool> command_pools;
 	VkSemaphore swapchain_semaphore;
-	VkFence render_fence;
+	// Frame timeline value signaled by the last submission from this slot.
+	// The slot's resources may be reused once the timeline reaches it.
+	uint64_t timeline_value { 0 };
+
+	// Resolution scale the slot's last frame rendered at.
+	float resolution_scale { 1.0f };
+	double record_ms { 0.0 };
+	std::chrono::steady_clock::time_point submit_time {};
 
-	DeletionQueue deletion_queue;
+	// GPU-driven scene data. The instance table is host-visible and only
+	// rewritten when the scene or the geometry buffer layout changed since
+	// this frame slot last used it.
+	AllocatedBuffer instance_buffer {};
+	AllocatedBuffer draw_buffer {};
+	AllocatedBuffer draw_count_buffer {};
+	uint32_t instance_capacity { 0 };
+	uint32_t instance_count { 0 };
+	// Instances are sorted by index type; this many 16-bit ones come first,
+	// and each group has its own draw list and count.
+	uint32_t short_index_instances { 0 };
+	// Task shader work for the meshlet path: one (instance, first meshlet)
+	// pair per MESHLET_TASK_SIZE meshlets. Only filled with mesh shading.
+	AllocatedBuffer meshlet_task_buffer {};
+	uint32_t meshlet_task_capacity { 0 };
+	uint32_t meshlet_task_count { 0 };
+	// Instances whose mesh has meshlets; the meshlet path is only taken
+	// when that is all of them.
+	uint32_t meshlet_instances { 0 };
+	uint64_t scene_generation { ~0ull };
+	uint64_t geometry_generation { ~0ull };
 };
 
 struct Vertex {
@@ -39,9 +81,65 @@ struct Vertex {
 	smath::Vec4 color;
 };
 
-struct GPUMeshBuffers {
-	AllocatedBuffer index_buffer, vertex_buffer;
-	VkDeviceAddress vertex_buffer_address;
+// 20-byte vertex for large meshes, decoded in the vertex shader. Positions
+// are unorm16 within the mesh's bounding box (see Mesh::position_offset),
+// normals are octahedral snorm16, texture coordinates half floats and
+// colors unorm8.
+struct CompactVertex {
+	uint16_t position[3];
+	uint16_t padding;
+	int16_t normal[2];
+	uint16_t uv[2];
+	uint8_t color[4];
+};
+static_assert(sizeof(CompactVertex) == 20);
+
+// Mirrored by the VERTEX_FORMAT_* constants in the mesh vertex shaders.
+enum class VertexFormat : uint32_t {
+	Full = 0,
+	Compact = 1,
+};
+
+constexpr auto vertex_stride(VertexFormat format) -> size_t
+{
+	return format == VertexFormat::Compact ? sizeof(CompactVertex)
+	                                       : sizeof(Vertex);
+}
+
+// Timeline value of the upload batch that carries a piece of data. The data is
+// safe to read on the GPU once the upload timeline reaches this value.
+struct UploadTicket {
+	uint64_t value { 0 };
+};
+
+// Levels of detail per surface, including the full one.
+constexpr uint32_t MAX_LODS { 4 };
+
+// Index into the GeometryBuffer's range table.
+using GeometryHandle = uint32_t;
+
+// CPU-side mesh data handed to the renderer for upload. `indices` is raw
+// index data; each surface of the mesh says where its own indices start and
+// whether they are 16 or 32 bits wide.
+struct MeshData {
+	std::span<std::byte const> indices;
+	// Packed vertices of `vertex_format`.
+	std::span<std::byte const> vertices;
+	VertexFormat vertex_format { VertexFormat::Full };
+	// One MeshletBlock per surface level of detail, each starting 16-byte
+	// aligned; may be empty.
+	std::span<std::byte const> meshlets {};
+};
+
+// A mesh's vertex and index ranges inside the shared geometry buffer.
+struct GPUMesh {
+	GeometryHandle vertices;
+	GeometryHandle indices;
+	uint32_t vertex_count;
+	uint32_t index_bytes;
+	// Empty for meshes uploaded without meshlets.
+	std::optional<GeometryHandle> meshlets;
+	UploadTicket upload_ticket;
 };
 
 } // namespace Lunar
@@ -0,0 +1,339 @@
+#include "UploadQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Util.h"
+
+namespace Lunar {
+
+constexpr auto CATEGORY { Logger::Category::Renderer };
+
+static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+static constexpr VkPipelineStageFlags2 UPLOAD_CONSUMER_STAGES
+    = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT
+    | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT
+    | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+static constexpr VkAccessFlags2 UPLOAD_CONSUMER_ACCESS
+    = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT
+    | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+static auto align_up(uint64_t value, uint64_t alignment) -> uint64_t
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+auto UploadQueue::init(Logger &logger, InitInfo const &info) -> void
+{
+	m_logger = &logger;
+	m_dev = info.dev;
+	m_allocator = info.allocator;
+	m_queue = info.queue;
+	m_queue_family = info.queue_family;
+	m_graphics_queue_family = info.graphics_queue_family;
+	m_staging_size = info.staging_size;
+
+	VkCommandPoolCreateInfo pool_ci {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+		    | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = m_queue_family,
+	};
+	VK_CHECK(*m_logger,
+	    vkCreateCommandPool(m_dev, &pool_ci, nullptr, &m_command_pool));
+
+	VkSemaphoreTypeCreateInfo timeline_ci {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.pNext = nullptr,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+	VkSemaphoreCreateInfo semaphore_ci {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &timeline_ci,
+		.flags = 0,
+	};
+	VK_CHECK(*m_logger,
+	    vkCreateSemaphore(m_dev, &semaphore_ci, nullptr, &m_timeline));
+
+	VkBufferCreateInfo buffer_ci {};
+	buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_ci.size = m_staging_size;
+	buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo alloc_ci {};
+	alloc_ci.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+	alloc_ci.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT
+	    | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+	VK_CHECK(*m_logger,
+	    vmaCreateBuffer(m_allocator, &buffer_ci, &alloc_ci, &m_staging.buffer,
+	        &m_staging.allocation, &m_staging.info));
+	m_staging_data = static_cast<std::byte *>(m_staging.info.pMappedData);
+
+	m_logger->debug(CATEGORY,
+	    "Upload queue ready: family {} ({}), {} MiB staging", m_queue_family,
+	    dedicated() ? "dedicated transfer" : "shared graphics",
+	    m_staging_size / (1024 * 1024));
+}
+
+auto UploadQueue::destroy() -> void
+{
+	if (m_dev == VK_NULL_HANDLE)
+		return;
+
+	flush();
+	wait({ m_submitted_value });
+
+	vmaDestroyBuffer(m_allocator, m_staging.buffer, m_staging.allocation);
+	vkDestroySemaphore(m_dev, m_timeline, nullptr);
+	vkDestroyCommandPool(m_dev, m_command_pool, nullptr);
+
+	m_in_flight.clear();
+	m_free_command_buffers.clear();
+	m_pending_acquires.clear();
+	m_dev = VK_NULL_HANDLE;
+}
+
+auto UploadQueue::enqueue_buffer(VkBuffer dst, VkDeviceSize dst_offset,
+    std::span<std::byte const> data) -> UploadTicket
+{
+	// Keep individual chunks well below the arena size so that one large
+	// upload can stream through the ring while earlier chunks are copied.
+	VkDeviceSize const max_chunk { m_staging_size / 4 };
+
+	VkDeviceSize done { 0 };
+	while (done < data.size()) {
+		auto const chunk { std::min<VkDeviceSize>(
+			max_chunk, data.size() - done) };
+		auto const staging_offset { allocate_staging(chunk) };
+
+		std::memcpy(m_staging_data + staging_offset, data.data() + done, chunk);
+		vmaFlushAllocation(
+		    m_allocator, m_staging.allocation, staging_offset, chunk);
+
+		m_pending.emplace_back(PendingCopy {
+		    .dst = dst,
+		    .region = {
+		        .srcOffset = staging_offset,
+		        .dstOffset = dst_offset + done,
+		        .size = chunk,
+		    },
+		});
+
+		done += chunk;
+	}
+
+	return { m_submitted_value + (m_pending.empty() ? 0 : 1) };
+}
+
+auto UploadQueue::flush() -> UploadTicket
+{
+	if (m_pending.empty())
+		return { m_submitted_value };
+
+	retire_completed();
+
+	auto cmd { acquire_command_buffer() };
+	VkCommandBufferBeginInfo begin_info {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = nullptr,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = nullptr,
+	};
+	VK_CHECK(*m_logger, vkBeginCommandBuffer(cmd, &begin_info));
+
+	std::stable_sort(m_pending.begin(), m_pending.end(),
+	    [](PendingCopy const &a, PendingCopy const &b) {
+		    return a.dst < b.dst;
+	    });
+
+	std::vector<VkBufferCopy> regions;
+	std::vector<VkBufferMemoryBarrier2> releases;
+	for (size_t i { 0 }; i < m_pending.size();) {
+		auto const dst { m_pending[i].dst };
+
+		regions.clear();
+		for (; i < m_pending.size() && m_pending[i].dst == dst; i++) {
+			regions.emplace_back(m_pending[i].region);
+		}
+		vkCmdCopyBuffer(cmd, m_staging.buffer, dst,
+		    static_cast<uint32_t>(regions.size()), regions.data());
+
+		if (!dedicated())
+			continue;
+
+		for (auto const &region : regions) {
+			VkBufferMemoryBarrier2 barrier {
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+				.pNext = nullptr,
+				.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+				.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_2_NONE,
+				.dstAccessMask = VK_ACCESS_2_NONE,
+				.srcQueueFamilyIndex = m_queue_family,
+				.dstQueueFamilyIndex = m_graphics_queue_family,
+				.buffer = dst,
+				.offset = region.dstOffset,
+				.size = region.size,
+			};
+			releases.emplace_back(barrier);
+
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+			barrier.srcAccessMask = VK_ACCESS_2_NONE;
+			barrier.dstStageMask = UPLOAD_CONSUMER_STAGES;
+			barrier.dstAccessMask = UPLOAD_CONSUMER_ACCESS;
+			m_pending_acquires.emplace_back(barrier);
+		}
+	}
+
+	if (!releases.empty()) {
+		VkDependencyInfo dep_info {};
+		dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dep_info.bufferMemoryBarrierCount
+		    = static_cast<uint32_t>(releases.size());
+		dep_info.pBufferMemoryBarriers = releases.data();
+		vkCmdPipelineBarrier2(cmd, &dep_info);
+	}
+
+	VK_CHECK(*m_logger, vkEndCommandBuffer(cmd));
+
+	auto const value { m_submitted_value + 1 };
+	auto cmd_info { vkinit::command_buffer_submit_info(cmd) };
+	auto signal_info { vkinit::semaphore_submit_info(
+		VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, m_timeline) };
+	signal_info.value = value;
+	auto submit { vkinit::submit_info2(&cmd_info, nullptr, &signal_info) };
+	VK_CHECK(*m_logger, vkQueueSubmit2(m_queue, 1, &submit, VK_NULL_HANDLE));
+
+	m_submitted_value = value;
+	m_in_flight.emplace_back(InFlightBatch {
+	    .value = value,
+	    .ring_end = m_ring_head,
+	    .cmd = cmd,
+	});
+	m_pending.clear();
+
+	return { value };
+}
+
+auto UploadQueue::completed_value() const -> uint64_t
+{
+	uint64_t value { 0 };
+	VK_CHECK(*m_logger, vkGetSemaphoreCounterValue(m_dev, m_timeline, &value));
+	return value;
+}
+
+auto UploadQueue::wait(UploadTicket ticket) const -> void
+{
+	if (ticket.value == 0)
+		return;
+
+	VkSemaphoreWaitInfo wait_info {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.semaphoreCount = 1,
+		.pSemaphores = &m_timeline,
+		.pValues = &ticket.value,
+	};
+	VK_CHECK(*m_logger, vkWaitSemaphores(m_dev, &wait_info, UINT64_MAX));
+}
+
+auto UploadQueue::record_acquires(VkCommandBuffer cmd) -> void
+{
+	if (m_pending_acquires.empty())
+		return;
+
+	VkDependencyInfo dep_info {};
+	dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dep_info.bufferMemoryBarrierCount
+	    = static_cast<uint32_t>(m_pending_acquires.size());
+	dep_info.pBufferMemoryBarriers = m_pending_acquires.data();
+	vkCmdPipelineBarrier2(cmd, &dep_info);
+
+	m_pending_acquires.clear();
+}
+
+auto UploadQueue::wait_info() const -> VkSemaphoreSubmitInfo
+{
+	auto info { vkinit::semaphore_submit_info(
+		UPLOAD_CONSUMER_STAGES, m_timeline) };
+	info.value = m_submitted_value;
+	return info;
+}
+
+auto UploadQueue::allocate_staging(VkDeviceSize size) -> VkDeviceSize
+{
+	size = align_up(size, STAGING_ALIGNMENT);
+
+	for (;;) {
+		if (m_ring_head == m_ring_tail) {
+			// Ring is empty; restart at the beginning of the arena.
+			m_ring_head = m_ring_tail = align_up(m_ring_head, m_staging_size);
+		}
+
+		auto start { m_ring_head };
+		auto const physical { start % m_staging_size };
+		if (physical + size > m_staging_size)
+			start += m_staging_size - physical;
+
+		if (start + size - m_ring_tail <= m_staging_size) {
+			m_ring_head = start + size;
+			return start % m_staging_size;
+		}
+
+		retire_completed();
+		if (m_ring_head == m_ring_tail)
+			continue;
+
+		// Out of staging space: push what we have and wait for the oldest
+		// batch still holding part of the ring.
+		flush();
+		wait({ m_in_flight.front().value });
+		retire_completed();
+	}
+}
+
+auto UploadQueue::retire_completed() -> void
+{
+	if (m_in_flight.empty())
+		return;
+
+	auto const completed { completed_value() };
+	while (!m_in_flight.empty() && m_in_flight.front().value <= completed) {
+		m_ring_tail = m_in_flight.front().ring_end;
+		m_free_command_buffers.emplace_back(m_in_flight.front().cmd);
+		m_in_flight.pop_front();
+	}
+
+	// Copies still waiting for a flush keep their space reserved.
+	if (m_in_flight.empty() && m_pending.empty())
+		m_ring_tail = m_ring_head;
+}
+
+auto UploadQueue::acquire_command_buffer() -> VkCommandBuffer
+{
+	if (!m_free_command_buffers.empty()) {
+		auto cmd { m_free_command_buffers.back() };
+		m_free_command_buffers.pop_back();
+		VK_CHECK(*m_logger, vkResetCommandBuffer(cmd, 0));
+		return cmd;
+	}
+
+	VkCommandBufferAllocateInfo ai {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.pNext = nullptr,
+		.commandPool = m_command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+	VkCommandBuffer cmd;
+	VK_CHECK(*m_logger, vkAllocateCommandBuffers(m_dev, &ai, &cmd));
+	return cmd;
+}
+
+} // namespace Lunar
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan_core.h>
+
+#include "Logger.h"
+#include "Types.h"
+
+namespace Lunar {
+
+// Streams data into device-local buffers through a persistently mapped,
+// ring-allocated staging arena. Copies are batched and submitted on the
+// transfer queue (when the device exposes a separate family), and every batch
+// signals a timeline semaphore so callers can poll or wait on their data.
+struct UploadQueue {
+	struct InitInfo {
+		VkDevice dev;
+		VmaAllocator allocator;
+		VkQueue queue;
+		uint32_t queue_family;
+		uint32_t graphics_queue_family;
+		VkDeviceSize staging_size { 64ull * 1024 * 1024 };
+	};
+
+	auto init(Logger &logger, InitInfo const &info) -> void;
+	auto destroy() -> void;
+
+	// Copies `data` into `dst` at `dst_offset` as part of the open batch. The
+	// returned ticket completes once the batch has been flushed and executed.
+	auto enqueue_buffer(VkBuffer dst, VkDeviceSize dst_offset,
+	    std::span<std::byte const> data) -> UploadTicket;
+	// Submits the open batch, if any. Returns the ticket of the most recent
+	// submission.
+	auto flush() -> UploadTicket;
+
+	auto completed_value() const -> uint64_t;
+	auto is_complete(UploadTicket ticket) const -> bool
+	{
+		return ticket.value <= completed_value();
+	}
+	auto wait(UploadTicket ticket) const -> void;
+
+	// Records the graphics-side half of the queue family ownership transfers
+	// for everything flushed since the last call. Must be followed by a submit
+	// that waits on `wait_info()`.
+	auto record_acquires(VkCommandBuffer cmd) -> void;
+	auto wait_info() const -> VkSemaphoreSubmitInfo;
+
+	auto semaphore() const -> VkSemaphore { return m_timeline; }
+	auto dedicated() const -> bool
+	{
+		return m_queue_family != m_graphics_queue_family;
+	}
+
+private:
+	struct PendingCopy {
+		VkBuffer dst;
+		VkBufferCopy region;
+	};
+
+	struct InFlightBatch {
+		uint64_t value;
+		uint64_t ring_end;
+		VkCommandBuffer cmd;
+	};
+
+	auto allocate_staging(VkDeviceSize size) -> VkDeviceSize;
+	auto retire_completed() -> void;
+	auto acquire_command_buffer() -> VkCommandBuffer;
+
+	Logger *m_logger { nullptr };
+	VkDevice m_dev { VK_NULL_HANDLE };
+	VmaAllocator m_allocator { nullptr };
+	VkQueue m_queue { VK_NULL_HANDLE };
+	uint32_t m_queue_family { 0 };
+	uint32_t m_graphics_queue_family { 0 };
+
+	VkCommandPool m_command_pool { VK_NULL_HANDLE };
+	std::vector<VkCommandBuffer> m_free_command_buffers;
+
+	VkSemaphore m_timeline { VK_NULL_HANDLE };
+	uint64_t m_submitted_value { 0 };
+
+	AllocatedBuffer m_staging {};
+	std::byte *m_staging_data { nullptr };
+	VkDeviceSize m_staging_size { 0 };
+	// Monotonic byte positions into the ring; the physical offset is the
+	// position modulo the staging size.
+	uint64_t m_ring_head { 0 };
+	uint64_t m_ring_tail { 0 };
+
+	std::vector<PendingCopy> m_pending;
+	std::deque<InFlightBatch> m_in_flight;
+	std::vector<VkBufferMemoryBarrier2> m_pending_acquires;
+};
+
+} // namespace Lunar
@@ -4,40 +4,6 @@
 
 namespace vkutil {
 
-auto transition_image(VkCommandBuffer cmd, VkImage image,
-    VkImageLayout current_layout, VkImageLayout new_layout) -> void
-{
-	VkImageAspectFlags aspect_mask
-	    = (new_layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
-	    ? VK_IMAGE_ASPECT_DEPTH_BIT
-	    : VK_IMAGE_ASPECT_COLOR_BIT;
-
-	VkImageMemoryBarrier image_barrier {
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.pNext = nullptr,
-
-		.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
-		.dstAccessMask
-		= VK_ACCESS_MEMORY_WRITE_BIT | VK_ACCESS_MEMORY_READ_BIT,
-		.oldLayout = current_layout,
-		.newLayout = new_layout,
-		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.image = image,
-		.subresourceRange = {
-			.aspectMask = aspect_mask,
-			.baseMipLevel = 0,
-			.levelCount = 1,
-			.baseArrayLayer = 0,
-			.layerCount = 1,
-		},
-	};
-
-	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-	    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1,
-	    &image_barrier);
-}
-
 auto copy_image_to_image(VkCommandBuffer cmd, VkImage source,
     VkImage destination, VkExtent2D src_size, VkExtent2D dst_size) -> void
 {
@@ -77,8 +43,8 @@ auto copy_image_to_image(VkCommandBuffer cmd, VkImage source,
 	vkCmdBlitImage2(cmd, &blit_info);
 }
 
-auto load_shader_module(std::span<uint8_t> spirv_data, VkDevice device,
-    VkShaderModule *out_shader_module) -> bool
+auto load_shader_module(std::span<uint8_t const> spirv_data,
+    VkDevice device, VkShaderModule *out_shader_module) -> bool
 {
 	if (!device || !out_shader_module)
 		return false;
@@ -209,6 +175,23 @@ auto attachment_info(VkImageView view, VkClearValue *clear,
 	return color_at;
 }
 
+auto depth_attachment_info(VkImageView view, VkImageLayout layout)
+    -> VkRenderingAttachmentInfo
+{
+	VkRenderingAttachmentInfo depth_at {};
+	depth_at.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depth_at.pNext = nullptr;
+
+	depth_at.imageView = view;
+	depth_at.imageLayout = layout;
+	depth_at.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	// Depth only lives for the frame, so there is nothing to write back.
+	depth_at.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depth_at.clearValue.depthStencil.depth = 1.0f;
+
+	return depth_at;
+}
+
 auto pipeline_shader_stage(VkShaderStageFlagBits stage, VkShaderModule module)
     -> VkPipelineShaderStageCreateInfo
 {
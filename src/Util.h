@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <span>
 
 #include <vulkan/vk_enum_string_helper.h>
@@ -36,14 +37,31 @@ template<typename F> privDefer<F> defer_func(F f) { return privDefer<F>(f); }
 		} \
 	} while (0)
 
+namespace Lunar {
+
+constexpr uint64_t FNV1A_SEED { 0xcbf29ce484222325ull };
+
+// 64-bit FNV-1a, chainable through `seed`. For cache keys and hash tables,
+// not for anything adversarial.
+constexpr auto fnv1a(std::span<uint8_t const> data, uint64_t seed = FNV1A_SEED)
+    -> uint64_t
+{
+	auto value { seed };
+	for (auto const byte : data) {
+		value ^= byte;
+		value *= 0x100000001b3ull;
+	}
+	return value;
+}
+
+} // namespace Lunar
+
 namespace vkutil {
 
-auto transition_image(VkCommandBuffer cmd, VkImage image,
-    VkImageLayout current_layout, VkImageLayout new_layout) -> void;
 auto copy_image_to_image(VkCommandBuffer cmd, VkImage source,
     VkImage destination, VkExtent2D src_size, VkExtent2D dst_size) -> void;
-auto load_shader_module(std::span<uint8_t> spirv_data, VkDevice device,
-    VkShaderModule *out_shader_module) -> bool;
+auto load_shader_module(std::span<uint8_t const> spirv_data,
+    VkDevice device, VkShaderModule *out_shader_module) -> bool;
 
 } // namespace vkutil
 
@@ -63,6 +81,9 @@ auto submit_info2(VkCommandBufferSubmitInfo *cmd_info,
 auto attachment_info(VkImageView view, VkClearValue *clear,
     VkImageLayout layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
     -> VkRenderingAttachmentInfo;
+auto depth_attachment_info(VkImageView view,
+    VkImageLayout layout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
+    -> VkRenderingAttachmentInfo;
 auto pipeline_shader_stage(VkShaderStageFlagBits stage, VkShaderModule module)
     -> VkPipelineShaderStageCreateInfo;
 auto render_info(VkExtent2D extent, VkRenderingAttachmentInfo const *color_att,
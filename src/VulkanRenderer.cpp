@@ -1,10 +1,15 @@
 #include "VulkanRenderer.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <format>
 #include <iostream>
+#include <limits>
 #include <print>
 #include <stdexcept>
+#include <thread>
 
 #include <SDL3/SDL_video.h>
 #include <SDL3/SDL_vulkan.h>
@@ -13,41 +18,90 @@
 #include <imgui_impl_vulkan.h>
 #include <vulkan/vulkan_core.h>
 
+#include "BarrierBuilder.h"
 #include "DescriptorLayoutBuilder.h"
 #include "GraphicsPipelineBuilder.h"
+#include "Meshlets.h"
+#include "Shaders.h"
 #include "Util.h"
 
 namespace Lunar {
 
-VulkanRenderer::VulkanRenderer(SDL_Window *window, Logger &logger)
+constexpr auto CATEGORY { Logger::Category::Renderer };
+
+// Weight of a new sample in the frame pacing averages.
+constexpr double AVERAGE_WEIGHT { 0.1 };
+// Slack the pacer leaves before the predicted vblank for scheduling
+// jitter and the compositor.
+constexpr double PACING_MARGIN_MS { 2.0 };
+// Longest a single present is waited for; presents to a swapchain that
+// went out of date may never complete.
+constexpr uint64_t PRESENT_TIMEOUT_NS { 100'000'000 };
+
+// Jumps to slower frames at once and decays slowly, so the pacer errs
+// towards starting frames early.
+static auto track_work(double estimate_ms, double sample_ms) -> double
+{
+	if (sample_ms > estimate_ms)
+		return sample_ms;
+	return estimate_ms + (sample_ms - estimate_ms) * AVERAGE_WEIGHT;
+}
+
+VulkanRenderer::VulkanRenderer(
+    SDL_Window *window, Logger &logger, RendererConfig const &config)
     : m_window(window)
+    , m_headless(config.headless)
+    , m_lod_pixel_error(config.lod_pixel_error)
+    , m_mesh_cache_directory(config.mesh_cache_directory)
     , m_logger(logger)
 {
-	if (m_window == nullptr) {
+	if (m_window == nullptr && !m_headless) {
 		throw std::runtime_error("VulkanRenderer requires a valid window");
 	}
 
-	vk_init();
-	swapchain_init();
+	set_frames_in_flight(config.frames_in_flight);
+	m_vk.desired_present_mode = config.present_mode;
+	m_vk.low_latency = config.low_latency;
+	m_vk.jobs.init(config.recording_threads > 0 ? config.recording_threads - 1
+	                                            : 0);
+
+	vk_init(config.validation, config.mesh_shading, config.pipeline_statistics);
+	swapchain_init(config.headless_extent, config.max_draw_extent);
 	commands_init();
 	sync_init();
+	profiler_init(config.gpu_profiling);
+	uploads_init();
+	geometry_init();
+	render_graph_init();
 	descriptors_init();
+	pipeline_cache_init(config.pipeline_cache_path);
 	pipelines_init();
+	dynamic_resolution_init(config);
 	default_data_init();
-	imgui_init();
+	if (!m_headless)
+		imgui_init();
 }
 
 VulkanRenderer::~VulkanRenderer()
 {
 	vkDeviceWaitIdle(m_vkb.dev);
 
+	m_vk.jobs.destroy();
+	m_vk.retired.flush();
+	collect_present_fences(true);
+
 	for (auto &frame_data : m_vk.frames) {
-		vkDestroyCommandPool(m_vkb.dev, frame_data.command_pool, nullptr);
+		for (auto &thread_pool : frame_data.command_pools)
+			vkDestroyCommandPool(m_vkb.dev, thread_pool.pool, nullptr);
 
-		vkDestroyFence(m_vkb.dev, frame_data.render_fence, nullptr);
 		vkDestroySemaphore(m_vkb.dev, frame_data.swapchain_semaphore, nullptr);
 
-		frame_data.deletion_queue.flush();
+		for (auto *buffer : { &frame_data.instance_buffer,
+		         &frame_data.draw_buffer, &frame_data.draw_count_buffer,
+		         &frame_data.meshlet_task_buffer }) {
+			if (buffer->buffer != VK_NULL_HANDLE)
+				destroy_buffer(*buffer);
+		}
 	}
 
 	destroy_swapchain();
@@ -55,7 +109,8 @@ VulkanRenderer::~VulkanRenderer()
 
 	m_vk.deletion_queue.flush();
 
-	SDL_Vulkan_DestroySurface(m_vkb.instance, m_vk.surface, nullptr);
+	if (m_vk.surface != VK_NULL_HANDLE)
+		SDL_Vulkan_DestroySurface(m_vkb.instance, m_vk.surface, nullptr);
 
 	vkb::destroy_device(m_vkb.dev);
 	vkb::destroy_instance(m_vkb.instance);
@@ -63,14 +118,40 @@ VulkanRenderer::~VulkanRenderer()
 
 auto VulkanRenderer::resize(uint32_t width, uint32_t height) -> void
 {
-	recreate_swapchain(width, height);
+	if (m_headless) {
+		m_vk.headless_extent = VkExtent2D { width, height };
+		ensure_draw_image(m_vk.headless_extent);
+		return;
+	}
+
+	// Applied by the next render(), so the burst of resize events of an
+	// interactive drag recreates the swapchain once per frame at most.
+	m_vk.pending_extent = VkExtent2D { width, height };
+}
+
+auto VulkanRenderer::set_frames_in_flight(uint32_t count) -> void
+{
+	m_vk.frames_in_flight = std::clamp(count, 1u, MAX_FRAMES_IN_FLIGHT);
+}
+
+auto VulkanRenderer::set_present_mode(PresentMode mode) -> void
+{
+	if (mode == m_vk.desired_present_mode)
+		return;
+	m_vk.desired_present_mode = mode;
+
+	// Replaced from the old swapchain by the next render(), like a resize.
+	// Without a swapchain, the next one is created with the new mode.
+	if (!m_headless && !m_vk.pending_extent
+	    && m_vk.swapchain != VK_NULL_HANDLE)
+		m_vk.pending_extent = m_vk.swapchain_extent;
 }
 
 auto VulkanRenderer::immediate_submit(
     std::function<void(VkCommandBuffer cmd)> &&function) -> void
 {
 	VK_CHECK(m_logger, vkResetFences(m_vkb.dev, 1, &m_vk.imm_fence));
-	VK_CHECK(m_logger, vkResetCommandBuffer(m_vk.imm_command_buffer, 0));
+	VK_CHECK(m_logger, vkResetCommandPool(m_vkb.dev, m_vk.imm_command_pool, 0));
 
 	auto cmd { m_vk.imm_command_buffer };
 	VkCommandBufferBeginInfo cmd_begin_info {
@@ -94,12 +175,14 @@ auto VulkanRenderer::immediate_submit(
 	    vkWaitForFences(m_vkb.dev, 1, &m_vk.imm_fence, true, 9999999999));
 }
 
-auto VulkanRenderer::vk_init() -> void
+auto VulkanRenderer::vk_init(
+    bool validation, bool mesh_shading, bool pipeline_statistics) -> void
 {
 	vkb::InstanceBuilder instance_builder {};
 	instance_builder
 	    .enable_extension(VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME)
-	    .request_validation_layers()
+	    .request_validation_layers(validation)
+	    .set_headless(m_headless)
 	    .set_app_name("Lunar")
 	    .set_engine_name("Lunar")
 	    .require_api_version(1, 3, 0)
@@ -123,13 +206,25 @@ auto VulkanRenderer::vk_init() -> void
 			        level = Logger::Level::Info;
 		        }
 
-		        renderer->m_logger.log(level,
-		            std::format("[Vulkan] [{}] {}",
-		                vkb::to_string_message_type(message_type),
-		                callback_data->pMessage));
+		        renderer->m_logger.log(Logger::Category::Vulkan, level,
+		            "[Vulkan] [{}] {}",
+		            vkb::to_string_message_type(message_type),
+		            callback_data->pMessage);
 
 		        return VK_FALSE;
 	        });
+	// Required by VK_EXT_swapchain_maintenance1, for present fences.
+	auto const system_info { vkb::SystemInfo::get_system_info() };
+	auto const surface_maintenance { !m_headless && system_info
+		&& system_info->is_extension_available(
+		    VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME)
+		&& system_info->is_extension_available(
+		    VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME) };
+	if (surface_maintenance) {
+		instance_builder
+		    .enable_extension(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME)
+		    .enable_extension(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+	}
 	auto const instance_builder_ret { instance_builder.build() };
 	if (!instance_builder_ret) {
 		std::println(std::cerr, "Failed to create Vulkan instance. Error: {}",
@@ -139,9 +234,10 @@ auto VulkanRenderer::vk_init() -> void
 
 	m_vkb.instance = instance_builder_ret.value();
 
-	if (!SDL_Vulkan_CreateSurface(
+	if (!m_headless
+	    && !SDL_Vulkan_CreateSurface(
 	        m_window, m_vkb.instance, nullptr, &m_vk.surface)) {
-		m_logger.err("Failed to create vulkan surface");
+		m_logger.err(CATEGORY, "Failed to create vulkan surface");
 		throw std::runtime_error("App init fail");
 	}
 
@@ -151,12 +247,19 @@ auto VulkanRenderer::vk_init() -> void
 	features_13.pNext = nullptr;
 	features_13.synchronization2 = VK_TRUE;
 	features_13.dynamicRendering = VK_TRUE;
-	VkPhysicalDeviceBufferDeviceAddressFeatures
-	    buffer_device_address_features {};
-	buffer_device_address_features.sType
-	    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
-	buffer_device_address_features.bufferDeviceAddress = VK_TRUE;
-	phys_device_selector.set_surface(m_vk.surface)
+	VkPhysicalDeviceVulkan12Features features_12 {};
+	features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features_12.pNext = nullptr;
+	features_12.bufferDeviceAddress = VK_TRUE;
+	features_12.timelineSemaphore = VK_TRUE;
+	features_12.drawIndirectCount = VK_TRUE;
+	VkPhysicalDeviceFeatures features {};
+	features.multiDrawIndirect = VK_TRUE;
+	features.drawIndirectFirstInstance = VK_TRUE;
+	// A headless instance makes the selector skip the present support check.
+	if (!m_headless)
+		phys_device_selector.set_surface(m_vk.surface);
+	phys_device_selector
 	    .add_desired_extensions({
 	        VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME,
 	        VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
@@ -172,7 +275,8 @@ auto VulkanRenderer::vk_init() -> void
 	        VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
 	    })
 	    .set_required_features_13(features_13)
-	    .add_required_extension_features(buffer_device_address_features);
+	    .set_required_features_12(features_12)
+	    .set_required_features(features);
 	auto physical_device_selector_return { phys_device_selector.select() };
 	if (!physical_device_selector_return) {
 		std::println(std::cerr,
@@ -182,9 +286,65 @@ auto VulkanRenderer::vk_init() -> void
 	}
 	m_vkb.phys_dev = physical_device_selector_return.value();
 
-	m_logger.info("Chosen Vulkan physical device: {}",
+	m_logger.info(CATEGORY, "Chosen Vulkan physical device: {}",
 	    m_vkb.phys_dev.properties.deviceName);
 
+	// Optional: without it, meshes take the compute-culled index path.
+	if (mesh_shading) {
+		VkPhysicalDeviceMeshShaderFeaturesEXT mesh_features {};
+		mesh_features.sType
+		    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+		mesh_features.taskShader = VK_TRUE;
+		mesh_features.meshShader = VK_TRUE;
+		m_vk.mesh_shading = m_vkb.phys_dev.enable_extension_if_present(
+		                        VK_EXT_MESH_SHADER_EXTENSION_NAME)
+		    && m_vkb.phys_dev.enable_extension_features_if_present(
+		        mesh_features);
+	}
+	m_logger.info(CATEGORY, "Mesh shading: {}",
+	    m_vk.mesh_shading ? "enabled"
+	                      : (mesh_shading ? "unsupported" : "disabled"));
+
+	if (pipeline_statistics) {
+		VkPhysicalDeviceFeatures statistics_features {};
+		statistics_features.pipelineStatisticsQuery = VK_TRUE;
+		m_vk.pipeline_statistics
+		    = m_vkb.phys_dev.enable_features_if_present(statistics_features);
+	}
+
+	// Optional: without it, frame pacing can only wait for the GPU.
+	if (!m_headless) {
+		VkPhysicalDevicePresentIdFeaturesKHR present_id_features {};
+		present_id_features.sType
+		    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		present_id_features.presentId = VK_TRUE;
+		VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features {};
+		present_wait_features.sType
+		    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		present_wait_features.presentWait = VK_TRUE;
+		m_vk.present_wait = m_vkb.phys_dev.enable_extension_if_present(
+		                        VK_KHR_PRESENT_ID_EXTENSION_NAME)
+		    && m_vkb.phys_dev.enable_extension_if_present(
+		        VK_KHR_PRESENT_WAIT_EXTENSION_NAME)
+		    && m_vkb.phys_dev.enable_extension_features_if_present(
+		        present_id_features)
+		    && m_vkb.phys_dev.enable_extension_features_if_present(
+		        present_wait_features);
+	}
+
+	// Optional: without it, retired swapchains are destroyed on the frame
+	// timeline; see retire_swapchain().
+	if (surface_maintenance) {
+		VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT features {};
+		features.sType
+		    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+		features.swapchainMaintenance1 = VK_TRUE;
+		m_vk.swapchain_maintenance
+		    = m_vkb.phys_dev.enable_extension_if_present(
+		          VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME)
+		    && m_vkb.phys_dev.enable_extension_features_if_present(features);
+	}
+
 	vkb::DeviceBuilder device_builder { m_vkb.phys_dev };
 	auto dev_ret { device_builder.build() };
 	if (!dev_ret) {
@@ -194,6 +354,17 @@ auto VulkanRenderer::vk_init() -> void
 	}
 	m_vkb.dev = dev_ret.value();
 
+	if (m_vk.mesh_shading) {
+		m_vk.draw_mesh_tasks = reinterpret_cast<PFN_vkCmdDrawMeshTasksEXT>(
+		    vkGetDeviceProcAddr(m_vkb.dev, "vkCmdDrawMeshTasksEXT"));
+		m_vk.mesh_shading = m_vk.draw_mesh_tasks != nullptr;
+	}
+	if (m_vk.present_wait) {
+		m_vk.wait_for_present = reinterpret_cast<PFN_vkWaitForPresentKHR>(
+		    vkGetDeviceProcAddr(m_vkb.dev, "vkWaitForPresentKHR"));
+		m_vk.present_wait = m_vk.wait_for_present != nullptr;
+	}
+
 	auto queue_ret { m_vkb.dev.get_queue(vkb::QueueType::graphics) };
 	if (!queue_ret) {
 		std::println(std::cerr, "Failed to get graphics queue. Error: {}",
@@ -211,6 +382,35 @@ auto VulkanRenderer::vk_init() -> void
 	}
 	m_vk.graphics_queue_family = queue_family_ret.value();
 
+	auto const queue_families { m_vkb.phys_dev.get_queue_families() };
+	auto const timestamp_bits {
+		queue_families.at(m_vk.graphics_queue_family).timestampValidBits
+	};
+	if (timestamp_bits > 0) {
+		m_vk.timestamp_period
+		    = m_vkb.phys_dev.properties.limits.timestampPeriod;
+		m_vk.timestamp_mask = timestamp_bits >= 64
+		    ? ~0ull
+		    : (1ull << timestamp_bits) - 1;
+	}
+
+	// Prefer a transfer-only family so uploads run alongside rendering, then
+	// any non-graphics family, and finally share the graphics queue.
+	m_vk.transfer_queue = m_vk.graphics_queue;
+	m_vk.transfer_queue_family = m_vk.graphics_queue_family;
+	if (auto dedicated_ret {
+	        m_vkb.dev.get_dedicated_queue(vkb::QueueType::transfer) }) {
+		m_vk.transfer_queue = dedicated_ret.value();
+		m_vk.transfer_queue_family
+		    = m_vkb.dev.get_dedicated_queue_index(vkb::QueueType::transfer)
+		          .value();
+	} else if (auto separate_ret {
+	               m_vkb.dev.get_queue(vkb::QueueType::transfer) }) {
+		m_vk.transfer_queue = separate_ret.value();
+		m_vk.transfer_queue_family
+		    = m_vkb.dev.get_queue_index(vkb::QueueType::transfer).value();
+	}
+
 	VmaAllocatorCreateInfo allocator_ci {};
 	allocator_ci.physicalDevice = m_vkb.phys_dev;
 	allocator_ci.device = m_vkb.dev;
@@ -222,38 +422,98 @@ auto VulkanRenderer::vk_init() -> void
 	    [this]() { vmaDestroyAllocator(m_vk.allocator); });
 }
 
-auto VulkanRenderer::swapchain_init() -> void
+// Largest desktop resolution over all displays, in pixels.
+static auto largest_display_extent() -> VkExtent2D
+{
+	VkExtent2D largest { 0, 0 };
+	int count { 0 };
+	auto *displays { SDL_GetDisplays(&count) };
+	if (displays == nullptr)
+		return largest;
+	defer(SDL_free(displays));
+
+	for (int i { 0 }; i < count; i++) {
+		auto const *mode { SDL_GetDesktopDisplayMode(displays[i]) };
+		if (mode == nullptr)
+			continue;
+		largest.width = std::max(largest.width,
+		    static_cast<uint32_t>(
+		        std::ceil(static_cast<float>(mode->w) * mode->pixel_density)));
+		largest.height = std::max(largest.height,
+		    static_cast<uint32_t>(
+		        std::ceil(static_cast<float>(mode->h) * mode->pixel_density)));
+	}
+	return largest;
+}
+
+// Refresh rate of the display showing `window`; 60 Hz when unknown.
+static auto display_refresh_rate(SDL_Window *window) -> float
+{
+	if (window != nullptr) {
+		auto const *mode { SDL_GetCurrentDisplayMode(
+			SDL_GetDisplayForWindow(window)) };
+		if (mode != nullptr && mode->refresh_rate > 0.0f)
+			return mode->refresh_rate;
+	}
+	return 60.0f;
+}
+
+static auto to_vk_present_mode(PresentMode mode) -> VkPresentModeKHR
 {
-	int w, h;
-	SDL_GetWindowSize(m_window, &w, &h);
-	create_swapchain(static_cast<uint32_t>(w), static_cast<uint32_t>(h));
-	create_draw_image(static_cast<uint32_t>(w), static_cast<uint32_t>(h));
+	switch (mode) {
+	case PresentMode::Fifo:
+		return VK_PRESENT_MODE_FIFO_KHR;
+	case PresentMode::FifoRelaxed:
+		return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+	case PresentMode::Mailbox:
+		return VK_PRESENT_MODE_MAILBOX_KHR;
+	case PresentMode::Immediate:
+		return VK_PRESENT_MODE_IMMEDIATE_KHR;
+	}
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+auto VulkanRenderer::swapchain_init(
+    VkExtent2D headless_extent, VkExtent2D max_draw_extent) -> void
+{
+	// The draw image is sized for the largest output up front, so resizing
+	// the window only changes the part of it that is rendered to.
+	VkExtent2D output {};
+	if (m_headless) {
+		m_vk.headless_extent = headless_extent;
+		output = headless_extent;
+	} else {
+		int w, h;
+		SDL_GetWindowSize(m_window, &w, &h);
+		create_swapchain(static_cast<uint32_t>(w), static_cast<uint32_t>(h));
+		output = m_vk.swapchain_extent;
+		if (max_draw_extent.width == 0 || max_draw_extent.height == 0)
+			max_draw_extent = largest_display_extent();
+	}
+
+	auto const limit { m_vkb.phys_dev.properties.limits.maxImageDimension2D };
+	create_draw_image(
+	    std::min(std::max(output.width, max_draw_extent.width), limit),
+	    std::min(std::max(output.height, max_draw_extent.height), limit));
 }
 
 auto VulkanRenderer::commands_init() -> void
 {
+	// Pools are reset wholesale once per use, so individual buffers never
+	// need resetting.
 	VkCommandPoolCreateInfo ci {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
 		.pNext = nullptr,
-		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
 		.queueFamilyIndex = m_vk.graphics_queue_family,
 	};
 	for (auto &frame_data : m_vk.frames) {
-		VK_CHECK(m_logger,
-		    vkCreateCommandPool(
-		        m_vkb.dev, &ci, nullptr, &frame_data.command_pool));
-
-		VkCommandBufferAllocateInfo ai {
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-			.pNext = nullptr,
-			.commandPool = frame_data.command_pool,
-			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			.commandBufferCount = 1,
-		};
-
-		VK_CHECK(m_logger,
-		    vkAllocateCommandBuffers(
-		        m_vkb.dev, &ai, &frame_data.main_command_buffer));
+		frame_data.command_pools.resize(m_vk.jobs.thread_count());
+		for (auto &thread_pool : frame_data.command_pools) {
+			VK_CHECK(m_logger,
+			    vkCreateCommandPool(
+			        m_vkb.dev, &ci, nullptr, &thread_pool.pool));
+		}
 	}
 
 	VK_CHECK(m_logger,
@@ -287,25 +547,79 @@ auto VulkanRenderer::sync_init() -> void
 		.flags = 0,
 	};
 	for (auto &frame_data : m_vk.frames) {
-		VK_CHECK(m_logger,
-		    vkCreateFence(
-		        m_vkb.dev, &fence_ci, nullptr, &frame_data.render_fence));
-
 		VK_CHECK(m_logger,
 		    vkCreateSemaphore(m_vkb.dev, &semaphore_ci, nullptr,
 		        &frame_data.swapchain_semaphore));
 	}
 
+	VkSemaphoreTypeCreateInfo timeline_ci {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.pNext = nullptr,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+	VkSemaphoreCreateInfo timeline_semaphore_ci {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &timeline_ci,
+		.flags = 0,
+	};
+	VK_CHECK(m_logger,
+	    vkCreateSemaphore(m_vkb.dev, &timeline_semaphore_ci, nullptr,
+	        &m_vk.frame_timeline));
+	m_vk.deletion_queue.emplace([this]() {
+		vkDestroySemaphore(m_vkb.dev, m_vk.frame_timeline, nullptr);
+	});
+
 	VK_CHECK(m_logger,
 	    vkCreateFence(m_vkb.dev, &fence_ci, nullptr, &m_vk.imm_fence));
 	m_vk.deletion_queue.emplace(
 	    [this]() { vkDestroyFence(m_vkb.dev, m_vk.imm_fence, nullptr); });
 }
 
+auto VulkanRenderer::profiler_init(bool enabled) -> void
+{
+	if (!enabled || m_vk.timestamp_period == 0.0f)
+		return;
+
+	m_vk.profiler.init(m_logger, m_vkb.dev, MAX_FRAMES_IN_FLIGHT,
+	    m_vk.timestamp_period, m_vk.timestamp_mask, m_vk.pipeline_statistics);
+
+	m_vk.deletion_queue.emplace([this]() { m_vk.profiler.destroy(); });
+}
+
+auto VulkanRenderer::uploads_init() -> void
+{
+	m_vk.uploads.init(m_logger,
+	    {
+	        .dev = m_vkb.dev,
+	        .allocator = m_vk.allocator,
+	        .queue = m_vk.transfer_queue,
+	        .queue_family = m_vk.transfer_queue_family,
+	        .graphics_queue_family = m_vk.graphics_queue_family,
+	    });
+
+	m_vk.deletion_queue.emplace([this]() { m_vk.uploads.destroy(); });
+}
+
+auto VulkanRenderer::geometry_init() -> void
+{
+	m_vk.geometry.init(m_logger, m_vkb.dev, m_vk.allocator, 32 * 1024 * 1024);
+
+	m_vk.deletion_queue.emplace([this]() { m_vk.geometry.destroy(); });
+}
+
+auto VulkanRenderer::render_graph_init() -> void
+{
+	m_vk.render_graph.init(m_logger, m_vkb.dev, m_vk.allocator);
+
+	m_vk.deletion_queue.emplace([this]() { m_vk.render_graph.destroy(); });
+}
+
 auto VulkanRenderer::descriptors_init() -> void
 {
 	std::vector<DescriptorAllocator::PoolSizeRatio> sizes {
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
 	};
 	m_vk.descriptor_allocator.init_pool(m_vkb.dev, 10, sizes);
 
@@ -313,9 +627,29 @@ auto VulkanRenderer::descriptors_init() -> void
 	    = DescriptorLayoutBuilder()
 	          .add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
 	          .build(m_logger, m_vkb.dev, VK_SHADER_STAGE_COMPUTE_BIT);
+	m_vk.draw_image_sampled_descriptor_layout
+	    = DescriptorLayoutBuilder()
+	          .add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+	          .build(m_logger, m_vkb.dev, VK_SHADER_STAGE_FRAGMENT_BIT);
 
 	m_vk.draw_image_descriptors = m_vk.descriptor_allocator.allocate(
 	    m_logger, m_vkb.dev, m_vk.draw_image_descriptor_layout);
+	m_vk.draw_image_sampled_descriptors = m_vk.descriptor_allocator.allocate(
+	    m_logger, m_vkb.dev, m_vk.draw_image_sampled_descriptor_layout);
+
+	// Clamped, so filtering at the image's edges does not wrap around.
+	VkSamplerCreateInfo sampler_ci {};
+	sampler_ci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_ci.pNext = nullptr;
+	sampler_ci.magFilter = VK_FILTER_LINEAR;
+	sampler_ci.minFilter = VK_FILTER_LINEAR;
+	sampler_ci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_ci.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_ci.maxLod = VK_LOD_CLAMP_NONE;
+	VK_CHECK(m_logger,
+	    vkCreateSampler(m_vkb.dev, &sampler_ci, nullptr, &m_vk.linear_sampler));
 
 	update_draw_image_descriptor();
 
@@ -323,14 +657,73 @@ auto VulkanRenderer::descriptors_init() -> void
 		m_vk.descriptor_allocator.destroy_pool(m_vkb.dev);
 		vkDestroyDescriptorSetLayout(
 		    m_vkb.dev, m_vk.draw_image_descriptor_layout, nullptr);
+		vkDestroyDescriptorSetLayout(
+		    m_vkb.dev, m_vk.draw_image_sampled_descriptor_layout, nullptr);
+		vkDestroySampler(m_vkb.dev, m_vk.linear_sampler, nullptr);
 	});
 }
 
+auto VulkanRenderer::pipeline_cache_init(std::filesystem::path const &path)
+    -> void
+{
+	auto shader_hash { FNV1A_SEED };
+	for (auto const spirv : shaders::all)
+		shader_hash = fnv1a(spirv, shader_hash);
+
+	m_vk.pipeline_cache.init(
+	    m_logger, m_vkb.phys_dev, m_vkb.dev, path, shader_hash);
+
+	m_vk.deletion_queue.emplace([this]() { m_vk.pipeline_cache.destroy(); });
+}
+
 auto VulkanRenderer::pipelines_init() -> void
 {
+	// Pipelines compile on the job system while the first frames render.
+	// Draws skip or fall back until their pipeline is ready.
+	m_vk.pipelines_start = std::chrono::steady_clock::now();
+
 	background_pipelines_init();
 	triangle_pipeline_init();
 	mesh_pipeline_init();
+	cull_pipeline_init();
+	mesh_indirect_pipeline_init();
+	if (m_vk.mesh_shading)
+		meshlet_pipeline_init();
+	if (!m_headless)
+		upscale_pipeline_init();
+}
+
+auto VulkanRenderer::pipelines_ready() const -> bool
+{
+	for (auto const *pipeline : { &m_vk.gradient_pipeline,
+	         &m_vk.triangle_pipeline, &m_vk.mesh_pipeline,
+	         &m_vk.cull_pipeline, &m_vk.mesh_indirect_pipeline }) {
+		if (!pipeline->ready())
+			return false;
+	}
+	if (!m_headless && !m_vk.upscale_pipeline.ready())
+		return false;
+	return !m_vk.mesh_shading || m_vk.meshlet_pipeline.ready();
+}
+
+auto VulkanRenderer::report_pipelines() -> void
+{
+	if (m_vk.pipelines_reported || !pipelines_ready())
+		return;
+	m_vk.pipelines_reported = true;
+
+	auto const stats { m_vk.pipeline_cache.stats() };
+	auto const elapsed { std::chrono::duration<double, std::milli>(
+		stats.last_created - m_vk.pipelines_start) };
+	m_logger.info(CATEGORY,
+	    "Created {} pipelines in {:.2f} ms ({} start, {} cache hits, {:.2f} "
+	    "ms in the driver)",
+	    stats.pipelines, elapsed.count(),
+	    m_vk.pipeline_cache.warm() ? "warm" : "cold", stats.cache_hits,
+	    static_cast<double>(stats.creation_ns) / 1e6);
+
+	// Persist right away so a later crash still leaves a warm cache.
+	m_vk.pipeline_cache.save();
 }
 
 auto VulkanRenderer::background_pipelines_init() -> void
@@ -341,65 +734,33 @@ auto VulkanRenderer::background_pipelines_init() -> void
 	layout_ci.pSetLayouts = &m_vk.draw_image_descriptor_layout;
 	layout_ci.setLayoutCount = 1;
 
+	// The draw extent, which is smaller than the image.
+	VkPushConstantRange push_constant_range {};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(VkExtent2D);
+	layout_ci.pPushConstantRanges = &push_constant_range;
+	layout_ci.pushConstantRangeCount = 1;
+
 	VK_CHECK(m_logger,
 	    vkCreatePipelineLayout(
 	        m_vkb.dev, &layout_ci, nullptr, &m_vk.gradient_pipeline_layout));
 
-	uint8_t compute_draw_shader_data[] {
-#embed "gradient_comp.spv"
-	};
-	VkShaderModule compute_draw_shader {};
-	if (!vkutil::load_shader_module(std::span<uint8_t>(compute_draw_shader_data,
-	                                    sizeof(compute_draw_shader_data)),
-	        m_vkb.dev, &compute_draw_shader)) {
-		m_logger.err("Failed to load gradient compute shader");
-	}
-
-	auto stage_ci { vkinit::pipeline_shader_stage(
-		VK_SHADER_STAGE_COMPUTE_BIT, compute_draw_shader) };
+	m_vk.gradient_pipeline = m_vk.jobs.async(
+	    [&cache = m_vk.pipeline_cache, layout = m_vk.gradient_pipeline_layout] {
+		    return cache.create_compute_pipeline(
+		        layout, shaders::gradient_comp, "gradient");
+	    });
 
-	VkComputePipelineCreateInfo compute_pip_ci {};
-	compute_pip_ci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	compute_pip_ci.pNext = nullptr;
-	compute_pip_ci.layout = m_vk.gradient_pipeline_layout;
-	compute_pip_ci.stage = stage_ci;
-
-	VK_CHECK(m_logger,
-	    vkCreateComputePipelines(m_vkb.dev, VK_NULL_HANDLE, 1, &compute_pip_ci,
-	        nullptr, &m_vk.gradient_pipeline));
-
-	vkDestroyShaderModule(m_vkb.dev, compute_draw_shader, nullptr);
 	m_vk.deletion_queue.emplace([&]() {
 		vkDestroyPipelineLayout(
 		    m_vkb.dev, m_vk.gradient_pipeline_layout, nullptr);
-		vkDestroyPipeline(m_vkb.dev, m_vk.gradient_pipeline, nullptr);
+		vkDestroyPipeline(m_vkb.dev, m_vk.gradient_pipeline.wait(), nullptr);
 	});
 }
 
 auto VulkanRenderer::triangle_pipeline_init() -> void
 {
-	uint8_t triangle_vert_shader_data[] {
-#embed "triangle_vert.spv"
-	};
-	VkShaderModule triangle_vert_shader {};
-	if (!vkutil::load_shader_module(
-	        std::span<uint8_t>(
-	            triangle_vert_shader_data, sizeof(triangle_vert_shader_data)),
-	        m_vkb.dev, &triangle_vert_shader)) {
-		m_logger.err("Failed to load triangle vert shader");
-	}
-
-	uint8_t triangle_frag_shader_data[] {
-#embed "triangle_frag.spv"
-	};
-	VkShaderModule triangle_frag_shader {};
-	if (!vkutil::load_shader_module(
-	        std::span<uint8_t>(
-	            triangle_frag_shader_data, sizeof(triangle_frag_shader_data)),
-	        m_vkb.dev, &triangle_frag_shader)) {
-		m_logger.err("Failed to load triangle frag shader");
-	}
-
 	VkPipelineLayoutCreateInfo layout_ci {};
 	layout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	layout_ci.pNext = nullptr;
@@ -408,55 +769,28 @@ auto VulkanRenderer::triangle_pipeline_init() -> void
 	    vkCreatePipelineLayout(
 	        m_vkb.dev, &layout_ci, nullptr, &m_vk.triangle_pipeline_layout));
 
-	auto pip {
-		GraphicsPipelineBuilder { m_logger }
-		    .set_pipeline_layout(m_vk.triangle_pipeline_layout)
-		    .set_shaders(triangle_vert_shader, triangle_frag_shader)
-		    .set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
-		    .set_polygon_mode(VK_POLYGON_MODE_FILL)
-		    .set_multisampling_none()
-		    .disable_blending()
-		    .disable_depth_testing()
-		    .set_color_attachment_format(m_vk.draw_image.format)
-		    .set_depth_format(VK_FORMAT_UNDEFINED)
-		    .build(m_vkb.dev),
-	};
-	m_vk.triangle_pipeline = pip;
-
-	vkDestroyShaderModule(m_vkb.dev, triangle_vert_shader, nullptr);
-	vkDestroyShaderModule(m_vkb.dev, triangle_frag_shader, nullptr);
+	m_vk.triangle_pipeline
+	    = GraphicsPipelineBuilder { m_logger }
+	          .set_pipeline_layout(m_vk.triangle_pipeline_layout)
+	          .set_shaders(shaders::triangle_vert, shaders::triangle_frag)
+	          .set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+	          .set_polygon_mode(VK_POLYGON_MODE_FILL)
+	          .set_multisampling_none()
+	          .disable_blending()
+	          .disable_depth_testing()
+	          .set_color_attachment_format(m_vk.draw_image.format)
+	          .set_depth_format(DEPTH_FORMAT)
+	          .build_async(m_vk.jobs, m_vk.pipeline_cache, "triangle");
 
 	m_vk.deletion_queue.emplace([&]() {
 		vkDestroyPipelineLayout(
 		    m_vkb.dev, m_vk.triangle_pipeline_layout, nullptr);
-		vkDestroyPipeline(m_vkb.dev, m_vk.triangle_pipeline, nullptr);
+		vkDestroyPipeline(m_vkb.dev, m_vk.triangle_pipeline.wait(), nullptr);
 	});
 }
 
 auto VulkanRenderer::mesh_pipeline_init() -> void
 {
-	uint8_t triangle_vert_shader_data[] {
-#embed "triangle_mesh_vert.spv"
-	};
-	VkShaderModule triangle_vert_shader {};
-	if (!vkutil::load_shader_module(
-	        std::span<uint8_t>(
-	            triangle_vert_shader_data, sizeof(triangle_vert_shader_data)),
-	        m_vkb.dev, &triangle_vert_shader)) {
-		m_logger.err("Failed to load triangle vert shader");
-	}
-
-	uint8_t triangle_frag_shader_data[] {
-#embed "triangle_mesh_frag.spv"
-	};
-	VkShaderModule triangle_frag_shader {};
-	if (!vkutil::load_shader_module(
-	        std::span<uint8_t>(
-	            triangle_frag_shader_data, sizeof(triangle_frag_shader_data)),
-	        m_vkb.dev, &triangle_frag_shader)) {
-		m_logger.err("Failed to load triangle frag shader");
-	}
-
 	VkPushConstantRange push_constant_range {};
 	push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	push_constant_range.offset = 0;
@@ -472,31 +806,207 @@ auto VulkanRenderer::mesh_pipeline_init() -> void
 	    vkCreatePipelineLayout(
 	        m_vkb.dev, &layout_ci, nullptr, &m_vk.mesh_pipeline_layout));
 
-	auto pip {
-		GraphicsPipelineBuilder { m_logger }
-		    .set_pipeline_layout(m_vk.mesh_pipeline_layout)
-		    .set_shaders(triangle_vert_shader, triangle_frag_shader)
-		    .set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
-		    .set_polygon_mode(VK_POLYGON_MODE_FILL)
-		    .set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE)
-		    .set_multisampling_none()
-		    .disable_blending()
-		    .disable_depth_testing()
-		    .set_color_attachment_format(m_vk.draw_image.format)
-		    .set_depth_format(VK_FORMAT_UNDEFINED)
-		    .build(m_vkb.dev),
-	};
-	m_vk.mesh_pipeline = pip;
-
-	vkDestroyShaderModule(m_vkb.dev, triangle_vert_shader, nullptr);
-	vkDestroyShaderModule(m_vkb.dev, triangle_frag_shader, nullptr);
+	m_vk.mesh_pipeline
+	    = GraphicsPipelineBuilder { m_logger }
+	          .set_pipeline_layout(m_vk.mesh_pipeline_layout)
+	          .set_shaders(
+	              shaders::triangle_mesh_vert, shaders::triangle_mesh_frag)
+	          .set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+	          .set_polygon_mode(VK_POLYGON_MODE_FILL)
+	          .set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE)
+	          .set_multisampling_none()
+	          .disable_blending()
+	          .disable_depth_testing()
+	          .set_color_attachment_format(m_vk.draw_image.format)
+	          .set_depth_format(DEPTH_FORMAT)
+	          .build_async(m_vk.jobs, m_vk.pipeline_cache, "mesh");
 
 	m_vk.deletion_queue.emplace([&]() {
 		vkDestroyPipelineLayout(m_vkb.dev, m_vk.mesh_pipeline_layout, nullptr);
-		vkDestroyPipeline(m_vkb.dev, m_vk.mesh_pipeline, nullptr);
+		vkDestroyPipeline(m_vkb.dev, m_vk.mesh_pipeline.wait(), nullptr);
+	});
+}
+
+auto VulkanRenderer::cull_pipeline_init() -> void
+{
+	VkPushConstantRange push_constant_range {};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(GPUCullPushConstants);
+
+	VkPipelineLayoutCreateInfo layout_ci {};
+	layout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_ci.pNext = nullptr;
+	layout_ci.pushConstantRangeCount = 1;
+	layout_ci.pPushConstantRanges = &push_constant_range;
+
+	VK_CHECK(m_logger,
+	    vkCreatePipelineLayout(
+	        m_vkb.dev, &layout_ci, nullptr, &m_vk.cull_pipeline_layout));
+
+	m_vk.cull_pipeline = m_vk.jobs.async(
+	    [&cache = m_vk.pipeline_cache, layout = m_vk.cull_pipeline_layout] {
+		    return cache.create_compute_pipeline(
+		        layout, shaders::cull_comp, "cull");
+	    });
+
+	m_vk.deletion_queue.emplace([&]() {
+		vkDestroyPipelineLayout(m_vkb.dev, m_vk.cull_pipeline_layout, nullptr);
+		vkDestroyPipeline(m_vkb.dev, m_vk.cull_pipeline.wait(), nullptr);
+	});
+}
+
+auto VulkanRenderer::mesh_indirect_pipeline_init() -> void
+{
+	VkPushConstantRange push_constant_range {};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(GPUIndirectPushConstants);
+
+	VkPipelineLayoutCreateInfo layout_ci {};
+	layout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_ci.pNext = nullptr;
+	layout_ci.pushConstantRangeCount = 1;
+	layout_ci.pPushConstantRanges = &push_constant_range;
+
+	VK_CHECK(m_logger,
+	    vkCreatePipelineLayout(m_vkb.dev, &layout_ci, nullptr,
+	        &m_vk.mesh_indirect_pipeline_layout));
+
+	m_vk.mesh_indirect_pipeline
+	    = GraphicsPipelineBuilder { m_logger }
+	          .set_pipeline_layout(m_vk.mesh_indirect_pipeline_layout)
+	          .set_shaders(
+	              shaders::mesh_indirect_vert, shaders::triangle_mesh_frag)
+	          .set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+	          .set_polygon_mode(VK_POLYGON_MODE_FILL)
+	          .set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE)
+	          .set_multisampling_none()
+	          .disable_blending()
+	          .enable_depth_test(true, VK_COMPARE_OP_LESS_OR_EQUAL)
+	          .set_color_attachment_format(m_vk.draw_image.format)
+	          .set_depth_format(DEPTH_FORMAT)
+	          .build_async(m_vk.jobs, m_vk.pipeline_cache, "mesh_indirect");
+
+	m_vk.deletion_queue.emplace([&]() {
+		vkDestroyPipelineLayout(
+		    m_vkb.dev, m_vk.mesh_indirect_pipeline_layout, nullptr);
+		vkDestroyPipeline(
+		    m_vkb.dev, m_vk.mesh_indirect_pipeline.wait(), nullptr);
+	});
+}
+
+auto VulkanRenderer::meshlet_pipeline_init() -> void
+{
+	VkPushConstantRange push_constant_range {};
+	push_constant_range.stageFlags
+	    = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(GPUMeshletPushConstants);
+
+	VkPipelineLayoutCreateInfo layout_ci {};
+	layout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_ci.pNext = nullptr;
+	layout_ci.pushConstantRangeCount = 1;
+	layout_ci.pPushConstantRanges = &push_constant_range;
+
+	VK_CHECK(m_logger,
+	    vkCreatePipelineLayout(
+	        m_vkb.dev, &layout_ci, nullptr, &m_vk.meshlet_pipeline_layout));
+
+	// Same state as mesh_indirect. Neither culls back faces in the
+	// rasterizer; the task shader only cone culls meshlets of single-sided
+	// materials, whose back faces glTF does not show.
+	m_vk.meshlet_pipeline
+	    = GraphicsPipelineBuilder { m_logger }
+	          .set_pipeline_layout(m_vk.meshlet_pipeline_layout)
+	          .set_mesh_shaders(shaders::meshlet_task, shaders::meshlet_mesh,
+	              shaders::triangle_mesh_frag)
+	          .set_polygon_mode(VK_POLYGON_MODE_FILL)
+	          .set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE)
+	          .set_multisampling_none()
+	          .disable_blending()
+	          .enable_depth_test(true, VK_COMPARE_OP_LESS_OR_EQUAL)
+	          .set_color_attachment_format(m_vk.draw_image.format)
+	          .set_depth_format(DEPTH_FORMAT)
+	          .build_async(m_vk.jobs, m_vk.pipeline_cache, "meshlet");
+
+	m_vk.deletion_queue.emplace([&]() {
+		vkDestroyPipelineLayout(
+		    m_vkb.dev, m_vk.meshlet_pipeline_layout, nullptr);
+		vkDestroyPipeline(m_vkb.dev, m_vk.meshlet_pipeline.wait(), nullptr);
+	});
+}
+
+auto VulkanRenderer::upscale_pipeline_init() -> void
+{
+	VkPushConstantRange push_constant_range {};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(GPUUpscalePushConstants);
+
+	VkPipelineLayoutCreateInfo layout_ci {};
+	layout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_ci.pNext = nullptr;
+	layout_ci.pSetLayouts = &m_vk.draw_image_sampled_descriptor_layout;
+	layout_ci.setLayoutCount = 1;
+	layout_ci.pushConstantRangeCount = 1;
+	layout_ci.pPushConstantRanges = &push_constant_range;
+
+	VK_CHECK(m_logger,
+	    vkCreatePipelineLayout(
+	        m_vkb.dev, &layout_ci, nullptr, &m_vk.upscale_pipeline_layout));
+
+	m_vk.upscale_pipeline
+	    = GraphicsPipelineBuilder { m_logger }
+	          .set_pipeline_layout(m_vk.upscale_pipeline_layout)
+	          .set_shaders(shaders::fullscreen_vert, shaders::upscale_frag)
+	          .set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+	          .set_polygon_mode(VK_POLYGON_MODE_FILL)
+	          .set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE)
+	          .set_multisampling_none()
+	          .disable_blending()
+	          .disable_depth_testing()
+	          .set_color_attachment_format(m_vk.swapchain_image_format)
+	          .set_depth_format(VK_FORMAT_UNDEFINED)
+	          .build_async(m_vk.jobs, m_vk.pipeline_cache, "upscale");
+
+	m_vk.deletion_queue.emplace([&]() {
+		vkDestroyPipelineLayout(
+		    m_vkb.dev, m_vk.upscale_pipeline_layout, nullptr);
+		vkDestroyPipeline(m_vkb.dev, m_vk.upscale_pipeline.wait(), nullptr);
 	});
 }
 
+auto VulkanRenderer::dynamic_resolution_init(RendererConfig const &config)
+    -> void
+{
+	if (!config.dynamic_resolution)
+		return;
+	if (!m_vk.profiler.enabled()) {
+		m_logger.warn(CATEGORY,
+		    "Dynamic resolution needs GPU profiling, which is disabled or "
+		    "lacks timestamp support on the graphics queue");
+		return;
+	}
+
+	auto budget_ms { static_cast<double>(config.frame_budget_ms) };
+	if (budget_ms <= 0.0) {
+		auto const refresh_rate { display_refresh_rate(
+			m_headless ? nullptr : m_window) };
+		// Leaves room for the upscale, ImGui and timing jitter.
+		budget_ms = 0.9 * 1000.0 / static_cast<double>(refresh_rate);
+	}
+
+	m_vk.dynamic_resolution = true;
+	m_vk.resolution.init(config.min_resolution_scale,
+	    config.max_resolution_scale, budget_ms);
+	m_logger.info(CATEGORY,
+	    "Dynamic resolution between {:.2f} and {:.2f} of the output, {:.2f} "
+	    "ms GPU budget",
+	    config.min_resolution_scale, config.max_resolution_scale, budget_ms);
+}
+
 auto VulkanRenderer::imgui_init() -> void
 {
 	VkDescriptorPoolSize pool_sizes[] = {
@@ -534,6 +1044,7 @@ auto VulkanRenderer::imgui_init() -> void
 	init_info.Device = m_vkb.dev;
 	init_info.Queue = m_vk.graphics_queue;
 	init_info.DescriptorPool = m_vk.imgui_descriptor_pool;
+	init_info.PipelineCache = m_vk.pipeline_cache.handle();
 	init_info.MinImageCount = 3;
 	init_info.ImageCount = 3;
 	init_info.UseDynamicRendering = true;
@@ -591,51 +1102,152 @@ auto VulkanRenderer::default_data_init() -> void
 	m_vk.test_meshes
 	    = Mesh::load_gltf_meshes(*this, "assets/basicmesh.glb").value();
 
-	m_vk.deletion_queue.emplace([&]() {
-		for (auto &mesh : m_vk.test_meshes) {
-			destroy_buffer(mesh->mesh_buffers.index_buffer);
-			destroy_buffer(mesh->mesh_buffers.vertex_buffer);
+	m_vk.scene.add(m_vk.test_meshes[2], smath::Mat4::identity());
+}
+
+auto VulkanRenderer::pace_frame() -> void
+{
+	defer(m_vk.input_time = std::chrono::steady_clock::now());
+	if (m_headless || m_vk.swapchain == VK_NULL_HANDLE)
+		return;
+
+	if (!collect_presents(m_vk.low_latency)
+	    || m_vk.present_mode == PresentMode::Immediate)
+		return;
+
+	// The last frame was just displayed, so the next vblank is about one
+	// refresh interval away. The frame starts as late as still lets its CPU
+	// and GPU work finish before then.
+	auto const delay_ms { m_vk.refresh_interval_ms - m_vk.cpu_work_ms
+		- m_vk.gpu_work_ms - PACING_MARGIN_MS };
+	if (delay_ms > 0.0) {
+		std::this_thread::sleep_for(
+		    std::chrono::duration<double, std::milli>(delay_ms));
+	}
+}
+
+auto VulkanRenderer::collect_presents(bool block) -> bool
+{
+	auto waited { false };
+	while (!m_vk.pending_presents.empty()) {
+		auto const pending { m_vk.pending_presents.front() };
+		if (m_vk.present_wait) {
+			auto result { m_vk.wait_for_present(
+				m_vkb.dev, m_vk.swapchain, pending.value, 0) };
+			if (result == VK_TIMEOUT && block) {
+				waited = true;
+				result = m_vk.wait_for_present(m_vkb.dev, m_vk.swapchain,
+				    pending.value, PRESENT_TIMEOUT_NS);
+			}
+			if (result == VK_TIMEOUT)
+				return false;
+			// Out of date or lost; the swapchain is replaced before the
+			// next frame.
+			if (result != VK_SUCCESS) {
+				m_vk.pending_presents.clear();
+				return false;
+			}
+		} else if (completed_frame_value() < pending.value) {
+			if (!block)
+				return false;
+			waited = true;
+			wait_frame_value(pending.value);
 		}
 
-		destroy_buffer(m_vk.rectangle.index_buffer);
-		destroy_buffer(m_vk.rectangle.vertex_buffer);
-	});
+		auto const latency { std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - pending.input_time) };
+		m_vk.latency_ms = m_vk.latency_ms == 0.0
+		    ? latency.count()
+		    : m_vk.latency_ms
+		        + (latency.count() - m_vk.latency_ms) * AVERAGE_WEIGHT;
+		m_vk.pending_presents.pop_front();
+	}
+	return waited && m_vk.present_wait;
 }
 
 auto VulkanRenderer::render() -> void
 {
 	defer(m_vk.frame_number++);
 
-	if (m_vk.swapchain == VK_NULL_HANDLE || m_vk.swapchain_extent.width == 0
-	    || m_vk.swapchain_extent.height == 0) {
-		return;
+	if (!m_headless && m_vk.pending_extent) {
+		auto const extent { *m_vk.pending_extent };
+		m_vk.pending_extent.reset();
+		recreate_swapchain(extent.width, extent.height);
 	}
 
-	VK_CHECK(m_logger,
-	    vkWaitForFences(m_vkb.dev, 1, &m_vk.get_current_frame().render_fence,
-	        true, 1'000'000'000));
-	VK_CHECK(m_logger,
-	    vkResetFences(m_vkb.dev, 1, &m_vk.get_current_frame().render_fence));
-
-	uint32_t swapchain_image_idx;
-	auto const acquire_result = vkAcquireNextImageKHR(m_vkb.dev, m_vk.swapchain,
-	    1000000000, m_vk.get_current_frame().swapchain_semaphore, nullptr,
-	    &swapchain_image_idx);
-	if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR
-	    || acquire_result == VK_SUBOPTIMAL_KHR) {
-		int width {}, height {};
-		SDL_GetWindowSize(m_window, &width, &height);
-		recreate_swapchain(
-		    static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+	if (m_headless) {
+		if (m_vk.headless_extent.width == 0
+		    || m_vk.headless_extent.height == 0)
+			return;
+	} else if (m_vk.swapchain == VK_NULL_HANDLE
+	    || m_vk.swapchain_extent.width == 0
+	    || m_vk.swapchain_extent.height == 0) {
 		return;
 	}
-	VK_CHECK(m_logger, acquire_result);
 
-	auto cmd { m_vk.get_current_frame().main_command_buffer };
-	VK_CHECK(m_logger, vkResetCommandBuffer(cmd, 0));
+	// Only wait for the submission that last used this frame slot; newer
+	// frames may keep running on the GPU.
+	wait_frame_value(m_vk.get_current_frame().timeline_value);
+	m_vk.retired.collect(completed_frame_value());
+	collect_present_fences(false);
+
+	uint32_t swapchain_image_idx { 0 };
+	if (!m_headless) {
+		auto const acquire_result = vkAcquireNextImageKHR(m_vkb.dev,
+		    m_vk.swapchain, 1000000000,
+		    m_vk.get_current_frame().swapchain_semaphore, nullptr,
+		    &swapchain_image_idx);
+		if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
+			request_window_extent();
+			return;
+		}
+		// A suboptimal image was still acquired and its semaphore will be
+		// signaled, so the frame goes ahead and the swapchain is replaced
+		// after presenting it.
+		if (acquire_result == VK_SUBOPTIMAL_KHR)
+			request_window_extent();
+		else
+			VK_CHECK(m_logger, acquire_result);
+	}
+	auto const record_start { std::chrono::steady_clock::now() };
+	// Without pace_frame(), latency is still measured from here.
+	if (!m_vk.input_time)
+		collect_presents(false);
+	auto const input_time { m_vk.input_time.value_or(record_start) };
+	m_vk.input_time.reset();
+
+	auto &frame { m_vk.get_current_frame() };
+	for (auto &thread_pool : frame.command_pools) {
+		VK_CHECK(m_logger, vkResetCommandPool(m_vkb.dev, thread_pool.pool, 0));
+		thread_pool.used = 0;
+	}
+	auto cmd { acquire_command_buffer(frame, 0) };
+	auto const slot {
+		static_cast<uint32_t>(m_vk.frame_number % m_vk.frames_in_flight)
+	};
 
-	m_vk.draw_extent.width = m_vk.draw_image.extent.width;
-	m_vk.draw_extent.height = m_vk.draw_image.extent.height;
+	// The slot's previous frame has completed, so its timings can be read
+	// before begin_frame() below resets them.
+	if (auto const gpu_ms { m_vk.profiler.frame_ms(slot) }) {
+		m_vk.gpu_work_ms = track_work(m_vk.gpu_work_ms, *gpu_ms);
+		if (m_vk.dynamic_resolution)
+			m_vk.resolution.update(*gpu_ms, frame.resolution_scale);
+	}
+	frame.resolution_scale = resolution_scale();
+
+	// Only the top-left corner of the draw image is rendered to: the
+	// output size, scaled down with dynamic resolution.
+	auto const output { m_headless ? m_vk.headless_extent
+		                           : m_vk.swapchain_extent };
+	auto const scaled { [&](uint32_t size, uint32_t limit) {
+		auto const scaled_size { static_cast<uint32_t>(
+			std::lround(static_cast<float>(size) * frame.resolution_scale)) };
+		return std::clamp(scaled_size, 1u, limit);
+	} };
+	m_vk.draw_extent.width
+	    = scaled(output.width, m_vk.draw_image.extent.width);
+	m_vk.draw_extent.height
+	    = scaled(output.height, m_vk.draw_image.extent.height);
 
 	VkCommandBufferBeginInfo cmd_begin_info {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -645,54 +1257,220 @@ auto VulkanRenderer::render() -> void
 	};
 	VK_CHECK(m_logger, vkBeginCommandBuffer(cmd, &cmd_begin_info));
 
-	vkutil::transition_image(cmd, m_vk.draw_image.image,
-	    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	// Upload acquires and relocations get a scope of their own, so the
+	// frame's GPU time starts with them.
+	auto setup_scope { ~0u };
+	if (m_vk.profiler.enabled()) {
+		m_vk.profiler.begin_frame(cmd, slot, m_vk.frame_number);
+		setup_scope = m_vk.profiler.add_scope("Setup");
+		m_vk.profiler.begin(cmd, setup_scope);
+	}
 
-	draw_background(cmd);
+	m_vk.uploads.flush();
+	m_vk.uploads.record_acquires(cmd);
+	m_vk.geometry.record_relocations(
+	    cmd, m_vk.retired, m_vk.frame_timeline_value + 1);
 
-	vkutil::transition_image(cmd, m_vk.draw_image.image,
-	    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	if (setup_scope != ~0u)
+		m_vk.profiler.end(cmd, setup_scope);
+	VK_CHECK(m_logger, vkEndCommandBuffer(cmd));
 
-	draw_geometry(cmd);
+	report_pipelines();
+
+	m_vk.view_proj = view_projection();
+	m_vk.lod_scale = lod_scale();
+	update_instances(frame);
+	// Meshlets are only drawn when every instance has them, so one frame
+	// never mixes both paths. Until culling and indirect drawing have
+	// compiled, the scene is skipped.
+	auto scene_path { ScenePath::None };
+	if (frame.instance_count > 0 && m_vk.mesh_shading
+	    && frame.meshlet_instances == frame.instance_count
+	    && m_vk.meshlet_pipeline.ready()) {
+		scene_path = ScenePath::Meshlets;
+	} else if (frame.instance_count > 0 && m_vk.cull_pipeline.ready()
+	    && m_vk.mesh_indirect_pipeline.ready()) {
+		scene_path = ScenePath::Indirect;
+	}
+	auto &graph { m_vk.render_graph };
+	graph.begin(
+	    static_cast<uint32_t>(m_vk.frame_number % m_vk.frames_in_flight));
+
+	// The draw image's previous contents are discarded; only the last
+	// frame's blit or upscale must finish first. The swapchain image is only
+	// available after the acquire semaphore, which the submit waits on at
+	// COLOR_ATTACHMENT_OUTPUT.
+	auto const draw_image { graph.import_image(m_vk.draw_image.image,
+		m_vk.draw_image.image_view, m_vk.draw_extent,
+		VK_IMAGE_LAYOUT_UNDEFINED,
+		{ VK_PIPELINE_STAGE_2_BLIT_BIT
+		        | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+		    VK_ACCESS_2_NONE }) };
+	RGImage swapchain_image {};
+	if (m_headless) {
+		// Left ready to be copied out, which also orders it against the
+		// next frame's import.
+		graph.export_image(
+		    draw_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, sync::BLIT_READ);
+	} else {
+		swapchain_image = graph.import_image(
+		    m_vk.swapchain_images.at(swapchain_image_idx),
+		    m_vk.swapchain_image_views.at(swapchain_image_idx),
+		    m_vk.swapchain_extent, VK_IMAGE_LAYOUT_UNDEFINED,
+		    { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		        VK_ACCESS_2_NONE });
+		graph.export_image(
+		    swapchain_image, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, sync::NONE);
+	}
+	// Sized like the draw image, so a changing resolution scale does not
+	// reallocate it every frame.
+	auto const depth_image { graph.create_image({
+		.format = DEPTH_FORMAT,
+		.extent = { m_vk.draw_image.extent.width,
+		    m_vk.draw_image.extent.height },
+		.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+	}) };
+
+	RGBuffer draws {}, draw_count {};
+	if (scene_path == ScenePath::Indirect) {
+		// This slot's previous frame has completed, so nothing reads the
+		// buffers anymore.
+		draws = graph.import_buffer(frame.draw_buffer.buffer, sync::NONE);
+		draw_count
+		    = graph.import_buffer(frame.draw_count_buffer.buffer, sync::NONE);
+
+		graph.add_pass("cull")
+		    .write(draws, sync::COMPUTE_WRITE)
+		    .write(draw_count,
+		        { VK_PIPELINE_STAGE_2_CLEAR_BIT
+		                | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		            VK_ACCESS_2_TRANSFER_WRITE_BIT
+		                | VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+		                | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT })
+		    .execute([this](VkCommandBuffer cmd, RenderGraph const &) {
+			    cull_instances(cmd);
+		    });
+	}
 
-	vkutil::transition_image(cmd, m_vk.draw_image.image,
-	    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-	    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	// Falls back to a clear while the gradient pipeline compiles.
+	graph.add_pass("background")
+	    .write(draw_image, VK_IMAGE_LAYOUT_GENERAL,
+	        { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+	                | VK_PIPELINE_STAGE_2_CLEAR_BIT,
+	            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+	                | VK_ACCESS_2_TRANSFER_WRITE_BIT })
+	    .execute([this](VkCommandBuffer cmd, RenderGraph const &) {
+		    draw_background(cmd);
+	    });
+
+	auto &geometry_pass { graph.add_pass("geometry")
+		    .read_write(draw_image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		        sync::COLOR_ATTACHMENT)
+		    .write(depth_image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+		        sync::DEPTH_ATTACHMENT)
+		    .execute([this, depth_image, scene_path](
+		                 VkCommandBuffer cmd, RenderGraph const &graph) {
+			    draw_geometry(cmd, graph.view(depth_image), scene_path);
+		    }) };
+	if (scene_path == ScenePath::Indirect) {
+		geometry_pass.read(draws, sync::INDIRECT_READ)
+		    .read(draw_count, sync::INDIRECT_READ);
+	}
 
-	vkutil::transition_image(cmd, m_vk.swapchain_images.at(swapchain_image_idx),
-	    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	// Falls back to a bilinear blit while the upscale pipeline compiles.
+	if (!m_headless && m_vk.upscale_pipeline.ready()) {
+		graph.add_pass("upscale")
+		    .read(draw_image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		        sync::FRAGMENT_SAMPLED_READ)
+		    .write(swapchain_image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		        sync::COLOR_ATTACHMENT_WRITE)
+		    .execute([this, swapchain_image](
+		                 VkCommandBuffer cmd, RenderGraph const &graph) {
+			    draw_upscale(cmd, graph.view(swapchain_image));
+		    });
+	} else if (!m_headless) {
+		graph.add_pass("blit")
+		    .read(draw_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		        sync::BLIT_READ)
+		    .write(swapchain_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		        sync::BLIT_WRITE)
+		    .execute([this, draw_image, swapchain_image](
+		                 VkCommandBuffer cmd, RenderGraph const &graph) {
+			    vkutil::copy_image_to_image(cmd, graph.image(draw_image),
+			        graph.image(swapchain_image), m_vk.draw_extent,
+			        m_vk.swapchain_extent);
+		    });
+	}
 
-	vkutil::copy_image_to_image(cmd, m_vk.draw_image.image,
-	    m_vk.swapchain_images.at(swapchain_image_idx), m_vk.draw_extent,
-	    m_vk.swapchain_extent);
+	if (!m_headless) {
 
-	vkutil::transition_image(cmd, m_vk.swapchain_images[swapchain_image_idx],
-	    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-	    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		graph.add_pass("imgui")
+		    .read_write(swapchain_image,
+		        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		        sync::COLOR_ATTACHMENT)
+		    .execute([this, swapchain_image](
+		                 VkCommandBuffer cmd, RenderGraph const &graph) {
+			    draw_imgui(cmd, graph.view(swapchain_image));
+		    });
+	}
 
-	draw_imgui(cmd, m_vk.swapchain_image_views.at(swapchain_image_idx));
+	auto const pass_buffers { graph.execute(
+		m_vk.jobs,
+		[this, &frame](uint32_t thread) {
+			return acquire_command_buffer(frame, thread);
+		},
+		m_vk.profiler.enabled() ? &m_vk.profiler : nullptr) };
 
-	vkutil::transition_image(cmd, m_vk.swapchain_images[swapchain_image_idx],
-	    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-	    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	auto const frame_value { m_vk.frame_timeline_value + 1 };
+	std::vector command_buffer_infos {
+		vkinit::command_buffer_submit_info(cmd),
+	};
+	for (auto const pass_buffer : pass_buffers) {
+		command_buffer_infos.emplace_back(
+		    vkinit::command_buffer_submit_info(pass_buffer));
+	}
 
-	VK_CHECK(m_logger, vkEndCommandBuffer(cmd));
+	std::vector wait_infos { m_vk.uploads.wait_info() };
+	auto frame_signal { vkinit::semaphore_submit_info(
+		VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_vk.frame_timeline) };
+	frame_signal.value = frame_value;
+	std::vector signal_infos { frame_signal };
+	VkSemaphore render_semaphore { VK_NULL_HANDLE };
+	if (!m_headless) {
+		render_semaphore = m_vk.present_semaphores.at(swapchain_image_idx);
+		wait_infos.emplace_back(vkinit::semaphore_submit_info(
+		    VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		    frame.swapchain_semaphore));
+		signal_infos.emplace_back(vkinit::semaphore_submit_info(
+		    VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, render_semaphore));
+	}
 
-	VkSemaphore render_semaphore
-	    = m_vk.present_semaphores.at(swapchain_image_idx);
-	VkPipelineStageFlags2 wait_stage
-	    = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
-	auto wait_info { vkinit::semaphore_submit_info(
-		wait_stage, m_vk.get_current_frame().swapchain_semaphore) };
-	auto command_buffer_info { vkinit::command_buffer_submit_info(cmd) };
-	auto signal_info { vkinit::semaphore_submit_info(
-		VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, render_semaphore) };
 	auto submit_info { vkinit::submit_info2(
-		&command_buffer_info, &wait_info, &signal_info) };
-
+		command_buffer_infos.data(), wait_infos.data(), signal_infos.data()) };
+	submit_info.commandBufferInfoCount
+	    = static_cast<uint32_t>(command_buffer_infos.size());
+	submit_info.waitSemaphoreInfoCount
+	    = static_cast<uint32_t>(wait_infos.size());
+	submit_info.signalSemaphoreInfoCount
+	    = static_cast<uint32_t>(signal_infos.size());
+
+	frame.submit_time = std::chrono::steady_clock::now();
+	auto const record_time { std::chrono::duration<double, std::milli>(
+		frame.submit_time - record_start) };
+	frame.record_ms = record_time.count();
+	m_vk.cpu_work_ms = track_work(m_vk.cpu_work_ms,
+	    std::chrono::duration<double, std::milli>(
+	        frame.submit_time - input_time)
+	        .count());
 	VK_CHECK(m_logger,
-	    vkQueueSubmit2(m_vk.graphics_queue, 1, &submit_info,
-	        m_vk.get_current_frame().render_fence));
+	    vkQueueSubmit2(m_vk.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+	m_vk.frame_timeline_value = frame_value;
+	frame.timeline_value = frame_value;
+	m_vk.last_frame_slot
+	    = static_cast<uint32_t>(m_vk.frame_number % m_vk.frames_in_flight);
+
+	if (m_headless)
+		return;
 
 	VkPresentInfoKHR present_info = {};
 	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -705,43 +1483,259 @@ auto VulkanRenderer::render() -> void
 
 	present_info.pImageIndices = &swapchain_image_idx;
 
+	VkPresentIdKHR present_id {};
+	if (m_vk.present_wait) {
+		m_vk.present_id++;
+		present_id.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		present_id.pNext = nullptr;
+		present_id.swapchainCount = 1;
+		present_id.pPresentIds = &m_vk.present_id;
+		present_info.pNext = &present_id;
+	}
+
+	VkFence present_fence { VK_NULL_HANDLE };
+	VkSwapchainPresentFenceInfoEXT present_fence_info {};
+	if (m_vk.swapchain_maintenance) {
+		present_fence = acquire_present_fence();
+		present_fence_info.sType
+		    = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+		present_fence_info.pNext = present_info.pNext;
+		present_fence_info.swapchainCount = 1;
+		present_fence_info.pFences = &present_fence;
+		present_info.pNext = &present_fence_info;
+	}
+
 	auto const present_result
 	    = vkQueuePresentKHR(m_vk.graphics_queue, &present_info);
+	// Signaled even when the present is rejected as out of date.
+	if (present_fence != VK_NULL_HANDLE)
+		m_vk.present_fences.push_back(present_fence);
+	if (present_result == VK_SUCCESS || present_result == VK_SUBOPTIMAL_KHR) {
+		m_vk.pending_presents.emplace_back(
+		    m_vk.present_wait ? m_vk.present_id : frame_value, input_time);
+	}
 	if (present_result == VK_ERROR_OUT_OF_DATE_KHR
 	    || present_result == VK_SUBOPTIMAL_KHR) {
-		int width {}, height {};
-		SDL_GetWindowSize(m_window, &width, &height);
-		recreate_swapchain(
-		    static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+		request_window_extent();
 		return;
 	}
 	VK_CHECK(m_logger, present_result);
 }
 
-auto VulkanRenderer::draw_background(VkCommandBuffer cmd) -> void
+auto VulkanRenderer::wait_last_frame() -> FrameTimings
+{
+	auto const &frame { m_vk.frames.at(m_vk.last_frame_slot) };
+	if (frame.timeline_value == 0)
+		return {};
+
+	wait_frame_value(frame.timeline_value);
+	auto const latency { std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - frame.submit_time) };
+	FrameTimings timings {
+		.record_ms = frame.record_ms,
+		.latency_ms = latency.count(),
+		.gpu_ms = {},
+	};
+
+	timings.gpu_ms = m_vk.profiler.frame_ms(m_vk.last_frame_slot);
+
+	return timings;
+}
+
+auto VulkanRenderer::update_instances(FrameData &frame) -> void
+{
+	auto const &instances { m_vk.scene.instances() };
+	if (frame.scene_generation == m_vk.scene.generation()
+	    && frame.geometry_generation == m_vk.geometry.generation())
+		return;
+
+	auto const count { static_cast<uint32_t>(instances.size()) };
+	if (count > frame.instance_capacity) {
+		// This frame slot's previous submission has completed, so its
+		// buffers can be replaced in place.
+		if (frame.instance_capacity > 0) {
+			destroy_buffer(frame.instance_buffer);
+			destroy_buffer(frame.draw_buffer);
+		}
+
+		frame.instance_capacity
+		    = std::max({ count, frame.instance_capacity * 2, 64u });
+		frame.instance_buffer = create_buffer(
+		    frame.instance_capacity * sizeof(GPUInstance),
+		    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		        | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		    VMA_MEMORY_USAGE_CPU_TO_GPU);
+		frame.draw_buffer = create_buffer(
+		    frame.instance_capacity * sizeof(VkDrawIndexedIndirectCommand),
+		    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+		        | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		        | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		    VMA_MEMORY_USAGE_GPU_ONLY);
+		if (frame.draw_count_buffer.buffer == VK_NULL_HANDLE) {
+			frame.draw_count_buffer = create_buffer(2 * sizeof(uint32_t),
+			    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+			        | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+			        | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+			        | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			    VMA_MEMORY_USAGE_GPU_ONLY);
+		}
+	}
+
+	// 16-bit and 32-bit surfaces need different index buffer bindings, so
+	// they are drawn from separate lists: 16-bit instances first.
+	auto *gpu_instances { static_cast<GPUInstance *>(
+		frame.instance_buffer.info.pMappedData) };
+	uint32_t written { 0 };
+	std::vector<GPUMeshletTask> meshlet_tasks;
+	frame.meshlet_instances = 0;
+	for (auto const type : { VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32 }) {
+		if (type == VK_INDEX_TYPE_UINT32)
+			frame.short_index_instances = written;
+		for (auto const &instance : instances) {
+			auto const &mesh { *instance.mesh };
+			auto const &surface { mesh.surfaces.at(instance.surface) };
+			if (surface.index_type != type)
+				continue;
+
+			auto const has_meshlets { mesh.gpu.meshlets && m_vk.mesh_shading };
+			std::array<GPULod, MAX_LODS> lods {};
+			for (uint32_t l { 0 }; l < surface.lod_count; l++) {
+				auto const &lod { surface.lods[l] };
+				lods[l] = GPULod {
+					.meshlets = has_meshlets
+					    ? m_vk.geometry.address(*mesh.gpu.meshlets)
+					        + lod.meshlet_offset
+					    : 0,
+					.first_index
+					= first_index(mesh.gpu, type) + lod.start_index,
+					.index_count = lod.count,
+					.meshlet_count = has_meshlets ? lod.meshlet_count : 0,
+					.error = lod.error,
+				};
+			}
+
+			// The full level has the most meshlets; the task shader skips
+			// the tasks past those of the level it picks.
+			if (has_meshlets) {
+				frame.meshlet_instances++;
+				for (uint32_t first { 0 }; first < lods[0].meshlet_count;
+				    first += MESHLET_TASK_SIZE)
+					meshlet_tasks.emplace_back(written, first);
+			}
+
+			// Indices are relative to the surface, so the vertex pointer
+			// starts at its first vertex.
+			gpu_instances[written++] = GPUInstance {
+				.model = instance.transform,
+				.bounds = surface.bounds,
+				.position_offset = mesh.position_offset,
+				.vertex_format = static_cast<uint32_t>(mesh.vertex_format),
+				.position_scale = mesh.position_scale,
+				.lod_count = surface.lod_count,
+				.vertex_buffer = m_vk.geometry.address(mesh.gpu.vertices)
+				    + surface.base_vertex * vertex_stride(mesh.vertex_format),
+				.padding = 0,
+				.lods = lods,
+			};
+		}
+	}
+	if (count > 0) {
+		vmaFlushAllocation(m_vk.allocator, frame.instance_buffer.allocation, 0,
+		    count * sizeof(GPUInstance));
+	}
+
+	auto const task_count { static_cast<uint32_t>(meshlet_tasks.size()) };
+	if (task_count > frame.meshlet_task_capacity) {
+		if (frame.meshlet_task_capacity > 0)
+			destroy_buffer(frame.meshlet_task_buffer);
+		frame.meshlet_task_capacity
+		    = std::max({ task_count, frame.meshlet_task_capacity * 2, 64u });
+		frame.meshlet_task_buffer = create_buffer(
+		    frame.meshlet_task_capacity * sizeof(GPUMeshletTask),
+		    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		        | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		    VMA_MEMORY_USAGE_CPU_TO_GPU);
+	}
+	if (task_count > 0) {
+		std::memcpy(frame.meshlet_task_buffer.info.pMappedData,
+		    meshlet_tasks.data(), task_count * sizeof(GPUMeshletTask));
+		vmaFlushAllocation(m_vk.allocator,
+		    frame.meshlet_task_buffer.allocation, 0,
+		    task_count * sizeof(GPUMeshletTask));
+	}
+	frame.meshlet_task_count = task_count;
+
+	frame.instance_count = count;
+	frame.scene_generation = m_vk.scene.generation();
+	frame.geometry_generation = m_vk.geometry.generation();
+}
+
+auto VulkanRenderer::cull_instances(VkCommandBuffer cmd) -> void
 {
+	auto const &frame { m_vk.get_current_frame() };
+	if (frame.instance_count == 0)
+		return;
+
+	vkCmdFillBuffer(
+	    cmd, frame.draw_count_buffer.buffer, 0, 2 * sizeof(uint32_t), 0);
+
+	BarrierBuilder {}
+	    .buffer(frame.draw_count_buffer.buffer, sync::CLEAR_WRITE,
+	        sync::COMPUTE_READ_WRITE)
+	    .record(cmd);
+
 	vkCmdBindPipeline(
-	    cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_vk.gradient_pipeline);
+	    cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_vk.cull_pipeline.get());
+
+	GPUCullPushConstants push_constants {
+		.view_proj = m_vk.view_proj,
+		.instances = buffer_address(frame.instance_buffer),
+		.draws = buffer_address(frame.draw_buffer),
+		.draw_count = buffer_address(frame.draw_count_buffer),
+		.instance_count = frame.instance_count,
+		.short_index_instances = frame.short_index_instances,
+		.lod_scale = m_vk.lod_scale,
+		.padding = 0,
+	};
+	vkCmdPushConstants(cmd, m_vk.cull_pipeline_layout,
+	    VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+	vkCmdDispatch(cmd, (frame.instance_count + 63) / 64, 1, 1);
+}
+
+auto VulkanRenderer::draw_background(VkCommandBuffer cmd) -> void
+{
+	auto const pipeline { m_vk.gradient_pipeline.get() };
+	if (pipeline == VK_NULL_HANDLE) {
+		VkClearColorValue const clear { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		auto const range { BarrierBuilder::range(VK_IMAGE_ASPECT_COLOR_BIT) };
+		vkCmdClearColorImage(cmd, m_vk.draw_image.image,
+		    VK_IMAGE_LAYOUT_GENERAL, &clear, 1, &range);
+		return;
+	}
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
 	    m_vk.gradient_pipeline_layout, 0, 1, &m_vk.draw_image_descriptors, 0,
 	    nullptr);
+	vkCmdPushConstants(cmd, m_vk.gradient_pipeline_layout,
+	    VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(VkExtent2D), &m_vk.draw_extent);
 	vkCmdDispatch(cmd,
 	    static_cast<uint32_t>(std::ceil(m_vk.draw_extent.width / 16.0)),
 	    static_cast<uint32_t>(std::ceil(m_vk.draw_extent.height / 16.0)), 1);
 }
 
-auto VulkanRenderer::draw_geometry(VkCommandBuffer cmd) -> void
+auto VulkanRenderer::draw_geometry(
+    VkCommandBuffer cmd, VkImageView depth_view, ScenePath scene_path) -> void
 {
 	auto color_att { vkinit::attachment_info(m_vk.draw_image.image_view,
 		nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) };
+	auto depth_att { vkinit::depth_attachment_info(depth_view) };
 	auto const render_info { vkinit::render_info(
-		m_vk.draw_extent, &color_att, nullptr) };
+		m_vk.draw_extent, &color_att, &depth_att) };
 
 	vkCmdBeginRendering(cmd, &render_info);
 
-	vkCmdBindPipeline(
-	    cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_vk.triangle_pipeline);
-
 	VkViewport viewport {};
 	viewport.x = 0;
 	viewport.y = 0;
@@ -757,51 +1751,137 @@ auto VulkanRenderer::draw_geometry(VkCommandBuffer cmd) -> void
 	scissor.extent = m_vk.draw_extent;
 	vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-	vkCmdDraw(cmd, 3, 1, 0, 0);
+	// Every mesh lives in the geometry buffer, so one index buffer binding
+	// per index type serves all of the draws below.
+	vkCmdBindIndexBuffer(
+	    cmd, m_vk.geometry.buffer(), 0, VK_INDEX_TYPE_UINT32);
 
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_vk.mesh_pipeline);
+	// Draws whose pipeline is still compiling are skipped.
+	if (auto const pipeline { m_vk.triangle_pipeline.get() }) {
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		vkCmdDraw(cmd, 3, 1, 0, 0);
+	}
 
-	GPUDrawPushConstants push_constants;
-	push_constants.world_matrix = smath::Mat4 { 1.0f };
-	push_constants.vertex_buffer = m_vk.rectangle.vertex_buffer_address;
+	if (auto const pipeline { m_vk.mesh_pipeline.get() }) {
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-	vkCmdPushConstants(cmd, m_vk.mesh_pipeline_layout,
-	    VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants), &push_constants);
-	vkCmdBindIndexBuffer(
-	    cmd, m_vk.rectangle.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+		GPUDrawPushConstants const push_constants {
+			.world_matrix = smath::Mat4 { 1.0f },
+			.position_offset = { 0.0f, 0.0f, 0.0f },
+			.vertex_format = static_cast<uint32_t>(VertexFormat::Full),
+			.position_scale = { 1.0f, 1.0f, 1.0f },
+			.padding = 0,
+			.vertex_buffer = m_vk.geometry.address(m_vk.rectangle.vertices),
+		};
 
-	vkCmdDrawIndexed(cmd, 6, 1, 0, 0, 0);
+		vkCmdPushConstants(cmd, m_vk.mesh_pipeline_layout,
+		    VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants),
+		    &push_constants);
 
-	push_constants.vertex_buffer
-	    = m_vk.test_meshes[2]->mesh_buffers.vertex_buffer_address;
+		vkCmdDrawIndexed(cmd, m_vk.rectangle.index_bytes / sizeof(uint32_t),
+		    1, first_index(m_vk.rectangle, VK_INDEX_TYPE_UINT32), 0, 0);
+	}
 
-	auto model { smath::Mat4::identity() };
-	// auto model { smath::translate(smath::Vec3 { 0.0f, 0.0f, -3.0f }) };
+	auto const &frame { m_vk.get_current_frame() };
+	if (scene_path == ScenePath::Meshlets && frame.meshlet_task_count > 0) {
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+		    m_vk.meshlet_pipeline.get());
+
+		GPUMeshletPushConstants const meshlet_constants {
+			.view_proj = m_vk.view_proj,
+			.camera_position = m_vk.camera_position,
+			.task_count = frame.meshlet_task_count,
+			.instances = buffer_address(frame.instance_buffer),
+			.tasks = buffer_address(frame.meshlet_task_buffer),
+			.lod_scale = m_vk.lod_scale,
+			.padding = 0,
+		};
+		vkCmdPushConstants(cmd, m_vk.meshlet_pipeline_layout,
+		    VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, 0,
+		    sizeof(meshlet_constants), &meshlet_constants);
+
+		// One task workgroup per task; counts past the 65535 every device
+		// supports in x wrap into y, and the task shader skips the excess.
+		constexpr uint32_t max_groups { 65535 };
+		auto const tasks { frame.meshlet_task_count };
+		m_vk.draw_mesh_tasks(cmd, std::min(tasks, max_groups),
+		    (tasks + max_groups - 1) / max_groups, 1);
+	} else if (scene_path == ScenePath::Indirect) {
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+		    m_vk.mesh_indirect_pipeline.get());
+
+		GPUIndirectPushConstants indirect_constants {
+			.view_proj = m_vk.view_proj,
+			.instances = buffer_address(frame.instance_buffer),
+		};
+		vkCmdPushConstants(cmd, m_vk.mesh_indirect_pipeline_layout,
+		    VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(indirect_constants),
+		    &indirect_constants);
+
+		// The cull pass writes the 16-bit draws from the start of the draw
+		// buffer and the 32-bit ones after them, each with its own count.
+		auto const split { frame.short_index_instances };
+		if (split > 0) {
+			vkCmdBindIndexBuffer(
+			    cmd, m_vk.geometry.buffer(), 0, VK_INDEX_TYPE_UINT16);
+			vkCmdDrawIndexedIndirectCount(cmd, frame.draw_buffer.buffer, 0,
+			    frame.draw_count_buffer.buffer, 0, split,
+			    sizeof(VkDrawIndexedIndirectCommand));
+		}
+		if (split < frame.instance_count) {
+			vkCmdBindIndexBuffer(
+			    cmd, m_vk.geometry.buffer(), 0, VK_INDEX_TYPE_UINT32);
+			vkCmdDrawIndexedIndirectCount(cmd, frame.draw_buffer.buffer,
+			    split * sizeof(VkDrawIndexedIndirectCommand),
+			    frame.draw_count_buffer.buffer, sizeof(uint32_t),
+			    frame.instance_count - split,
+			    sizeof(VkDrawIndexedIndirectCommand));
+		}
+	}
 
-	auto view { smath::matrix_look_at(smath::Vec3 { 0.0f, 0.0f, 3.0f },
-		smath::Vec3 { 0.0f, 0.0f, 0.0f }, smath::Vec3 { 0.0f, 1.0f, 0.0f },
-		false) };
+	vkCmdEndRendering(cmd);
+}
 
-	// auto projection { smath::Mat4::identity() };
-	// projection[1][1] *= -1;
-	auto projection {
-		smath::matrix_perspective(smath::deg(70.0f),
-		    static_cast<float>(m_vk.draw_extent.width)
-		        / static_cast<float>(m_vk.draw_extent.height),
-		    0.1f, 10000.0f),
-	};
+auto VulkanRenderer::draw_upscale(
+    VkCommandBuffer cmd, VkImageView target_image_view) -> void
+{
+	auto const color_attachment { vkinit::attachment_info(
+		target_image_view, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) };
+	auto const render_info { vkinit::render_info(
+		m_vk.swapchain_extent, &color_attachment, nullptr) };
 
-	push_constants.world_matrix = projection * view * model;
-	push_constants.world_matrix[1][1] *= -1;
+	vkCmdBeginRendering(cmd, &render_info);
 
-	vkCmdPushConstants(cmd, m_vk.mesh_pipeline_layout,
-	    VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants), &push_constants);
-	vkCmdBindIndexBuffer(cmd,
-	    m_vk.test_meshes[2]->mesh_buffers.index_buffer.buffer, 0,
-	    VK_INDEX_TYPE_UINT32);
+	VkViewport viewport {};
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = static_cast<float>(m_vk.swapchain_extent.width);
+	viewport.height = static_cast<float>(m_vk.swapchain_extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
 
-	vkCmdDrawIndexed(cmd, m_vk.test_meshes[2]->surfaces[0].count, 1,
-	    m_vk.test_meshes[2]->surfaces[0].start_index, 0, 0);
+	VkRect2D scissor {};
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+	scissor.extent = m_vk.swapchain_extent;
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	vkCmdBindPipeline(
+	    cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_vk.upscale_pipeline.get());
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+	    m_vk.upscale_pipeline_layout, 0, 1,
+	    &m_vk.draw_image_sampled_descriptors, 0, nullptr);
+	GPUUpscalePushConstants const push_constants {
+		.source_size = { static_cast<float>(m_vk.draw_extent.width),
+		    static_cast<float>(m_vk.draw_extent.height) },
+		.image_size = { static_cast<float>(m_vk.draw_image.extent.width),
+		    static_cast<float>(m_vk.draw_image.extent.height) },
+	};
+	vkCmdPushConstants(cmd, m_vk.upscale_pipeline_layout,
+	    VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push_constants),
+	    &push_constants);
+	vkCmdDraw(cmd, 3, 1, 0, 0);
 
 	vkCmdEndRendering(cmd);
 }
@@ -812,7 +1892,7 @@ auto VulkanRenderer::draw_imgui(
 	auto const color_attachment { vkinit::attachment_info(
 		target_image_view, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) };
 	auto const render_info { vkinit::render_info(
-		m_vk.draw_extent, &color_attachment, nullptr) };
+		m_vk.swapchain_extent, &color_attachment, nullptr) };
 
 	vkCmdBeginRendering(cmd, &render_info);
 
@@ -823,6 +1903,22 @@ auto VulkanRenderer::draw_imgui(
 
 auto VulkanRenderer::create_swapchain(uint32_t width, uint32_t height) -> void
 {
+	uint32_t mode_count { 0 };
+	VK_CHECK(m_logger,
+	    vkGetPhysicalDeviceSurfacePresentModesKHR(
+	        m_vkb.phys_dev, m_vk.surface, &mode_count, nullptr));
+	std::vector<VkPresentModeKHR> modes(mode_count);
+	VK_CHECK(m_logger,
+	    vkGetPhysicalDeviceSurfacePresentModesKHR(
+	        m_vkb.phys_dev, m_vk.surface, &mode_count, modes.data()));
+	auto present_mode { m_vk.desired_present_mode };
+	if (std::ranges::find(modes, to_vk_present_mode(present_mode))
+	    == modes.end()) {
+		m_logger.debug(CATEGORY, "{} presentation is unsupported, using FIFO",
+		    present_mode_name(present_mode));
+		present_mode = PresentMode::Fifo;
+	}
+
 	vkb::SwapchainBuilder builder { m_vkb.phys_dev, m_vkb.dev, m_vk.surface };
 	m_vk.swapchain_image_format = VK_FORMAT_B8G8R8A8_UNORM;
 	auto const swapchain_ret { builder
@@ -830,16 +1926,24 @@ auto VulkanRenderer::create_swapchain(uint32_t width, uint32_t height) -> void
 		        .format = m_vk.swapchain_image_format,
 		        .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
 		    })
-		    .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+		    .set_desired_present_mode(to_vk_present_mode(present_mode))
 		    .set_desired_extent(width, height)
 		    .add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		    .set_old_swapchain(m_vk.swapchain)
 		    .build() };
 	if (!swapchain_ret) {
 		std::println(std::cerr, "Failed to create swapchain. Error: {}",
 		    swapchain_ret.error().message());
 		throw std::runtime_error("App init fail");
 	}
+	// The driver may hand resources over from the old swapchain, which is
+	// retired now and destroyed once no frame uses it.
+	retire_swapchain();
 	m_vkb.swapchain = swapchain_ret.value();
+	m_vk.present_mode = present_mode;
+	// The window may have moved to another display.
+	m_vk.refresh_interval_ms = 1000.0
+	    / static_cast<double>(display_refresh_rate(m_window));
 
 	m_vk.swapchain = m_vkb.swapchain.swapchain;
 	m_vk.swapchain_extent = m_vkb.swapchain.extent;
@@ -872,7 +1976,8 @@ auto VulkanRenderer::create_draw_image(uint32_t width, uint32_t height) -> void
 	VkImageCreateInfo rimg_ci { vkinit::image_create_info(
 		m_vk.draw_image.format,
 		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT
-		    | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+		    | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+		    | VK_IMAGE_USAGE_SAMPLED_BIT,
 		m_vk.draw_image.extent) };
 	VmaAllocationCreateInfo rimg_alloci {};
 	rimg_alloci.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -905,7 +2010,19 @@ auto VulkanRenderer::update_draw_image_descriptor() -> void
 	draw_img_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	draw_img_write.pImageInfo = &img_info;
 
-	vkUpdateDescriptorSets(m_vkb.dev, 1, &draw_img_write, 0, nullptr);
+	VkDescriptorImageInfo sampled_info {};
+	sampled_info.sampler = m_vk.linear_sampler;
+	sampled_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	sampled_info.imageView = m_vk.draw_image.image_view;
+
+	VkWriteDescriptorSet sampled_write { draw_img_write };
+	sampled_write.dstSet = m_vk.draw_image_sampled_descriptors;
+	sampled_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	sampled_write.pImageInfo = &sampled_info;
+
+	std::array const writes { draw_img_write, sampled_write };
+	vkUpdateDescriptorSets(m_vkb.dev, static_cast<uint32_t>(writes.size()),
+	    writes.data(), 0, nullptr);
 }
 
 auto VulkanRenderer::destroy_draw_image() -> void
@@ -925,25 +2042,103 @@ auto VulkanRenderer::destroy_draw_image() -> void
 
 auto VulkanRenderer::recreate_swapchain(uint32_t width, uint32_t height) -> void
 {
-	vkDeviceWaitIdle(m_vkb.dev);
-
+	// Minimized; nothing renders until the window has an area again.
 	if (width == 0 || height == 0) {
-		destroy_swapchain();
-		destroy_draw_image();
-		m_vk.swapchain_extent = { 0, 0 };
+		retire_swapchain();
 		return;
 	}
 
-	destroy_swapchain();
-	destroy_draw_image();
-
 	create_swapchain(width, height);
+	ensure_draw_image(m_vk.swapchain_extent);
+}
+
+auto VulkanRenderer::ensure_draw_image(VkExtent2D extent) -> void
+{
+	auto const current { m_vk.draw_image.extent };
+	if (extent.width <= current.width && extent.height <= current.height)
+		return;
+
+	// Outgrown sides grow by at least half, so a window dragged past the
+	// largest display reallocates a few times rather than every frame.
+	auto const limit { m_vkb.phys_dev.properties.limits.maxImageDimension2D };
+	auto const grow { [&](uint32_t wanted, uint32_t size) {
+		if (wanted <= size)
+			return size;
+		return std::min(std::max(wanted, size + size / 2), limit);
+	} };
+	auto const width { grow(extent.width, current.width) };
+	auto const height { grow(extent.height, current.height) };
+
+	// Frames in flight still read the draw image through its descriptor
+	// set, so only the graphics timeline has to catch up.
+	wait_frame_value(m_vk.frame_timeline_value);
 	create_draw_image(width, height);
 	update_draw_image_descriptor();
+	m_logger.debug(CATEGORY, "Grew the draw image to {}x{}", width, height);
+}
+
+auto VulkanRenderer::request_window_extent() -> void
+{
+	int width {}, height {};
+	SDL_GetWindowSize(m_window, &width, &height);
+	m_vk.pending_extent = VkExtent2D {
+		static_cast<uint32_t>(width),
+		static_cast<uint32_t>(height),
+	};
+}
+
+auto VulkanRenderer::retire_swapchain() -> void
+{
+	if (m_vk.swapchain == VK_NULL_HANDLE)
+		return;
+
+	if (m_vk.swapchain_maintenance) {
+		m_vk.retired_swapchains.push_back(RetiredSwapchain {
+		    .value = m_vk.frame_timeline_value,
+		    .swapchain = m_vk.swapchain,
+		    .views = std::move(m_vk.swapchain_image_views),
+		    .semaphores = std::move(m_vk.present_semaphores),
+		    .fences = { m_vk.present_fences.begin(),
+		        m_vk.present_fences.end() },
+		});
+		m_vk.present_fences.clear();
+	} else {
+		// Nothing reports when a present has consumed its wait semaphores.
+		// This assumes presents queued behind the last submitted frame have
+		// by the time the next frame completes on the same queue. That
+		// holds in practice, but the spec does not guarantee it.
+		m_vk.retired.emplace(m_vk.frame_timeline_value + 1,
+		    [dev = m_vkb.dev, swapchain = m_vk.swapchain,
+		        views = std::move(m_vk.swapchain_image_views),
+		        semaphores = std::move(m_vk.present_semaphores)] {
+			    for (auto const semaphore : semaphores)
+				    vkDestroySemaphore(dev, semaphore, nullptr);
+			    for (auto const view : views)
+				    vkDestroyImageView(dev, view, nullptr);
+			    vkDestroySwapchainKHR(dev, swapchain, nullptr);
+		    });
+	}
+
+	m_vk.swapchain = VK_NULL_HANDLE;
+	m_vk.swapchain_image_views.clear();
+	m_vk.swapchain_images.clear();
+	m_vk.present_semaphores.clear();
+	m_vk.swapchain_extent = { 0, 0 };
+	// Present IDs belong to the swapchain.
+	m_vk.pending_presents.clear();
+	m_vk.present_id = 0;
 }
 
 auto VulkanRenderer::destroy_swapchain() -> void
 {
+	// Outstanding presents were waited for by collect_present_fences().
+	for (auto const fence : m_vk.present_fences)
+		vkDestroyFence(m_vkb.dev, fence, nullptr);
+	for (auto const fence : m_vk.spare_present_fences)
+		vkDestroyFence(m_vkb.dev, fence, nullptr);
+	m_vk.present_fences.clear();
+	m_vk.spare_present_fences.clear();
+
 	if (m_vk.swapchain == VK_NULL_HANDLE)
 		return;
 
@@ -962,6 +2157,93 @@ auto VulkanRenderer::destroy_swapchain() -> void
 	m_vk.swapchain_extent = { 0, 0 };
 }
 
+auto VulkanRenderer::collect_present_fences(bool block) -> void
+{
+	if (block) {
+		std::vector<VkFence> fences { m_vk.present_fences.begin(),
+			m_vk.present_fences.end() };
+		for (auto const &retired : m_vk.retired_swapchains)
+			fences.insert(
+			    fences.end(), retired.fences.begin(), retired.fences.end());
+		// Presents to a lost surface may never signal; give up after a
+		// second rather than hang on shutdown.
+		if (!fences.empty()) {
+			vkWaitForFences(m_vkb.dev, static_cast<uint32_t>(fences.size()),
+			    fences.data(), VK_TRUE, 1'000'000'000);
+		}
+	}
+
+	auto const signaled { [this](VkFence fence) {
+		return vkGetFenceStatus(m_vkb.dev, fence) == VK_SUCCESS;
+	} };
+	auto const recycle { [this](VkFence fence) {
+		VK_CHECK(m_logger, vkResetFences(m_vkb.dev, 1, &fence));
+		m_vk.spare_present_fences.push_back(fence);
+	} };
+
+	while (!m_vk.present_fences.empty()
+	    && signaled(m_vk.present_fences.front())) {
+		recycle(m_vk.present_fences.front());
+		m_vk.present_fences.pop_front();
+	}
+
+	auto const completed { completed_frame_value() };
+	while (!m_vk.retired_swapchains.empty()) {
+		auto &retired { m_vk.retired_swapchains.front() };
+		if (!block
+		    && (retired.value > completed
+		        || !std::ranges::all_of(retired.fences, signaled)))
+			break;
+
+		for (auto const semaphore : retired.semaphores)
+			vkDestroySemaphore(m_vkb.dev, semaphore, nullptr);
+		for (auto const view : retired.views)
+			vkDestroyImageView(m_vkb.dev, view, nullptr);
+		vkDestroySwapchainKHR(m_vkb.dev, retired.swapchain, nullptr);
+		for (auto const fence : retired.fences)
+			recycle(fence);
+		m_vk.retired_swapchains.pop_front();
+	}
+}
+
+auto VulkanRenderer::acquire_present_fence() -> VkFence
+{
+	if (!m_vk.spare_present_fences.empty()) {
+		auto const fence { m_vk.spare_present_fences.back() };
+		m_vk.spare_present_fences.pop_back();
+		return fence;
+	}
+
+	VkFenceCreateInfo fence_ci {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+	};
+	VkFence fence { VK_NULL_HANDLE };
+	VK_CHECK(m_logger, vkCreateFence(m_vkb.dev, &fence_ci, nullptr, &fence));
+	return fence;
+}
+
+auto VulkanRenderer::acquire_command_buffer(FrameData &frame, uint32_t thread)
+    -> VkCommandBuffer
+{
+	auto &thread_pool { frame.command_pools.at(thread) };
+	if (thread_pool.used == thread_pool.buffers.size()) {
+		VkCommandBufferAllocateInfo ai {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.commandPool = thread_pool.pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		VK_CHECK(m_logger,
+		    vkAllocateCommandBuffers(
+		        m_vkb.dev, &ai, &thread_pool.buffers.emplace_back()));
+	}
+
+	return thread_pool.buffers[thread_pool.used++];
+}
+
 auto VulkanRenderer::create_buffer(size_t alloc_size, VkBufferUsageFlags usage,
     VmaMemoryUsage memory_usage) -> AllocatedBuffer
 {
@@ -976,7 +2258,8 @@ auto VulkanRenderer::create_buffer(size_t alloc_size, VkBufferUsageFlags usage,
 	VmaAllocationCreateInfo alloc_ci {};
 	alloc_ci.usage = memory_usage;
 	alloc_ci.flags = 0;
-	if (memory_usage == VMA_MEMORY_USAGE_CPU_ONLY) {
+	if (memory_usage == VMA_MEMORY_USAGE_CPU_ONLY
+	    || memory_usage == VMA_MEMORY_USAGE_CPU_TO_GPU) {
 		alloc_ci.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT
 		    | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
 	}
@@ -995,72 +2278,162 @@ auto VulkanRenderer::destroy_buffer(AllocatedBuffer &buffer) -> void
 }
 
 auto VulkanRenderer::upload_mesh(
-    std::span<uint32_t> indices, std::span<Vertex> vertices) -> GPUMeshBuffers
+    std::span<uint32_t> indices, std::span<Vertex> vertices) -> GPUMesh
 {
-	auto const vertex_buffer_size { vertices.size() * sizeof(Vertex) };
-	auto const index_buffer_size { indices.size() * sizeof(uint32_t) };
-
-	GPUMeshBuffers new_surface;
-	new_surface.vertex_buffer = create_buffer(vertex_buffer_size,
-	    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-	        | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-	    VMA_MEMORY_USAGE_GPU_ONLY);
+	MeshData const data {
+		.indices = std::as_bytes(indices),
+		.vertices = std::as_bytes(vertices),
+		.vertex_format = VertexFormat::Full,
+		.meshlets = {},
+	};
+	return upload_meshes({ &data, 1 }).front();
+}
 
-	VkBufferDeviceAddressInfo device_address_info {};
-	device_address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-	device_address_info.buffer = new_surface.vertex_buffer.buffer;
+auto VulkanRenderer::upload_meshes(std::span<MeshData const> meshes)
+    -> std::vector<GPUMesh>
+{
+	std::vector<GPUMesh> gpu_meshes;
+	gpu_meshes.reserve(meshes.size());
+	for (auto const &data : meshes) {
+		gpu_meshes.emplace_back(GPUMesh {
+		    .vertices = m_vk.geometry.allocate(
+		        data.vertices.size_bytes(), alignof(smath::Vec4)),
+		    .indices = m_vk.geometry.allocate(
+		        data.indices.size_bytes(), sizeof(uint32_t)),
+		    .vertex_count = static_cast<uint32_t>(data.vertices.size()
+		        / vertex_stride(data.vertex_format)),
+		    .index_bytes = static_cast<uint32_t>(data.indices.size()),
+		    .meshlets = data.meshlets.empty()
+		        ? std::nullopt
+		        : std::optional { m_vk.geometry.allocate(
+		              data.meshlets.size_bytes(), alignof(smath::Vec4)) },
+		    .upload_ticket = {},
+		});
+	}
 
-	new_surface.vertex_buffer_address
-	    = vkGetBufferDeviceAddress(m_vkb.dev, &device_address_info);
+	// Offsets are only read once every range exists, since growing the
+	// geometry buffer may move earlier ranges.
+	UploadTicket ticket {};
+	for (size_t i { 0 }; i < meshes.size(); i++) {
+		auto const &mesh { gpu_meshes[i] };
+		m_vk.uploads.enqueue_buffer(m_vk.geometry.buffer(),
+		    m_vk.geometry.offset(mesh.vertices), meshes[i].vertices);
+		ticket = m_vk.uploads.enqueue_buffer(m_vk.geometry.buffer(),
+		    m_vk.geometry.offset(mesh.indices), meshes[i].indices);
+		if (mesh.meshlets) {
+			ticket = m_vk.uploads.enqueue_buffer(m_vk.geometry.buffer(),
+			    m_vk.geometry.offset(*mesh.meshlets), meshes[i].meshlets);
+		}
+	}
+	// Timeline values only grow, so the last ticket covers every copy.
+	for (auto &mesh : gpu_meshes)
+		mesh.upload_ticket = ticket;
 
-	new_surface.index_buffer = create_buffer(index_buffer_size,
-	    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-	        | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-	    VMA_MEMORY_USAGE_GPU_ONLY);
+	return gpu_meshes;
+}
 
-	auto staging { create_buffer(vertex_buffer_size + index_buffer_size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY) };
+auto VulkanRenderer::free_mesh(GPUMesh const &mesh) -> void
+{
+	// The frame being recorded may still draw the mesh.
+	m_vk.retired.emplace(m_vk.frame_timeline_value + 1, [this, mesh]() {
+		m_vk.geometry.free(mesh.vertices);
+		m_vk.geometry.free(mesh.indices);
+		if (mesh.meshlets)
+			m_vk.geometry.free(*mesh.meshlets);
+
+		// Compact once the free space has splintered enough that large
+		// meshes would force the buffer to grow.
+		if (m_vk.geometry.fragmentation() > 0.5f
+		    && m_vk.geometry.used_bytes() < m_vk.geometry.capacity() / 2)
+			m_vk.geometry.defragment();
+	});
+}
 
-	VmaAllocationInfo info {};
-	vmaGetAllocationInfo(m_vk.allocator, staging.allocation, &info);
+auto VulkanRenderer::buffer_address(AllocatedBuffer const &buffer) const
+    -> VkDeviceAddress
+{
+	VkBufferDeviceAddressInfo address_info {};
+	address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	address_info.buffer = buffer.buffer;
+	return vkGetBufferDeviceAddress(m_vkb.dev, &address_info);
+}
 
-	void *data = info.pMappedData;
-	if (!data) {
-		VkResult res = vmaMapMemory(m_vk.allocator, staging.allocation, &data);
-		assert(res == VK_SUCCESS);
-	}
-	defer({
-		if (info.pMappedData == nullptr) {
-			vmaUnmapMemory(m_vk.allocator, staging.allocation);
-		}
-	});
+auto VulkanRenderer::projection() const -> smath::Mat4
+{
+	auto proj {
+		smath::matrix_perspective(smath::deg(70.0f),
+		    static_cast<float>(m_vk.draw_extent.width)
+		        / static_cast<float>(m_vk.draw_extent.height),
+		    0.1f, 10000.0f),
+	};
+	proj[1][1] *= -1;
+	return proj;
+}
 
-	memcpy(data, vertices.data(), vertex_buffer_size);
-	memcpy(reinterpret_cast<void *>(
-	           reinterpret_cast<size_t>(data) + vertex_buffer_size),
-	    indices.data(), index_buffer_size);
+auto VulkanRenderer::view_projection() const -> smath::Mat4
+{
+	auto view { smath::matrix_look_at(m_vk.camera_position,
+		smath::Vec3 { 0.0f, 0.0f, 0.0f }, smath::Vec3 { 0.0f, 1.0f, 0.0f },
+		false) };
 
-	immediate_submit([&](VkCommandBuffer cmd) {
-		VkBufferCopy vertex_copy {};
-		vertex_copy.dstOffset = 0;
-		vertex_copy.srcOffset = 0;
-		vertex_copy.size = vertex_buffer_size;
+	return projection() * view;
+}
 
-		vkCmdCopyBuffer(cmd, staging.buffer, new_surface.vertex_buffer.buffer,
-		    1, &vertex_copy);
+auto VulkanRenderer::lod_scale() const -> float
+{
+	// An infinite budget keeps every instance at full detail.
+	if (m_lod_pixel_error <= 0.0f)
+		return std::numeric_limits<float>::max();
+
+	// Pixels covered by one unit at view depth 1.
+	auto const pixels_per_unit { std::abs(projection()[1][1])
+		* static_cast<float>(m_vk.draw_extent.height) * 0.5f };
+	return pixels_per_unit / m_lod_pixel_error;
+}
 
-		VkBufferCopy index_copy {};
-		index_copy.dstOffset = 0;
-		index_copy.srcOffset = vertex_buffer_size;
-		index_copy.size = index_buffer_size;
+auto VulkanRenderer::completed_frame_value() const -> uint64_t
+{
+	uint64_t value { 0 };
+	VK_CHECK(m_logger,
+	    vkGetSemaphoreCounterValue(m_vkb.dev, m_vk.frame_timeline, &value));
+	return value;
+}
 
-		vkCmdCopyBuffer(cmd, staging.buffer, new_surface.index_buffer.buffer, 1,
-		    &index_copy);
-	});
+auto VulkanRenderer::wait_frame_value(uint64_t value) const -> void
+{
+	if (value == 0)
+		return;
 
-	destroy_buffer(staging);
+	VkSemaphoreWaitInfo wait_info {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.semaphoreCount = 1,
+		.pSemaphores = &m_vk.frame_timeline,
+		.pValues = &value,
+	};
+	// Slow devices, e.g. software rasterizers on large scenes, can take
+	// longer than the timeout for a frame; only errors are fatal.
+	for (;;) {
+		auto const result {
+			vkWaitSemaphores(m_vkb.dev, &wait_info, 1'000'000'000)
+		};
+		if (result != VK_TIMEOUT) {
+			VK_CHECK(m_logger, result);
+			return;
+		}
+		m_logger.warn(CATEGORY,
+		    "Still waiting for frame {} after a second", value);
+	}
+}
 
-	return new_surface;
+auto VulkanRenderer::first_index(GPUMesh const &mesh, VkIndexType type) const
+    -> uint32_t
+{
+	auto const index_size { type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+		                                                 : sizeof(uint32_t) };
+	return static_cast<uint32_t>(
+	    m_vk.geometry.offset(mesh.indices) / index_size);
 }
 
 } // namespace Lunar
@@ -1,6 +1,11 @@
 #pragma once
 
 #include <array>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <string_view>
 #include <vector>
 
 #include <SDL3/SDL_video.h>
@@ -11,60 +16,382 @@
 
 #include "DeletionQueue.h"
 #include "DescriptorAllocator.h"
+#include "DynamicResolution.h"
+#include "GeometryBuffer.h"
+#include "GpuProfiler.h"
+#include "JobSystem.h"
 #include "Loader.h"
 #include "Logger.h"
+#include "PipelineCache.h"
+#include "RenderGraph.h"
+#include "Scene.h"
 #include "Types.h"
+#include "UploadQueue.h"
 
 namespace Lunar {
 
+// The dequantization fields only apply to VertexFormat::Compact vertices;
+// see Mesh::position_offset.
 struct GPUDrawPushConstants {
 	smath::Mat4 world_matrix;
+	smath::Vec3 position_offset;
+	uint32_t vertex_format;
+	smath::Vec3 position_scale;
+	uint32_t padding;
 	VkDeviceAddress vertex_buffer;
 };
 
-constexpr unsigned FRAME_OVERLAP = 2;
+// Mirrors `Lod` in shaders/common.glsl; see Mesh::Lod.
+struct GPULod {
+	// The level's MeshletBlock; 0 without meshlets.
+	VkDeviceAddress meshlets;
+	uint32_t first_index;
+	uint32_t index_count;
+	uint32_t meshlet_count;
+	float error;
+};
+static_assert(sizeof(GPULod) == 24);
+
+// Mirrors `Instance` in shaders/common.glsl. Each instance carries its
+// mesh's vertex format, so one indirect draw covers both, and all of its
+// surface's levels of detail, so the shaders can pick one per frame.
+struct GPUInstance {
+	smath::Mat4 model;
+	smath::Vec4 bounds;
+	smath::Vec3 position_offset;
+	uint32_t vertex_format;
+	smath::Vec3 position_scale;
+	uint32_t lod_count;
+	VkDeviceAddress vertex_buffer;
+	uint64_t padding;
+	std::array<GPULod, MAX_LODS> lods;
+};
+static_assert(sizeof(GPUInstance) == 224);
+
+// Task shader workgroup input: MESHLET_TASK_SIZE meshlets of an instance.
+struct GPUMeshletTask {
+	uint32_t instance;
+	uint32_t first_meshlet;
+};
+
+struct GPUCullPushConstants {
+	smath::Mat4 view_proj;
+	VkDeviceAddress instances;
+	VkDeviceAddress draws;
+	VkDeviceAddress draw_count;
+	uint32_t instance_count;
+	// Instances before this one use 16-bit indices.
+	uint32_t short_index_instances;
+	// See VulkanRenderer::lod_scale().
+	float lod_scale;
+	uint32_t padding;
+};
+static_assert(sizeof(GPUCullPushConstants) <= 128);
+
+struct GPUIndirectPushConstants {
+	smath::Mat4 view_proj;
+	VkDeviceAddress instances;
+};
+
+struct GPUMeshletPushConstants {
+	smath::Mat4 view_proj;
+	// World space, for the normal cone test.
+	smath::Vec3 camera_position;
+	uint32_t task_count;
+	VkDeviceAddress instances;
+	VkDeviceAddress tasks;
+	float lod_scale;
+	uint32_t padding;
+};
+static_assert(sizeof(GPUMeshletPushConstants) <= 128);
+
+// Mirrors the push constants of upscale.frag.
+struct GPUUpscalePushConstants {
+	smath::Vec2 source_size;
+	smath::Vec2 image_size;
+};
+
+// How presented images reach the display; see VkPresentModeKHR.
+enum class PresentMode {
+	// Waits for vblank and never tears. Always supported.
+	Fifo,
+	// Like Fifo, but an image that misses its vblank is shown at once and
+	// may tear.
+	FifoRelaxed,
+	// Waits for vblank; newer images replace queued ones.
+	Mailbox,
+	// Shows images at once and tears.
+	Immediate,
+};
+
+constexpr auto present_mode_name(PresentMode mode) -> std::string_view
+{
+	switch (mode) {
+	case PresentMode::Fifo:
+		return "FIFO";
+	case PresentMode::FifoRelaxed:
+		return "FIFO relaxed";
+	case PresentMode::Mailbox:
+		return "Mailbox";
+	case PresentMode::Immediate:
+		return "Immediate";
+	}
+	return "Unknown";
+}
+
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
+struct RendererConfig {
+	// How many frames the CPU may record ahead of the GPU. 1 minimizes
+	// latency (VR), 3 maximizes throughput. Clamped to
+	// [1, MAX_FRAMES_IN_FLIGHT].
+	uint32_t frames_in_flight { 2 };
+	// Threads recording render graph passes, including the render thread.
+	// 0 uses every hardware thread.
+	uint32_t recording_threads { 0 };
+	// Where compiled pipelines persist between runs; empty disables it.
+	std::filesystem::path pipeline_cache_path {};
+	// Where meshes baked from glTF files are kept; empty disables baking.
+	std::filesystem::path mesh_cache_directory {};
+	// Renders into the offscreen draw image only, without a window, surface,
+	// swapchain or ImGui. Works on software drivers such as lavapipe.
+	bool headless { false };
+	// Draw image size in headless mode.
+	VkExtent2D headless_extent { 1280, 720 };
+	// Output size the draw image is allocated for up front (e.g. an HMD's
+	// largest eye resolution); 0 uses the largest display. Larger outputs
+	// grow it.
+	VkExtent2D max_draw_extent { 0, 0 };
+	// Times every render graph pass on the GPU; see gpu_profiler(). Also
+	// the source of whole-frame GPU times. Needs timestamp support.
+	bool gpu_profiling { true };
+	// Also counts each pass's vertices, primitives and shader invocations
+	// where the device supports pipeline statistics queries.
+	bool pipeline_statistics { false };
+	// Falls back to Fifo where the surface lacks it.
+	PresentMode present_mode { PresentMode::Fifo };
+	// Starts each frame as late as still makes its vblank; see
+	// VulkanRenderer::pace_frame().
+	bool low_latency { false };
+	bool validation { true };
+	// Draw meshes with task/mesh shaders that cull per meshlet where
+	// VK_EXT_mesh_shader is supported. Otherwise, or when false, the
+	// compute-culled indirect path is used.
+	bool mesh_shading { true };
+	// Largest error, in pixels, that a surface's level of detail may show
+	// on screen. 0 always draws full detail.
+	float lod_pixel_error { 1.0f };
+	// Renders at a fraction of the output size, chosen from the measured
+	// GPU frame time, and upscales to the output; headless frames are left
+	// at the scaled size. Needs gpu_profiling.
+	bool dynamic_resolution { false };
+	// Bounds of the render scale, per axis.
+	float min_resolution_scale { 0.5f };
+	float max_resolution_scale { 1.0f };
+	// GPU time per frame to stay under; 0 uses 90% of the display's
+	// refresh interval, or of 60 Hz headless.
+	float frame_budget_ms { 0.0f };
+};
+
+struct FrameTimings {
+	// CPU time spent in render() once the frame slot was free, up to the
+	// submit.
+	double record_ms { 0.0 };
+	// Host-observed time from the submit until the frame's timeline value
+	// was reached.
+	double latency_ms { 0.0 };
+	// From the start of the frame's first profiled scope to the end of its
+	// last; empty without RendererConfig::gpu_profiling.
+	std::optional<double> gpu_ms {};
+};
 
 struct VulkanRenderer {
-	VulkanRenderer(SDL_Window *window, Logger &logger);
+	VulkanRenderer(
+	    SDL_Window *window, Logger &logger, RendererConfig const &config = {});
 	~VulkanRenderer();
 
+	// Blocks until the next frame should start; call it right before
+	// sampling input. With low latency on, it waits for the last frame to
+	// reach the display, or to finish on the GPU without
+	// VK_KHR_present_wait, then sleeps until the predicted latest start that
+	// still makes the next vblank. Trades throughput for latency: frames
+	// that outgrow a refresh interval drop to every other vblank.
+	auto pace_frame() -> void;
 	auto render() -> void;
 	auto resize(uint32_t width, uint32_t height) -> void;
+	// Blocks until the last submitted frame completed on the GPU and returns
+	// its timings. Meant for benchmarks: it serializes the CPU and GPU.
+	auto wait_last_frame() -> FrameTimings;
+	auto headless() const -> bool { return m_headless; }
+	// Whether the meshlet path is available; meshes only need meshlets
+	// when it is.
+	auto mesh_shading() const -> bool { return m_vk.mesh_shading; }
+	auto mesh_cache_directory() const -> std::filesystem::path const &
+	{
+		return m_mesh_cache_directory;
+	}
+	// Whether every pipeline started at init has finished compiling.
+	auto pipelines_ready() const -> bool;
+	// Share of the output size, per axis, that frames render at.
+	auto resolution_scale() const -> float
+	{
+		return m_vk.dynamic_resolution ? m_vk.resolution.scale() : 1.0f;
+	}
+	auto device_name() const -> std::string_view
+	{
+		return m_vkb.phys_dev.properties.deviceName;
+	}
+
+	// The mode in use, which is Fifo when the requested one is unsupported.
+	auto present_mode() const -> PresentMode { return m_vk.present_mode; }
+	// Recreates the swapchain with `mode` before the next frame.
+	auto set_present_mode(PresentMode mode) -> void;
+	auto low_latency() const -> bool { return m_vk.low_latency; }
+	auto set_low_latency(bool enabled) -> void { m_vk.low_latency = enabled; }
+	// Whether latency is measured up to the display (VK_KHR_present_wait)
+	// rather than up to the end of the frame's GPU work.
+	auto present_wait() const -> bool { return m_vk.present_wait; }
+	// Smoothed time from pace_frame() returning until the frame was
+	// displayed; see present_wait(). Only exact with low latency on,
+	// otherwise completion is noticed up to a frame late.
+	auto latency_ms() const -> double { return m_vk.latency_ms; }
+
+	auto frames_in_flight() const -> uint32_t { return m_vk.frames_in_flight; }
+	// Takes effect from the next frame; no GPU idle is required because
+	// every slot waits for its own last submission before being reused.
+	auto set_frames_in_flight(uint32_t count) -> void;
 
 	auto immediate_submit(std::function<void(VkCommandBuffer cmd)> &&function)
 	    -> void;
+	// Suballocates the mesh from the geometry buffer and queues its data on
+	// the upload queue; returns immediately. The ranges are usable by frames
+	// rendered after the returned ticket.
 	auto upload_mesh(std::span<uint32_t> indices, std::span<Vertex> vertices)
-	    -> GPUMeshBuffers;
-
+	    -> GPUMesh;
+	// upload_mesh() for many meshes at once: every range is allocated up
+	// front and all copies go out in a single upload batch.
+	auto upload_meshes(std::span<MeshData const> meshes)
+	    -> std::vector<GPUMesh>;
+	// Releases the mesh's ranges once in-flight frames no longer use them.
+	auto free_mesh(GPUMesh const &mesh) -> void;
+	auto uploads() -> UploadQueue & { return m_vk.uploads; }
+
+	// Disabled without timestamp support or RendererConfig::gpu_profiling.
+	auto gpu_profiler() -> GpuProfiler & { return m_vk.profiler; }
+	auto gpu_profiler() const -> GpuProfiler const & { return m_vk.profiler; }
+
+	auto scene() -> Scene & { return m_vk.scene; }
+	auto jobs() -> JobSystem & { return m_vk.jobs; }
 	auto logger() const -> Logger & { return m_logger; }
 
 private:
-	auto vk_init() -> void;
-	auto swapchain_init() -> void;
+	auto vk_init(bool validation, bool mesh_shading, bool pipeline_statistics)
+	    -> void;
+	auto swapchain_init(VkExtent2D headless_extent, VkExtent2D max_draw_extent)
+	    -> void;
 	auto commands_init() -> void;
 	auto sync_init() -> void;
+	auto profiler_init(bool enabled) -> void;
+	auto uploads_init() -> void;
+	auto geometry_init() -> void;
+	auto render_graph_init() -> void;
 	auto descriptors_init() -> void;
+	auto pipeline_cache_init(std::filesystem::path const &path) -> void;
 	auto pipelines_init() -> void;
 	auto background_pipelines_init() -> void;
 	auto triangle_pipeline_init() -> void;
 	auto mesh_pipeline_init() -> void;
+	auto cull_pipeline_init() -> void;
+	auto mesh_indirect_pipeline_init() -> void;
+	auto meshlet_pipeline_init() -> void;
+	auto upscale_pipeline_init() -> void;
+	auto dynamic_resolution_init(RendererConfig const &config) -> void;
 	auto imgui_init() -> void;
 	auto default_data_init() -> void;
 
+	auto update_instances(FrameData &frame) -> void;
+	auto cull_instances(VkCommandBuffer cmd) -> void;
 	auto draw_background(VkCommandBuffer cmd) -> void;
-	auto draw_geometry(VkCommandBuffer cmd) -> void;
+	// How the scene's instances are drawn this frame.
+	enum class ScenePath {
+		// Nothing to draw, or the pipelines are still compiling.
+		None,
+		// Compute-culled instances, drawn with indexed indirect draws.
+		Indirect,
+		// Task shaders cull meshlets, mesh shaders draw them.
+		Meshlets,
+	};
+	auto draw_geometry(VkCommandBuffer cmd, VkImageView depth_view,
+	    ScenePath scene_path) -> void;
+	// Logs pipeline creation stats and saves the cache once every pipeline
+	// started by pipelines_init() has finished.
+	auto report_pipelines() -> void;
+	// Scales the draw extent of the draw image up to the swapchain image.
+	auto draw_upscale(VkCommandBuffer cmd, VkImageView target_image_view)
+	    -> void;
 	auto draw_imgui(VkCommandBuffer cmd, VkImageView target_image_view) -> void;
 
 	auto create_swapchain(uint32_t width, uint32_t height) -> void;
 	auto create_draw_image(uint32_t width, uint32_t height) -> void;
+	// Reallocates the draw image only when `extent` does not fit in it.
+	auto ensure_draw_image(VkExtent2D extent) -> void;
 	auto update_draw_image_descriptor() -> void;
 	auto destroy_draw_image() -> void;
+	// Builds the new swapchain from the old one without idling the device.
 	auto recreate_swapchain(uint32_t width, uint32_t height) -> void;
+	// Queues a recreation at the window's current size for the next frame.
+	auto request_window_extent() -> void;
+	// Hands the swapchain, its views and present semaphores over to be
+	// destroyed once its presents have completed.
+	auto retire_swapchain() -> void;
 	auto destroy_swapchain() -> void;
-
+	// With present fences, recycles those that have signaled and destroys
+	// the retired swapchains whose presents have all completed. `block`
+	// waits for every outstanding present first.
+	auto collect_present_fences(bool block) -> void;
+	auto acquire_present_fence() -> VkFence;
+	// Notes the presents that have completed since the last call; with
+	// `block`, waits for all of them. Returns whether it had to wait for
+	// the newest and that one reached the display.
+	auto collect_presents(bool block) -> bool;
+
+	// Hands out the next command buffer of `thread`'s pool for this frame.
+	auto acquire_command_buffer(FrameData &frame, uint32_t thread)
+	    -> VkCommandBuffer;
 	auto create_buffer(size_t alloc_size, VkBufferUsageFlags usage,
 	    VmaMemoryUsage memory_usage) -> AllocatedBuffer;
 	auto destroy_buffer(AllocatedBuffer &buffer) -> void;
+	auto first_index(GPUMesh const &mesh, VkIndexType type) const
+	    -> uint32_t;
+	auto buffer_address(AllocatedBuffer const &buffer) const
+	    -> VkDeviceAddress;
+	auto projection() const -> smath::Mat4;
+	auto view_projection() const -> smath::Mat4;
+	// Object-space error times this, over view depth, is the error on
+	// screen in multiples of the LOD pixel budget.
+	auto lod_scale() const -> float;
+	auto completed_frame_value() const -> uint64_t;
+	auto wait_frame_value(uint64_t value) const -> void;
+
+	// A swapchain waiting on its last presents before it is destroyed.
+	struct RetiredSwapchain {
+		// Frame timeline value of the last frame that rendered to it.
+		uint64_t value;
+		VkSwapchainKHR swapchain;
+		std::vector<VkImageView> views;
+		std::vector<VkSemaphore> semaphores;
+		// Present fences of its presents that had not signaled yet.
+		std::vector<VkFence> fences;
+	};
+
+	// A present, or without VK_KHR_present_wait a frame on the timeline,
+	// whose completion has not been seen yet.
+	struct PendingPresent {
+		// Present ID or frame timeline value.
+		uint64_t value;
+		std::chrono::steady_clock::time_point input_time;
+	};
 
 	struct {
 		vkb::Instance instance;
@@ -76,7 +403,7 @@ private:
 	struct {
 		auto get_current_frame() -> FrameData &
 		{
-			return frames.at(frame_number % frames.size());
+			return frames.at(frame_number % frames_in_flight);
 		}
 
 		VkSwapchainKHR swapchain { VK_NULL_HANDLE };
@@ -86,36 +413,113 @@ private:
 		uint32_t graphics_queue_family { 0 };
 		VkQueue graphics_queue { nullptr };
 
+		uint32_t transfer_queue_family { 0 };
+		VkQueue transfer_queue { nullptr };
+
 		std::vector<VkImage> swapchain_images;
 		std::vector<VkImageView> swapchain_image_views;
 		std::vector<VkSemaphore> present_semaphores;
 		VkExtent2D swapchain_extent;
-
-		std::array<FrameData, FRAME_OVERLAP> frames;
+		// VK_EXT_swapchain_maintenance1: presents signal a fence once their
+		// semaphores and swapchain can be destroyed.
+		bool swapchain_maintenance { false };
+		// Of the current swapchain's presents, oldest first.
+		std::deque<VkFence> present_fences;
+		std::vector<VkFence> spare_present_fences;
+		std::deque<RetiredSwapchain> retired_swapchains;
+		// Size to recreate the swapchain at before the next frame.
+		std::optional<VkExtent2D> pending_extent {};
+		PresentMode desired_present_mode { PresentMode::Fifo };
+		PresentMode present_mode { PresentMode::Fifo };
+
+		// Frame pacing; see pace_frame().
+		bool low_latency { false };
+		bool present_wait { false };
+		PFN_vkWaitForPresentKHR wait_for_present { nullptr };
+		// Last present ID used; IDs restart with every swapchain.
+		uint64_t present_id { 0 };
+		std::deque<PendingPresent> pending_presents;
+		// When pace_frame() last returned, if no frame started since.
+		std::optional<std::chrono::steady_clock::time_point> input_time {};
+		double refresh_interval_ms { 1000.0 / 60.0 };
+		// Smoothed CPU time from input to submit and GPU time per frame.
+		double cpu_work_ms { 0.0 };
+		double gpu_work_ms { 0.0 };
+		double latency_ms { 0.0 };
+
+		std::array<FrameData, MAX_FRAMES_IN_FLIGHT> frames;
+		uint32_t frames_in_flight { 2 };
+
+		// Signaled by every frame submission with a strictly increasing
+		// value; `frame_timeline_value` is the last value submitted.
+		VkSemaphore frame_timeline { VK_NULL_HANDLE };
+		uint64_t frame_timeline_value { 0 };
+		TimelineDeletionQueue retired;
+		// Slot of the last submitted frame.
+		uint32_t last_frame_slot { 0 };
+		// Nanoseconds per timestamp tick; 0 when timestamps are unsupported.
+		float timestamp_period { 0.0f };
+		uint64_t timestamp_mask { 0 };
+		bool pipeline_statistics { false };
+		GpuProfiler profiler;
+		// Allocated for the largest expected output; frames render to its
+		// `draw_extent` corner.
 		AllocatedImage draw_image {};
 		VkExtent2D draw_extent {};
+		bool dynamic_resolution { false };
+		DynamicResolution resolution;
+		VkExtent2D headless_extent {};
+		RenderGraph render_graph;
+		JobSystem jobs;
 
 		VmaAllocator allocator;
 		DescriptorAllocator descriptor_allocator;
 
 		VkDescriptorSet draw_image_descriptors;
 		VkDescriptorSetLayout draw_image_descriptor_layout;
+		// The draw image as a sampled texture, for the upscale.
+		VkDescriptorSet draw_image_sampled_descriptors;
+		VkDescriptorSetLayout draw_image_sampled_descriptor_layout;
+		VkSampler linear_sampler { VK_NULL_HANDLE };
 
-		VkPipeline gradient_pipeline {};
+		PipelineFuture gradient_pipeline {};
 		VkPipelineLayout gradient_pipeline_layout {};
 
-		VkPipeline triangle_pipeline {};
+		PipelineFuture triangle_pipeline {};
 		VkPipelineLayout triangle_pipeline_layout {};
 
-		VkPipeline mesh_pipeline {};
+		PipelineFuture mesh_pipeline {};
 		VkPipelineLayout mesh_pipeline_layout {};
 
-		GPUMeshBuffers rectangle;
+		// Only created with a swapchain.
+		PipelineFuture upscale_pipeline {};
+		VkPipelineLayout upscale_pipeline_layout {};
+
+		PipelineFuture cull_pipeline {};
+		VkPipelineLayout cull_pipeline_layout {};
+
+		PipelineFuture mesh_indirect_pipeline {};
+		VkPipelineLayout mesh_indirect_pipeline_layout {};
+
+		// Only created with mesh shading.
+		bool mesh_shading { false };
+		PFN_vkCmdDrawMeshTasksEXT draw_mesh_tasks { nullptr };
+		PipelineFuture meshlet_pipeline {};
+		VkPipelineLayout meshlet_pipeline_layout {};
+
+		PipelineCache pipeline_cache;
+		std::chrono::steady_clock::time_point pipelines_start {};
+		bool pipelines_reported { false };
+
+		GeometryBuffer geometry;
+		GPUMesh rectangle;
 
 		VkDescriptorPool imgui_descriptor_pool { VK_NULL_HANDLE };
 
 		DeletionQueue deletion_queue;
 
+		UploadQueue uploads;
+
 		VkFence imm_fence {};
 		VkCommandBuffer imm_command_buffer {};
 		VkCommandPool imm_command_pool {};
@@ -123,9 +527,16 @@ private:
 		uint64_t frame_number { 0 };
 
 		std::vector<std::shared_ptr<Mesh>> test_meshes;
+		Scene scene;
+		smath::Vec3 camera_position { 0.0f, 0.0f, 3.0f };
+		smath::Mat4 view_proj { 1.0f };
+		float lod_scale { 0.0f };
 	} m_vk;
 
 	SDL_Window *m_window { nullptr };
+	bool m_headless { false };
+	float m_lod_pixel_error { 1.0f };
+	std::filesystem::path m_mesh_cache_directory;
 	Logger &m_logger;
 };
 